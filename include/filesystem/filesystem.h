@@ -13,7 +13,16 @@
 #include <filesystem/fs_directory_options.h>
 #include <filesystem/fs_file_time_type.h>
 #include <filesystem/fs_file_status.h>
+#include <filesystem/fs_parallel.h>
 #include <filesystem/fs_ops.h>
 #include <filesystem/fs_path.h>
+#include <filesystem/fs_small_path.h>
 #include <filesystem/fs_dir.h>
+#include <filesystem/fs_async.h>
+#include <filesystem/fs_directory_cache.h>
+#include <filesystem/fs_watcher.h>
+#include <filesystem/fs_stat_cache.h>
+#include <filesystem/fs_mapped_file.h>
+#include <filesystem/fs_file_handle.h>
+#include <filesystem/fs_canonicalizer.h>
 // clang-format on
@@ -0,0 +1,235 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/asap_filesystem_api.h>
+#include <filesystem/fs_dir.h>
+#include <filesystem/fs_file_handle.h>
+#include <filesystem/fs_file_status.h>
+#include <filesystem/fs_file_time_type.h>
+#include <filesystem/fs_parallel.h>
+#include <filesystem/fs_path.h>
+
+#include <hedley/hedley.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L &&     \
+    __has_include(<coroutine>)
+#include <coroutine>
+#define ASAP_FS_HAS_COROUTINES 1
+#endif
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                               async_queue
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Runs metadata operations asynchronously, so that many of them can be in
+flight at the same time.
+
+This is an extension to the standard. On Linux, the operations are handed to
+the kernel through io_uring and do not occupy a thread each while they run.
+Operations submitted at the same time from several threads are sent to the
+kernel in one batch. When io_uring is not available, either because the system
+is not Linux or because the kernel is too old or does not allow it, the
+operations are run on the library's thread pool instead, with the same
+results.
+
+Each operation comes in two forms: one calls `done` with the result once the
+operation completes, and the other returns a std::future. The callbacks are
+called from an internal thread, possibly concurrently with each other, and
+should return quickly. They must not throw, and must not call wait() or
+destroy the queue. Errors are reported like the synchronous functions taking a
+std::error_code do, e.g. status() of a missing file gives file_type::not_found,
+and remove() of a missing file gives false without error. A future holds the
+filesystem_error that the throwing synchronous function would have thrown.
+
+The paths are copied, so they do not need to outlive the call. At most
+`queue_depth` operations are in flight at any time: submitting more blocks
+until some complete, except from a callback, where the excess is run on the
+thread pool. The destructor waits for all the submitted operations to
+complete.
+*/
+class ASAP_FILESYSTEM_API async_queue {
+ public:
+  using status_callback = std::function<void(file_status, std::error_code)>;
+  using size_callback = std::function<void(std::uintmax_t, std::error_code)>;
+  using time_callback = std::function<void(file_time_type, std::error_code)>;
+  using handle_callback = std::function<void(file_handle, std::error_code)>;
+  using bool_callback = std::function<void(bool, std::error_code)>;
+  using void_callback = std::function<void(std::error_code)>;
+
+  /// Creates a queue with room for `queue_depth` operations in flight. With
+  /// `allow_io_uring` false, the operations always run on the thread pool.
+  explicit async_queue(std::size_t queue_depth = 256,
+                       bool allow_io_uring = true);
+  async_queue(const async_queue &) = delete;
+  auto operator=(const async_queue &) -> async_queue & = delete;
+  ~async_queue();
+
+  /// Same as status(p, ec).
+  void status(const path &p, status_callback done);
+  auto status(const path &p) -> std::future<file_status>;
+
+  /// Same as symlink_status(p, ec).
+  void symlink_status(const path &p, status_callback done);
+  auto symlink_status(const path &p) -> std::future<file_status>;
+
+  /// Same as file_size(p, ec).
+  void file_size(const path &p, size_callback done);
+  auto file_size(const path &p) -> std::future<std::uintmax_t>;
+
+  /// Same as last_write_time(p, ec).
+  void last_write_time(const path &p, time_callback done);
+  auto last_write_time(const path &p) -> std::future<file_time_type>;
+
+  /// Same as create_directory(p, ec).
+  void create_directory(const path &p, bool_callback done);
+  auto create_directory(const path &p) -> std::future<bool>;
+
+  /// Same as remove(p, ec).
+  void remove(const path &p, bool_callback done);
+  auto remove(const path &p) -> std::future<bool>;
+
+  /// Same as rename(from, to, ec).
+  void rename(const path &from, const path &to, void_callback done);
+  auto rename(const path &from, const path &to) -> std::future<void>;
+
+  /// Same as file_handle(p, flags, ec). The file is always opened on the
+  /// thread pool, where the handle opens it like it does when constructed.
+  void open(const path &p, open_flags flags, handle_callback done);
+  auto open(const path &p, open_flags flags = open_flags::read)
+      -> std::future<file_handle>;
+
+  /// Blocks until all the operations submitted so far have completed and their
+  /// callbacks have returned.
+  void wait();
+
+  /// Whether the operations are run by the kernel with io_uring. Operations
+  /// that the running kernel cannot run this way still go to the thread pool.
+  auto uses_io_uring() const noexcept -> bool;
+
+ private:
+  class Impl;
+
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+  std::unique_ptr<Impl> impl_;
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(pop)
+#endif
+};
+
+// -----------------------------------------------------------------------------
+//                          async_directory_reader
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Lists a directory without blocking the calling thread, handing out its
+entries in batches.
+
+This is an extension to the standard. Reading a directory can block for a long
+time, e.g. on a network file system, which is not acceptable on the thread of
+an event loop. Each call to next() reads the next batch of entries on a thread
+dedicated to blocking I/O, and then calls `done` with them. When an executor is
+given, `done` is called through it, e.g. to get back onto the event loop;
+otherwise it is called from the I/O thread. An empty batch without error marks
+the end of the directory.
+
+The entries are those a directory_iterator constructed with the same arguments
+gives, in the same order, with their file type cached when the system provides
+it. Only one read can be pending at a time: next() must not be called again
+until `done` has been called. Destroying the reader does not wait for a pending
+read, whose `done` is then not called; it only waits for a `done` that is
+already running on another thread to return. `done` may call next(), or
+destroy the reader.
+
+When compiled as C++20 with coroutine support, the batches can also be awaited
+with `co_await reader.next_batch()`, which throws filesystem_error on errors.
+*/
+class ASAP_FILESYSTEM_API async_directory_reader {
+ public:
+  using batch_callback =
+      std::function<void(std::vector<directory_entry>, std::error_code)>;
+
+  /// The maximum number of entries handed out by one call to next().
+  static constexpr std::size_t batch_size = 256;
+
+  explicit async_directory_reader(
+      const path &p, directory_options options = directory_options::none,
+      parallel_policy::executor_type executor = {});
+  async_directory_reader(const async_directory_reader &) = delete;
+  auto operator=(const async_directory_reader &)
+      -> async_directory_reader & = delete;
+  ~async_directory_reader();
+
+  /// Reads the next batch of entries, and calls `done` with them or with the
+  /// error that stopped the reading.
+  void next(batch_callback done);
+
+  /// The directory being read.
+  auto path() const noexcept -> const filesystem::path & { return path_; }
+
+#if defined(ASAP_FS_HAS_COROUTINES)
+  class batch_awaiter {
+   public:
+    explicit batch_awaiter(async_directory_reader &reader) : reader_(reader) {}
+
+    auto await_ready() const noexcept -> bool { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      reader_.next([this, handle](std::vector<directory_entry> entries,
+                                  std::error_code ec) {
+        entries_ = std::move(entries);
+        ec_ = ec;
+        handle.resume();
+      });
+    }
+    auto await_resume() -> std::vector<directory_entry> {
+      if (ec_) {
+        throw filesystem_error("async_directory_reader", reader_.path(), ec_);
+      }
+      return std::move(entries_);
+    }
+
+   private:
+    async_directory_reader &reader_;
+    std::vector<directory_entry> entries_;
+    std::error_code ec_;
+  };
+
+  /// Awaits the next batch of entries, which is empty at the end of the
+  /// directory.
+  auto next_batch() -> batch_awaiter { return batch_awaiter{*this}; }
+#endif
+
+ private:
+  struct State;
+
+  filesystem::path path_;
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+  std::shared_ptr<State> state_;
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(pop)
+#endif
+};
+
+}  // namespace filesystem
+}  // namespace asap
@@ -0,0 +1,120 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/asap_filesystem_api.h>
+#include <filesystem/fs_parallel.h>
+#include <filesystem/fs_path.h>
+
+#include <hedley/hedley.h>
+
+#include <cstddef>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                               canonicalizer
+// -----------------------------------------------------------------------------
+
+/// The canonical path of one path, as given by canonicalizer::canonical_many().
+/// `path` and `ec` are what canonical(p, ec) gives.
+struct canonical_result {
+  filesystem::path path;
+  std::error_code ec;
+};
+
+/*!
+@brief Makes many paths canonical, resolving the directories they share only
+once.
+
+This is an extension to the standard. canonical() resolves every component of
+a path, one system call each, so making canonical many paths under the same
+directories resolves these directories over and over. A canonicalizer
+remembers where each directory it resolved leads, with the symlinks followed,
+and only asks the system about the components it has not seen yet; usually
+the last one.
+
+The paths are resolved like canonical() does: they must exist, and relative
+paths are made absolute against the current directory. The directories
+remembered are not checked again: changes made to them afterwards, such as a
+symlink pointing elsewhere or a directory removed, are only seen after clear().
+A canonicalizer is meant for a burst of work, e.g. scanning a tree, rather than
+to be kept for the lifetime of a program.
+
+On Windows, each path is resolved with canonical() and nothing is remembered.
+
+All the member functions can be called concurrently from several threads.
+*/
+class ASAP_FILESYSTEM_API canonicalizer {
+ public:
+  /// Creates a canonicalizer remembering at most `max_directories`
+  /// directories. It forgets part of them when it reaches that number.
+  explicit canonicalizer(std::size_t max_directories = 65536);
+  canonicalizer(const canonicalizer &) = delete;
+  auto operator=(const canonicalizer &) -> canonicalizer & = delete;
+  ~canonicalizer();
+
+  auto canonical(const path &p) -> path { return do_canonical(p); }
+  auto canonical(const path &p, std::error_code &ec) -> path {
+    return do_canonical(p, &ec);
+  }
+
+  /// Makes canonical the `count` paths starting at `paths`, and stores the
+  /// result for each of them at the same index in `results`. The paths are
+  /// resolved in the calling thread, or concurrently as specified by `policy`.
+  void canonical_many(const path *paths, std::size_t count,
+                      canonical_result *results) {
+    do_canonical_many(paths, count, results);
+  }
+  void canonical_many(const path *paths, std::size_t count,
+                      canonical_result *results,
+                      const parallel_policy &policy) {
+    do_canonical_many(paths, count, results, &policy);
+  }
+  auto canonical_many(const std::vector<path> &paths)
+      -> std::vector<canonical_result> {
+    std::vector<canonical_result> results(paths.size());
+    do_canonical_many(paths.data(), paths.size(), results.data());
+    return results;
+  }
+  auto canonical_many(const std::vector<path> &paths,
+                      const parallel_policy &policy)
+      -> std::vector<canonical_result> {
+    std::vector<canonical_result> results(paths.size());
+    do_canonical_many(paths.data(), paths.size(), results.data(), &policy);
+    return results;
+  }
+
+  /// Forgets all the directories resolved so far.
+  void clear();
+
+  /// The number of directories currently remembered.
+  auto size() const -> std::size_t;
+
+ private:
+  class Impl;
+
+  auto do_canonical(const path &p, std::error_code *ec = nullptr) -> path;
+  void do_canonical_many(const path *paths, std::size_t count,
+                         canonical_result *results,
+                         const parallel_policy *policy = nullptr);
+
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+  std::unique_ptr<Impl> impl_;
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(pop)
+#endif
+};
+
+}  // namespace filesystem
+}  // namespace asap
@@ -8,7 +8,10 @@
 #include <common/assert.h>
 #include <filesystem/asap_filesystem_api.h>
 #include <filesystem/filesystem.h>
+#include <filesystem/fs_parallel.h>
 
+#include <cstddef>
+#include <functional>
 #include <memory> // for std::shared_ptr
 #include <utility>
 
@@ -16,6 +19,7 @@ namespace asap {
 namespace filesystem {
 
 class DirectoryStream;
+class ParallelWalk;
 
 // -----------------------------------------------------------------------------
 //                               directory_entry
@@ -36,7 +40,10 @@ class ASAP_FILESYSTEM_API directory_entry {
 public:
   // constructors and destructors
   directory_entry() noexcept = default;
-  directory_entry(directory_entry const &) = default;
+  // A copy does not keep the directory the entry was iterated from, as it may
+  // outlive the iterator.
+  directory_entry(directory_entry const &other)
+      : path_(other.path_), cached_data_(other.cached_data_) {}
   directory_entry(directory_entry &&) noexcept = default;
 
   explicit directory_entry(path_type p) : path_(std::move(p)) {
@@ -48,26 +55,35 @@ public:
 
   ~directory_entry() = default;
 
-  auto operator=(directory_entry const &) -> directory_entry & = default;
+  auto operator=(directory_entry const &other) -> directory_entry & {
+    path_ = other.path_;
+    cached_data_ = other.cached_data_;
+    dir_fd_ = -1;
+    return *this;
+  }
   auto operator=(directory_entry &&) noexcept -> directory_entry & = default;
 
   void assign(path_type const &p) {
     path_ = p;
+    dir_fd_ = -1;
     DoRefresh();
   }
 
   void assign(path_type const &p, std::error_code &ec) {
     path_ = p;
+    dir_fd_ = -1;
     DoRefresh(&ec);
   }
 
   void replace_filename(path_type const &p) {
     path_.replace_filename(p);
+    dir_fd_ = -1;
     DoRefresh();
   }
 
   void replace_filename(path_type const &p, std::error_code &ec) {
     path_.replace_filename(p);
+    dir_fd_ = -1;
     DoRefresh(&ec);
   }
 
@@ -210,6 +226,28 @@ public:
     }
   }
 
+  /*!
+  @brief Returns the creation time of the referred-to filesystem object
+  (follows symlinks).
+
+  This is an extension to the standard. The time is only available when the
+  file system records it and the system can report it, which is the case with
+  statx() on Linux, on macOS and on Windows. Otherwise, the error
+  std::errc::not_supported is reported.
+  */
+  auto birth_time() const -> file_time_type { return GetBirthTime(); }
+
+  /// Returns the creation time of the referred-to filesystem object (follows
+  /// symlinks).
+  auto birth_time(std::error_code &ec) const noexcept -> file_time_type {
+    try {
+      return GetBirthTime(&ec);
+    } catch (...) {
+      // The above will never throw when we pass a non null ec
+      ASAP_UNREACHABLE();
+    }
+  }
+
   /// Returns status of the entry, as if determined by a status call (symlinks
   /// are followed to their targets).
   auto status() const -> file_status { return GetStatus(); }
@@ -244,11 +282,30 @@ private:
   friend class directory_iterator;
   friend class recursive_directory_iterator;
   friend class DirectoryStream;
+  friend class ParallelWalk;
 
   enum class CacheType_ : unsigned char { EMPTY, BASIC, EXTRA, FULL };
 
+  // On POSIX systems, the attributes are fetched one by one as they are
+  // needed, and these record the ones which are known. The ones starting with
+  // ATTR_LINK_ are about the symlink itself, the others about its target.
+  enum Attribute_ : unsigned char {
+    ATTR_LINK_TYPE = 1U << 0,
+    ATTR_LINK_PERMS = 1U << 1,
+    ATTR_NLINK = 1U << 2,
+    ATTR_TYPE = 1U << 3,
+    ATTR_PERMS = 1U << 4,
+    ATTR_SIZE = 1U << 5,
+    ATTR_WRITE_TIME = 1U << 6,
+    ATTR_BIRTH_TIME = 1U << 7
+  };
+
   struct CachedData_ {
     CacheType_ cache_type;
+    unsigned char resolved;
+    // Accept the attributes cached by network file systems, which is kept when
+    // the entry is refreshed.
+    bool dont_sync{false};
 
     bool symlink;
     bool type_resolved;
@@ -266,6 +323,8 @@ private:
     uintmax_t size;
     // Time of last modification (symlinks are followed)
     file_time_type write_time;
+    // Time of creation, when available (symlinks are followed)
+    file_time_type birth_time;
 
     // FULL
     perms symlink_perms;
@@ -277,10 +336,11 @@ private:
       symlink = false;
       type_resolved = extra_resolved = perms_resolved = false;
       cache_type = CacheType_::EMPTY;
+      resolved = 0;
       type = file_type::none;
       symlink_perms = non_symlink_perms = perms::unknown;
       size = nlink = uintmax_t(-1);
-      write_time = file_time_type::min();
+      write_time = birth_time = file_time_type::min();
     }
   };
 
@@ -356,6 +416,11 @@ private:
 
   auto GetLastWriteTime(std::error_code *ec = nullptr) const -> file_time_type;
 
+  auto GetBirthTime(std::error_code *ec = nullptr) const -> file_time_type;
+
+  // Fetches the `attributes` which are not known yet, on POSIX systems.
+  void Resolve(unsigned attributes, std::error_code &ec) const;
+
   path_type path_;
 #if defined(HEDLEY_MSVC_VERSION)
 #pragma warning(push)
@@ -365,6 +430,12 @@ private:
 #if defined(HEDLEY_MSVC_VERSION)
 #pragma warning(pop)
 #endif
+  // While the entry is the current one of a directory iterator on a POSIX
+  // system, the descriptor of the open directory it is in, and the position of
+  // its name in `path_`, so that its attributes are fetched relative to that
+  // directory instead of walking the full path again.
+  int dir_fd_{-1};
+  std::size_t name_pos_{0};
 }; // namespace filesystem
 
 class DirectoryEntryProxy_ {
@@ -575,6 +646,26 @@ public:
   auto options() const -> directory_options;
   auto depth() const -> int;
 
+  /*!
+  @brief The maximum number of directories the iteration keeps open at the
+  same time, 64 by default.
+
+  When recursing deeper than this, the oldest open ancestors read their
+  remaining entries into memory and close their directory. The iteration then
+  continues from those entries on the way back up. This caps the number of
+  file descriptors used for deep trees, at the cost of memory. The limit is
+  shared by all copies of the iterator, and is not enforced on Windows.
+  */
+  auto max_open_directories() const -> std::size_t;
+
+  /*!
+  @brief Set the maximum number of directories the iteration keeps open at
+  the same time. A value of 0 is treated as 1.
+
+  @see max_open_directories()
+  */
+  void set_max_open_directories(std::size_t max_open);
+
   void pop() { pop_impl(); }
 
   void pop(std::error_code &ec) { pop_impl(&ec); }
@@ -629,5 +720,52 @@ inline auto end(const recursive_directory_iterator & /*unused*/) noexcept
   return {};
 }
 
+// -----------------------------------------------------------------------------
+//                               parallel_walk
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Called by parallel_walk() for each entry of the tree. Returns whether
+the walk goes into the entry when it is a directory, which prunes the subtree
+when false.
+
+The visitor is called concurrently from several threads, and the entry is
+only valid during the call.
+*/
+using walk_visitor = std::function<bool(const directory_entry &)>;
+
+ASAP_FILESYSTEM_API
+void parallel_walk_impl(const path &root, directory_options options,
+    const walk_visitor &visitor, const parallel_policy &policy, std::error_code *ec = nullptr);
+
+/*!
+@brief Visits all the entries in the tree under `root`, with the
+subdirectories listed concurrently as specified by `policy`.
+
+This is an extension to the standard. The entries are the same as the ones of a
+recursive_directory_iterator constructed with `options`, but are visited in no
+particular order. Each subdirectory is listed by one task, and the entries
+carry the file type read with the directory when the file system provides it,
+so deciding whether to walk into an entry does not need a call to status().
+
+The first error stops the walk and is reported once the running tasks are done.
+When several errors happen, only one of them is reported. An exception thrown
+by the visitor also stops the walk, and is rethrown.
+*/
+inline void parallel_walk(const path &root, directory_options options, const walk_visitor &visitor,
+    const parallel_policy &policy = {}) {
+  parallel_walk_impl(root, options, visitor, policy);
+}
+
+inline void parallel_walk(const path &root, directory_options options, const walk_visitor &visitor,
+    const parallel_policy &policy, std::error_code &ec) {
+  parallel_walk_impl(root, options, visitor, policy, &ec);
+}
+
+inline void parallel_walk(const path &root, directory_options options, const walk_visitor &visitor,
+    std::error_code &ec) {
+  parallel_walk_impl(root, options, visitor, parallel_policy{}, &ec);
+}
+
 } // namespace filesystem
 } // namespace asap
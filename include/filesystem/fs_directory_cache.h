@@ -0,0 +1,107 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/asap_filesystem_api.h>
+#include <filesystem/fs_file_type.h>
+#include <filesystem/fs_path.h>
+
+#include <hedley/hedley.h>
+
+#include <cstddef>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                             directory_cache
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Remembers the content of directories that are listed over and over, so
+that listing them again is a lookup in memory.
+
+This is an extension to the standard. A listing holds the names of the entries
+of a directory and their types, as reported by the directory itself, in the
+order a directory_iterator gives them. On Linux, the kernel notifies the cache
+through inotify when an entry is added to, removed from or renamed in a cached
+directory, or when the directory itself is removed or renamed, and the listing
+is read again from disk the next time it is asked for. Elsewhere, or when the
+kernel refuses to watch one more directory, the modification time of the
+directory is checked instead, which costs one stat per listing. A directory
+modified in the last couple of seconds is then read again each time, since a
+change made within the same tick of its file system clock would not move its
+modification time.
+
+Changes to the entries themselves, e.g. writing to a file, do not invalidate a
+listing since they do not change it. Replacing one of the parents of a cached
+directory, e.g. by renaming it, is not noticed: call invalidate() in that case.
+
+Relative paths are made absolute against the current directory. All the member
+functions can be called concurrently from several threads. The listings handed
+out are never modified, and stay valid as long as they are used.
+*/
+class ASAP_FILESYSTEM_API directory_cache {
+ public:
+  struct entry {
+    /// The name of the entry in the directory.
+    path filename;
+    /// The type of the entry, not following symlinks. When the directory does
+    /// not report it, it is found with symlink_status(), and none if the entry
+    /// was removed in the meantime.
+    file_type type;
+  };
+  using listing = std::shared_ptr<const std::vector<entry>>;
+
+  /// Creates an empty cache holding at most `max_directories` listings. The
+  /// least recently used listing is dropped to make room for a new one. With
+  /// `allow_notifications` false, the modification time of the directories is
+  /// always checked instead.
+  explicit directory_cache(std::size_t max_directories = 1024,
+                           bool allow_notifications = true);
+  directory_cache(const directory_cache &) = delete;
+  auto operator=(const directory_cache &) -> directory_cache & = delete;
+  ~directory_cache();
+
+  /// The entries of the directory `p`, read from disk when they are not
+  /// cached or have changed since. On error, the listing is empty.
+  auto list(const path &p) -> listing { return do_list(p); }
+  auto list(const path &p, std::error_code &ec) -> listing {
+    return do_list(p, &ec);
+  }
+
+  /// Drops the listing of the directory `p`, if cached.
+  void invalidate(const path &p);
+  /// Drops all the listings.
+  void clear();
+
+  /// The number of directories currently cached.
+  auto size() const -> std::size_t;
+
+  /// Whether changes are notified by the kernel, rather than found by checking
+  /// the modification time of the directories.
+  auto uses_notifications() const noexcept -> bool;
+
+ private:
+  class Impl;
+
+  auto do_list(const path &p, std::error_code *ec = nullptr) -> listing;
+
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+  std::unique_ptr<Impl> impl_;
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(pop)
+#endif
+};
+
+}  // namespace filesystem
+}  // namespace asap
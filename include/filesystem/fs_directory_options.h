@@ -22,12 +22,18 @@ bitwise operators operator&, operator|, operator^, operator~, operator&=,
 operator|=, and operator^= are defined for this type). none represents the empty
 bitmask; every other enumerator represents a distinct bitmask element.
 
+As an extension to the standard, allow_stale_attributes lets the attributes of
+the entries be read from what the file system has cached, without making sure
+they are up to date. This saves a round trip to the server on network file
+systems (AT_STATX_DONT_SYNC on Linux), and has no effect elsewhere.
+
 @see https://en.cppreference.com/w/cpp/filesystem/directory_options
 */
 enum class directory_options : unsigned char {
   none = 0,
   follow_directory_symlink = 1,
-  skip_permission_denied = 2
+  skip_permission_denied = 2,
+  allow_stale_attributes = 4
 };
 
 constexpr auto operator&(directory_options lhs, directory_options rhs) noexcept
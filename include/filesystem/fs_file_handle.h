@@ -0,0 +1,196 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/asap_filesystem_api.h>
+#include <filesystem/fs_file_status.h>
+#include <filesystem/fs_path.h>
+
+#include <hedley/hedley.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                               file handle
+// -----------------------------------------------------------------------------
+
+/// How file_handle opens a file.
+enum class open_flags : unsigned short {
+  none = 0,
+  read = 1,
+  write = 2,
+  read_write = read | write,
+  /// Creates the file when it does not exist. Requires write.
+  create = 4,
+  /// Fails when the file exists already. Requires create.
+  exclusive = 8,
+  /// Empties the file when it exists. Requires write.
+  truncate = 16
+};
+
+constexpr auto operator&(open_flags lhs, open_flags rhs) noexcept
+    -> open_flags {
+  using utype = typename std::underlying_type<open_flags>::type;
+  return static_cast<open_flags>(static_cast<utype>(lhs) &
+                                 static_cast<utype>(rhs));
+}
+
+constexpr auto operator|(open_flags lhs, open_flags rhs) noexcept
+    -> open_flags {
+  using utype = typename std::underlying_type<open_flags>::type;
+  return static_cast<open_flags>(static_cast<utype>(lhs) |
+                                 static_cast<utype>(rhs));
+}
+
+constexpr auto operator^(open_flags lhs, open_flags rhs) noexcept
+    -> open_flags {
+  using utype = typename std::underlying_type<open_flags>::type;
+  return static_cast<open_flags>(static_cast<utype>(lhs) ^
+                                 static_cast<utype>(rhs));
+}
+
+constexpr auto operator~(open_flags lhs) noexcept -> open_flags {
+  using utype = typename std::underlying_type<open_flags>::type;
+  return static_cast<open_flags>(~static_cast<utype>(lhs));
+}
+
+inline auto operator&=(open_flags &lhs, open_flags rhs) noexcept
+    -> open_flags & {
+  return lhs = lhs & rhs;
+}
+
+inline auto operator|=(open_flags &lhs, open_flags rhs) noexcept
+    -> open_flags & {
+  return lhs = lhs | rhs;
+}
+
+inline auto operator^=(open_flags &lhs, open_flags rhs) noexcept
+    -> open_flags & {
+  return lhs = lhs ^ rhs;
+}
+
+/// A buffer to read into with file_handle::preadv().
+struct io_buffer {
+  void *data;
+  std::size_t size;
+};
+
+/// A buffer to write from with file_handle::pwritev().
+struct const_io_buffer {
+  const void *data;
+  std::size_t size;
+};
+
+/*!
+@brief An open file, read and written at explicit offsets.
+
+This is an extension to the standard. The reads and writes do not move a file
+position, so several threads can use the same handle at once. They transfer as
+much as they can in a single system call and return how many bytes were
+transferred, which may be less than asked for; a read returns 0 at the end of
+the file.
+
+preadv() and pwritev() transfer several buffers, one after the other, in a
+single system call where the system allows it, and in a loop otherwise.
+
+The errors are reported like the rest of the library: by throwing
+filesystem_error, or in the `ec` argument of the overloads taking one.
+*/
+class ASAP_FILESYSTEM_API file_handle {
+ public:
+  /// A handle that is not open.
+  file_handle() noexcept;
+  explicit file_handle(const path &p, open_flags flags = open_flags::read);
+  file_handle(const path &p, open_flags flags, std::error_code &ec);
+
+  file_handle(const file_handle &) = delete;
+  auto operator=(const file_handle &) -> file_handle & = delete;
+  file_handle(file_handle &&other) noexcept;
+  auto operator=(file_handle &&other) noexcept -> file_handle &;
+  ~file_handle();
+
+  auto is_open() const noexcept -> bool;
+  /// The path the file was opened with, empty when not open.
+  auto path() const noexcept -> const filesystem::path &;
+
+  /// The status of the file when it was opened, or when last refreshed.
+  auto status() const noexcept -> file_status;
+  auto refresh_status() -> file_status;
+  auto refresh_status(std::error_code &ec) noexcept -> file_status;
+
+  auto pread(void *buffer, std::size_t size, std::uintmax_t offset)
+      -> std::size_t;
+  auto pread(void *buffer, std::size_t size, std::uintmax_t offset,
+             std::error_code &ec) noexcept -> std::size_t;
+
+  auto pwrite(const void *buffer, std::size_t size, std::uintmax_t offset)
+      -> std::size_t;
+  auto pwrite(const void *buffer, std::size_t size, std::uintmax_t offset,
+              std::error_code &ec) noexcept -> std::size_t;
+
+  auto preadv(const io_buffer *buffers, std::size_t count,
+              std::uintmax_t offset) -> std::size_t;
+  auto preadv(const io_buffer *buffers, std::size_t count,
+              std::uintmax_t offset, std::error_code &ec) noexcept
+      -> std::size_t;
+
+  auto pwritev(const const_io_buffer *buffers, std::size_t count,
+               std::uintmax_t offset) -> std::size_t;
+  auto pwritev(const const_io_buffer *buffers, std::size_t count,
+               std::uintmax_t offset, std::error_code &ec) noexcept
+      -> std::size_t;
+
+  /// Reserves the storage for `length` bytes at `offset`, growing the file if
+  /// needed, so that writing there later does not fail for lack of space.
+  /// Where the system cannot reserve storage, only grows the file.
+  void fallocate(std::uintmax_t offset, std::uintmax_t length);
+  void fallocate(std::uintmax_t offset, std::uintmax_t length,
+                 std::error_code &ec) noexcept;
+
+  /// Waits for the content written to the file to be on the storage device,
+  /// along with the attributes needed to read it back, such as its size.
+  void fdatasync();
+  void fdatasync(std::error_code &ec) noexcept;
+
+  void close() noexcept;
+
+ private:
+  class Impl;
+
+  void do_open(const filesystem::path &p, open_flags flags,
+               std::error_code *ec);
+  auto do_refresh_status(std::error_code *ec) -> file_status;
+  auto do_pread(void *buffer, std::size_t size, std::uintmax_t offset,
+                std::error_code *ec) -> std::size_t;
+  auto do_pwrite(const void *buffer, std::size_t size, std::uintmax_t offset,
+                 std::error_code *ec) -> std::size_t;
+  auto do_preadv(const io_buffer *buffers, std::size_t count,
+                 std::uintmax_t offset, std::error_code *ec) -> std::size_t;
+  auto do_pwritev(const const_io_buffer *buffers, std::size_t count,
+                  std::uintmax_t offset, std::error_code *ec) -> std::size_t;
+  void do_fallocate(std::uintmax_t offset, std::uintmax_t length,
+                    std::error_code *ec);
+  void do_fdatasync(std::error_code *ec);
+
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+  std::unique_ptr<Impl> impl_;
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(pop)
+#endif
+};
+
+}  // namespace filesystem
+}  // namespace asap
@@ -0,0 +1,164 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/asap_filesystem_api.h>
+#include <filesystem/fs_path.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                               mapped file
+// -----------------------------------------------------------------------------
+
+enum class map_mode : unsigned char {
+  /// The content can only be read.
+  read_only,
+  /// The content can be read and written. What is written goes to the file.
+  read_write
+};
+
+/// How the content of a mapping is going to be accessed, so that the system
+/// can read it ahead or drop it accordingly. Only a hint.
+enum class map_advice : unsigned char {
+  normal,
+  /// From the start to the end, e.g. to parse the file in one pass.
+  sequential,
+  /// In no particular order. Reading ahead is useless.
+  random,
+  /// Soon. The system may start reading it now.
+  will_need,
+  /// Not for a while. The system may drop the pages from memory.
+  dont_need
+};
+
+/// Controls how mapped_file maps a file.
+struct map_options {
+  map_mode mode{map_mode::read_only};
+  /// Where the mapped region starts in the file.
+  std::uintmax_t offset{0};
+  /// The length of the mapped region, or 0 for up to the end of the file.
+  std::size_t length{0};
+  /// Whether the whole region is read in memory before the constructor
+  /// returns, instead of page by page as it is accessed. Only honored on
+  /// Linux.
+  bool populate{false};
+  /// Whether the system may back the region with huge pages, to reduce the
+  /// cost of accessing a large file at random. Only a hint, honored on Linux
+  /// when transparent huge pages are enabled for files.
+  bool huge_pages{false};
+  map_advice advice{map_advice::normal};
+};
+
+/*!
+@brief A read-only view on a region of a mapped file.
+
+It does not own the mapping: it must not be used after the mapped_file it comes
+from is closed or destroyed.
+*/
+class ASAP_FILESYSTEM_API mapped_file_view {
+ public:
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  mapped_file_view() noexcept = default;
+  mapped_file_view(const char *data, std::size_t size) noexcept
+      : data_(data), size_(size) {}
+
+  auto data() const noexcept -> const char * { return data_; }
+  auto size() const noexcept -> std::size_t { return size_; }
+  auto empty() const noexcept -> bool { return size_ == 0; }
+
+  auto begin() const noexcept -> const char * { return data_; }
+  auto end() const noexcept -> const char * { return data_ + size_; }
+
+  auto operator[](std::size_t pos) const noexcept -> const char & {
+    return data_[pos];
+  }
+
+  /// The `count` bytes starting at `offset`, or less when the view ends
+  /// before. Throws std::out_of_range when `offset` is past the end.
+  auto subview(std::size_t offset, std::size_t count = npos) const
+      -> mapped_file_view;
+
+  /// Tells the system how the viewed region is going to be accessed. Does
+  /// nothing on Windows.
+  void advise(map_advice advice) const noexcept;
+
+ private:
+  const char *data_{nullptr};
+  std::size_t size_{0};
+};
+
+/*!
+@brief Maps a region of a file in memory, to access its content without
+copying it.
+
+This is an extension to the standard. The file must be a regular file; it is
+mapped shared, so what is written to a read_write mapping ends up in the file,
+and changes made to the file by others may be seen through the mapping. The
+file must not be truncated while mapped: accessing the pages past its new end
+crashes the process on most systems.
+
+An empty region, e.g. for an empty file, maps nothing: the mapped_file is open
+but its data() is null.
+*/
+class ASAP_FILESYSTEM_API mapped_file {
+ public:
+  mapped_file() noexcept = default;
+  explicit mapped_file(const path &p, const map_options &options = {});
+  mapped_file(const path &p, const map_options &options, std::error_code &ec);
+
+  mapped_file(const mapped_file &) = delete;
+  auto operator=(const mapped_file &) -> mapped_file & = delete;
+  mapped_file(mapped_file &&other) noexcept;
+  auto operator=(mapped_file &&other) noexcept -> mapped_file &;
+  ~mapped_file();
+
+  auto is_open() const noexcept -> bool { return open_; }
+  auto mode() const noexcept -> map_mode { return mode_; }
+
+  /// The mapped region. Must not be written to unless the mode is read_write.
+  auto data() noexcept -> char * { return data_; }
+  auto data() const noexcept -> const char * { return data_; }
+  auto size() const noexcept -> std::size_t { return size_; }
+
+  auto view() const noexcept -> mapped_file_view {
+    return mapped_file_view(data_, size_);
+  }
+
+  /// Writes what was changed in the region to the file and waits for it to be
+  /// on the storage device.
+  void flush();
+  void flush(std::error_code &ec);
+
+  /// Unmaps the region. Changes not flushed are still written to the file,
+  /// eventually.
+  void close() noexcept;
+
+ private:
+  void open(const path &p, const map_options &options, std::error_code *ec);
+  void do_flush(std::error_code *ec);
+
+  // What the system mapped, which starts at a page boundary, before data_
+  void *base_{nullptr};
+  std::size_t mapped_length_{0};
+  char *data_{nullptr};
+  std::size_t size_{0};
+  // The file handle, needed to flush the file on Windows
+  void *handle_{nullptr};
+  // The mapped file, whose cached attributes flushing makes stale
+  path path_;
+  map_mode mode_{map_mode::read_only};
+  bool open_{false};
+};
+
+}  // namespace filesystem
+}  // namespace asap
@@ -8,10 +8,14 @@
 #include <filesystem/asap_filesystem_api.h>
 #include <filesystem/fs_copy_options.h>
 #include <filesystem/fs_file_status.h>
+#include <filesystem/fs_parallel.h>
 #include <filesystem/fs_path.h>
 
 #include "filesystem/fs_file_time_type.h"
 
+#include <type_traits>
+#include <vector>
+
 namespace asap {
 namespace filesystem {
 
@@ -25,6 +29,105 @@ struct space_info {
   std::uintmax_t available;
 };
 
+/*!
+@brief Identifies the mechanism used by copy_file() to transfer the contents of
+a file.
+
+This is an extension to the standard, provided for diagnostics only. The
+fastest available mechanism is always tried first (e.g. a copy-on-write clone
+of the file), and the next one is used whenever the previous one is not
+supported for the files involved.
+
+@see last_copy_file_strategy()
+*/
+enum class copy_file_strategy : unsigned char {
+  /// No data was copied yet by the calling thread.
+  none,
+  /// The destination shares the source data blocks (Linux FICLONE).
+  clone,
+  /// Data was copied in the kernel with copy_file_range().
+  copy_file_range,
+  /// Data was copied in the kernel with sendfile().
+  sendfile,
+  /// Data was copied with fcopyfile() (Apple).
+  copyfile,
+  /// Data was copied by the library through a userspace buffer.
+  read_write,
+  /// Data was copied with CopyFileW() (Windows).
+  win32_copy_file
+};
+
+/*!
+@brief The attributes fetched by status_many(), besides the status which is
+always fetched.
+
+This is an extension to the standard. status_fields satisfies the requirements
+of BitmaskType. Asking only for the attributes needed lets file systems that
+can tell them apart (e.g. network file systems with statx() on Linux) skip
+refreshing the others.
+*/
+enum class status_fields : unsigned char {
+  none = 0,
+  size = 1,
+  last_write_time = 2
+};
+
+constexpr auto operator&(status_fields lhs, status_fields rhs) noexcept
+    -> status_fields {
+  using utype = typename std::underlying_type<status_fields>::type;
+  return static_cast<status_fields>(static_cast<utype>(lhs) &
+                                    static_cast<utype>(rhs));
+}
+
+constexpr auto operator|(status_fields lhs, status_fields rhs) noexcept
+    -> status_fields {
+  using utype = typename std::underlying_type<status_fields>::type;
+  return static_cast<status_fields>(static_cast<utype>(lhs) |
+                                    static_cast<utype>(rhs));
+}
+
+constexpr auto operator^(status_fields lhs, status_fields rhs) noexcept
+    -> status_fields {
+  using utype = typename std::underlying_type<status_fields>::type;
+  return static_cast<status_fields>(static_cast<utype>(lhs) ^
+                                    static_cast<utype>(rhs));
+}
+
+constexpr auto operator~(status_fields lhs) noexcept -> status_fields {
+  using utype = typename std::underlying_type<status_fields>::type;
+  return static_cast<status_fields>(~static_cast<utype>(lhs));
+}
+
+inline auto operator&=(status_fields &lhs, status_fields rhs) noexcept
+    -> status_fields & {
+  return lhs = lhs & rhs;
+}
+
+inline auto operator|=(status_fields &lhs, status_fields rhs) noexcept
+    -> status_fields & {
+  return lhs = lhs | rhs;
+}
+
+inline auto operator^=(status_fields &lhs, status_fields rhs) noexcept
+    -> status_fields & {
+  return lhs = lhs ^ rhs;
+}
+
+/*!
+@brief The attributes of one path, as fetched by status_many().
+
+`status` and `ec` are what status(p, ec) gives, so a missing file has the type
+file_type::not_found and `ec` set. `size` is only set for regular files, and
+`last_write_time` only when `ec` is not set. They hold the same error values
+as the corresponding functions otherwise, or when they were not asked for.
+*/
+struct status_result {
+  file_status status;
+  std::uintmax_t size{static_cast<std::uintmax_t>(-1)};
+  file_time_type last_write_time{file_time_type::min()};
+  std::error_code ec;
+};
+
 // -----------------------------------------------------------------------------
 //                               operations
 // -----------------------------------------------------------------------------
@@ -37,6 +140,9 @@ ASAP_FILESYSTEM_API
 void copy_impl(const path &from, const path &to, copy_options opt,
                std::error_code *ec = nullptr);
 ASAP_FILESYSTEM_API
+void copy_impl(const path &from, const path &to, copy_options opt,
+               const parallel_policy &policy, std::error_code *ec = nullptr);
+ASAP_FILESYSTEM_API
 auto copy_file_impl(const path &from, const path &to, copy_options opt,
                     std::error_code *ec = nullptr) -> bool;
 ASAP_FILESYSTEM_API
@@ -90,6 +196,9 @@ auto remove_impl(const path &p, std::error_code *ec = nullptr) -> bool;
 ASAP_FILESYSTEM_API
 auto remove_all_impl(const path &p, std::error_code *ec = nullptr) -> uintmax_t;
 ASAP_FILESYSTEM_API
+auto remove_all_impl(const path &p, const parallel_policy &policy,
+                     std::error_code *ec = nullptr) -> uintmax_t;
+ASAP_FILESYSTEM_API
 void rename_impl(const path &from, const path &to,
                  std::error_code *ec = nullptr);
 ASAP_FILESYSTEM_API
@@ -100,6 +209,10 @@ auto space_impl(const path &p, std::error_code *ec = nullptr) -> space_info;
 ASAP_FILESYSTEM_API
 auto status_impl(const path &p, std::error_code *ec = nullptr) -> file_status;
 ASAP_FILESYSTEM_API
+void status_many_impl(const path *paths, std::size_t count,
+                      status_fields fields, status_result *results,
+                      const parallel_policy *policy = nullptr);
+ASAP_FILESYSTEM_API
 auto symlink_status_impl(const path &p, std::error_code *ec = nullptr)
     -> file_status;
 ASAP_FILESYSTEM_API
@@ -108,6 +221,49 @@ ASAP_FILESYSTEM_API
 auto weakly_canonical_impl(path const &p, std::error_code *ec = nullptr)
     -> path;
 
+/// Returns the strategy used by the last successful copy_file() made by the
+/// calling thread.
+ASAP_FILESYSTEM_API
+auto last_copy_file_strategy() noexcept -> copy_file_strategy;
+
+/// Returns the size of the buffer used by copy_file() when the data has to be
+/// copied through userspace (copy_file_strategy::read_write).
+ASAP_FILESYSTEM_API
+auto copy_file_buffer_size() noexcept -> std::size_t;
+
+/// Sets the size of the buffer used by copy_file() when the data has to be
+/// copied through userspace. The size is clamped between 64 KiB and 16 MiB,
+/// and the buffer itself is rounded up to a whole number of pages. Defaults to
+/// 1 MiB; the new size is used by the next copy made on any thread.
+ASAP_FILESYSTEM_API
+void copy_file_buffer_size(std::size_t size) noexcept;
+
+/// Returns whether copy_file() copies the data through userspace even when the
+/// system can copy it (copy_file_strategy::read_write).
+ASAP_FILESYSTEM_API
+auto copy_file_in_userspace() noexcept -> bool;
+
+/// Sets whether copy_file() copies the data through userspace, e.g. for the
+/// file systems that implement the system copies badly. Defaults to false; the
+/// new setting is used by the next copy made on any thread. Has no effect on
+/// Windows, where CopyFileW() does the copy.
+ASAP_FILESYSTEM_API
+void copy_file_in_userspace(bool enabled) noexcept;
+
+/// Returns whether absolute(), canonical() and the operations built on them
+/// use a snapshot of the current working directory to resolve relative paths,
+/// instead of asking the system for it every time. Enabled by default.
+ASAP_FILESYSTEM_API
+auto current_path_cache_enabled() noexcept -> bool;
+
+/// Enables or disables the snapshot of the current working directory, and
+/// drops the one taken if any. The snapshot is only refreshed when the current
+/// directory is changed with current_path(p): programs changing it by other
+/// means, e.g. calling chdir() directly, should disable it, or call this again
+/// after each change.
+ASAP_FILESYSTEM_API
+void current_path_cache_enabled(bool enabled);
+
 inline auto current_path() -> path { return current_path_impl(); }
 
 inline auto current_path(std::error_code &ec) -> path {
@@ -149,6 +305,21 @@ inline void copy(const path &from, const path &to, copy_options opt,
   copy_impl(from, to, opt, &ec);
 }
 
+/// Same as copy(from, to, opt), but copies the files of a directory tree
+/// concurrently as specified by `policy`. Directories are still created in
+/// the order of the walk, before any of their contents. When several errors
+/// happen, the one reported is the first one in the order of the walk, and
+/// some of the files following it may have been copied already.
+inline void copy(const path &from, const path &to, copy_options opt,
+                 const parallel_policy &policy) {
+  copy_impl(from, to, opt, policy);
+}
+
+inline void copy(const path &from, const path &to, copy_options opt,
+                 const parallel_policy &policy, std::error_code &ec) {
+  copy_impl(from, to, opt, policy, &ec);
+}
+
 inline auto copy_file(const path &from, const path &to) -> bool {
   return copy_file_impl(from, to, copy_options::none);
 }
@@ -472,6 +643,19 @@ inline auto remove_all(const path &p, std::error_code &ec) -> uintmax_t {
   return remove_all_impl(p, &ec);
 }
 
+/// Same as remove_all(p), but removes the contents of the subdirectories
+/// concurrently as specified by `policy`. When several errors happen, only one
+/// of them is reported.
+inline auto remove_all(const path &p, const parallel_policy &policy)
+    -> uintmax_t {
+  return remove_all_impl(p, policy);
+}
+
+inline auto remove_all(const path &p, const parallel_policy &policy,
+                       std::error_code &ec) -> uintmax_t {
+  return remove_all_impl(p, policy, &ec);
+}
+
 inline void rename(const path &from, const path &to) {
   return rename_impl(from, to);
 }
@@ -502,6 +686,41 @@ inline auto status(const path &p, std::error_code &ec) noexcept -> file_status {
   return status_impl(p, &ec);
 }
 
+/// Fetches the status of the `count` paths starting at `paths`, and the
+/// attributes in `fields`, into the `count` results starting at `results`.
+/// This is an extension to the standard. The errors are reported in each
+/// result instead of being thrown. Paths in the same directory are looked up
+/// relative to that directory, which is opened once, so the kernel does not
+/// resolve its path again for each of them.
+inline void status_many(const path *paths, std::size_t count,
+                        status_fields fields, status_result *results) {
+  status_many_impl(paths, count, fields, results);
+}
+
+/// Same as status_many(paths, count, fields, results), but fetches the
+/// attributes of the paths concurrently as specified by `policy`.
+inline void status_many(const path *paths, std::size_t count,
+                        status_fields fields, status_result *results,
+                        const parallel_policy &policy) {
+  status_many_impl(paths, count, fields, results, &policy);
+}
+
+inline auto status_many(const std::vector<path> &paths, status_fields fields)
+    -> std::vector<status_result> {
+  std::vector<status_result> results(paths.size());
+  status_many_impl(paths.data(), paths.size(), fields, results.data());
+  return results;
+}
+
+inline auto status_many(const std::vector<path> &paths, status_fields fields,
+                        const parallel_policy &policy)
+    -> std::vector<status_result> {
+  std::vector<status_result> results(paths.size());
+  status_many_impl(paths.data(), paths.size(), fields, results.data(),
+                   &policy);
+  return results;
+}
+
 inline auto symlink_status(const path &p) -> file_status {
   return symlink_status_impl(p);
 }
@@ -0,0 +1,51 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                             parallel_policy
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Controls how the operations accepting it spread their work over several
+threads.
+
+This is an extension to the standard. Passing a parallel_policy to an operation
+that supports it (e.g. copy()) opts into running independent parts of that
+operation concurrently. The observable result of the operation is the same as
+its sequential version, except for the order in which the side effects happen.
+
+By default, the work is run on a work-stealing thread pool owned by the
+library. A custom executor can be provided instead to run the work on an
+application provided thread pool. The calling thread always takes part in the
+work while it waits for the operation to complete, so an executor that never
+runs the tasks it is given does not cause a dead lock.
+*/
+struct parallel_policy {
+  /// A unit of work to be run by the executor.
+  using task = std::function<void()>;
+  /// Schedules a task to run on another thread. It may also run the task
+  /// immediately in the calling thread, or throw if it cannot accept it.
+  using executor_type = std::function<void(task)>;
+
+  /// The maximum number of tasks run at the same time by one operation,
+  /// including the calling thread. A value of 0 uses the number of hardware
+  /// threads, and a value of 1 runs everything in the calling thread.
+  std::size_t max_concurrency{0};
+
+  /// Runs the tasks of the operation. When empty, the library's thread pool is
+  /// used.
+  executor_type executor{};
+};
+
+}  // namespace filesystem
+}  // namespace asap
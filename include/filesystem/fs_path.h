@@ -11,15 +11,20 @@
 #include <filesystem/fs_path_traits.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iomanip>   // for std::quoted
 #include <iostream>  // for operator >> and operator <<
 #include <iterator>  // for std::iterator_traits
+#include <memory>    // for std::addressof
 #include <string>
 #include <type_traits>  // for std::enable_if
+#include <vector>
 
 namespace asap {
 namespace filesystem {
 
+class DirectoryStream;
+
 // -----------------------------------------------------------------------------
 //                               class path
 // -----------------------------------------------------------------------------
@@ -56,7 +61,7 @@ class ASAP_FILESYSTEM_API path {
    * @brief Copy constructor.
    * @param [in] p a path to copy.
    */
-  path(const path &p) = default;
+  path(const path &p);
 
   // NOLINTNEXTLINE
   path(string_type &&source, format /*fmt*/ = format::auto_format)
@@ -69,8 +74,10 @@ class ASAP_FILESYSTEM_API path {
    * Constructs a copy of p, p is left in valid but unspecified state.
    * @param [in] p a path to copy.
    */
-  path(path &&p) noexcept : pathname_(std::move(p.pathname_)) {
-    SplitComponents();
+  path(path &&p) noexcept
+      : pathname_(std::move(p.pathname_)),
+        components_(p.components_.exchange(nullptr, std::memory_order_relaxed)),
+        type_(p.type_) {
     p.clear();
   }
 
@@ -94,13 +101,13 @@ class ASAP_FILESYSTEM_API path {
     SplitComponents();
   }
 
-  ~path() = default;
+  ~path();
 
   //@}
 
   /// @name assignments
   //@{
-  auto operator=(const path &p) -> path & = default;
+  auto operator=(const path &p) -> path &;
   auto operator=(path &&p) noexcept -> path &;
   auto operator=(string_type &&source) -> path &;
   auto assign(string_type &&source) -> path &;
@@ -176,7 +183,8 @@ class ASAP_FILESYSTEM_API path {
 
   void clear() noexcept {
     pathname_.clear();
-    SplitComponents();
+    DropComponents();
+    type_ = Type::FILENAME;
   }
 
   auto make_preferred() -> path &;
@@ -186,8 +194,11 @@ class ASAP_FILESYSTEM_API path {
 
   void swap(path &rhs) noexcept {
     pathname_.swap(rhs.pathname_);
-    components_.swap(rhs.components_);
     std::swap(type_, rhs.type_);
+    auto *components = components_.load(std::memory_order_relaxed);
+    components_.store(rhs.components_.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    rhs.components_.store(components, std::memory_order_relaxed);
   }
 
   //@}
@@ -358,28 +369,75 @@ class ASAP_FILESYSTEM_API path {
   path(string_type pathname, Type type)
       : pathname_(std::move(pathname)), type_(type) {}
 
-  auto FindExtension() const -> std::pair<const string_type *, size_t>;
+  // The position of the last filename in pathname_ and the position of its
+  // extension in that filename (npos when it has none), or npos as the first
+  // member when the path does not end with a non-empty filename.
+  auto FindExtension() const -> std::pair<size_t, size_t>;
 
   auto AppendSeparatorIfNeeded() -> string_type::size_type;
   void EraseRedundantSeparator(string_type::size_type sep_pos);
 
+  // The components of a path are found by scanning its pathname, which does
+  // not allocate, every time they are needed. They are only built as paths
+  // when the path is first iterated, and kept until it is modified, as most
+  // paths are never iterated. SplitComponents() is called whenever pathname_
+  // changes: it only scans the first two components, to find the type of the
+  // path, and trims the paths that are only a root.
   void SplitComponents();
-  void Trim();
-  void AddRootName(size_t len);
-  void AddRootDir(size_t pos);
-  void AddFilename(size_t pos, size_t len);
+
+  // The components of a MULTI path as iterated, built on first use. This is
+  // safe to call from concurrent const accesses.
+  using ComponentList = std::vector<path>;
+  auto Components() const -> const ComponentList &;
+  void DropComponents() noexcept;
+
+  friend class DirectoryStream;
+  friend ASAP_FILESYSTEM_API auto hash_value(const path &p) noexcept -> size_t;
+
+  // Replace the filename at the end of a path made of a directory and a
+  // filename (i.e. `dir / filename`) with `name`, reusing the memory already
+  // allocated for the path. `prefix_size` is the size of the directory part,
+  // including the separator, and `name` must be a single filename. This makes
+  // iterating over the entries of a directory allocation free.
+  void ReplaceTrailingFilename(size_t prefix_size, const value_type *name,
+                               size_t len);
+
+  // A component of a path, as a range of its pathname.
+  struct Component {
+    Component() = default;
+    Component(size_t pos, size_t len, Type type) noexcept
+        : pos_(pos), len_(len), type_(type) {}
+
+    size_t pos_;
+    size_t len_;
+    Type type_;
+  };
+
+  // Gets the components of a pathname one after the other, as begin() gives
+  // them, without allocating or changing the path.
+  class ComponentScanner;
+
+  void AppendComponent(string_type &str, const Component &cmpt) const;
+  auto ComponentPath(const Component &cmpt) const -> path;
+  auto CompareComponent(const Component &cmpt, const path &other,
+                        const Component &other_cmpt) const noexcept -> int;
+  auto HashComponent(const Component &cmpt) const noexcept -> size_t;
+  auto FirstComponent() const noexcept -> Component;
+  // The components before last and last of a MULTI path.
+  auto LastComponents() const noexcept -> std::pair<Component, Component>;
+  // The root name and root directory, with a length of 0 when absent.
+  void FindRoot(Component &root_name, Component &root_dir) const noexcept;
 
   template <typename Allocator = std::allocator<value_type>>
   auto make_generic(const Allocator &alloc = Allocator()) const -> string_type;
 
-  struct Component;
-  using List = std::vector<Component>;
 #if defined(HEDLEY_MSVC_VERSION)
 #pragma warning(push)
 #pragma warning(disable : 4251)
 #endif
   string_type pathname_;
-  List components_; // empty unless type_ == Type::MULTI
+  // null until a MULTI path is iterated
+  mutable std::atomic<ComponentList *> components_{nullptr};
 #if defined(HEDLEY_MSVC_VERSION)
 #pragma warning(pop)
 #endif
@@ -391,6 +449,11 @@ inline void swap(path &lhs, path &rhs) noexcept { lhs.swap(rhs); }
 auto ASAP_FILESYSTEM_API hash_value(const path &p) noexcept -> size_t;
 
 /// An iterator for the components of a path
+/*!
+ * The components are built as paths and kept in the path the first time it is
+ * iterated. The references to them stay valid until the path is modified, so
+ * the iterator also works with std::reverse_iterator.
+ */
 class ASAP_FILESYSTEM_API path::iterator {
  public:
   using difference_type = std::ptrdiff_t;
@@ -432,19 +495,19 @@ class ASAP_FILESYSTEM_API path::iterator {
  private:
   friend class path;
 
-  iterator(const path *path, path::List::const_iterator iter)
+  iterator(const path *path, path::ComponentList::const_iterator iter)
       : path_(path), cur_(iter) {}
 
   iterator(const path *path, bool at_end) : path_(path), at_end_(at_end) {}
 
-  auto equals(iterator) const -> bool;
+  auto equals(const iterator &) const -> bool;
 
   const path *path_{};
 #if defined(HEDLEY_MSVC_VERSION)
 #pragma warning(push)
 #pragma warning(disable : 4251)
 #endif
-  path::List::const_iterator cur_;
+  path::ComponentList::const_iterator cur_{};
 #if defined(HEDLEY_MSVC_VERSION)
 #pragma warning(pop)
 #endif
@@ -532,13 +595,6 @@ auto operator>>(std::basic_istream<CharT, Traits> &is, path &p)
   return is;
 }
 
-struct path::Component : path {
-  Component(string_type pathname, Type type, size_t pos) noexcept
-      : path(std::move(pathname), type), pos_(pos) {}
-
-  size_t pos_;
-};
-
 // specialize Converter for degenerate 'noconv' case
 template <>
 struct path::Converter<path::value_type> {
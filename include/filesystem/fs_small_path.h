@@ -0,0 +1,281 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/fs_path.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                               small_path
+// -----------------------------------------------------------------------------
+
+/*!
+@brief A pathname stored inside the object when it is shorter than N
+characters.
+
+This is an extension to the standard. A path keeps its pathname in a
+std::string, which allocates as soon as the pathname is longer than its small
+string buffer (15 characters with libstdc++ and MSVC). Building, copying,
+appending to and destroying a small_path does not allocate as long as its
+pathname has less than N characters; a longer pathname moves to the heap.
+
+A small_path is meant for building pathnames, e.g. in a loop, and for passing
+them to the system with c_str(). Appending follows the rules of path::operator/=
+and it converts to and from path, so it can be given to any function taking a
+path. The conversion to path allocates like building the path from a string
+does. Unlike path, a small_path keeps its pathname as given: it does not trim a
+pathname made only of separators, such as "//".
+*/
+template <std::size_t N = 128>
+class small_path {
+  static_assert(N > 0, "small_path needs room for the terminating null");
+
+ public:
+  using value_type = path::value_type;
+  using string_type = path::string_type;
+
+  /// @name Constructors and destructor
+  //@{
+
+  small_path() noexcept { buffer_[0] = value_type(); }
+
+  // NOLINTNEXTLINE
+  small_path(const value_type *source) : small_path() {
+    assign(source, std::char_traits<value_type>::length(source));
+  }
+
+  // NOLINTNEXTLINE
+  small_path(const string_type &source) : small_path() {
+    assign(source.data(), source.size());
+  }
+
+  // NOLINTNEXTLINE
+  small_path(const path &p) : small_path(p.native()) {}
+
+  small_path(const small_path &other)
+      : size_(other.size_), overflow_(other.overflow_) {
+    if (size_ < N) {
+      std::memcpy(buffer_, other.buffer_, size_ + 1);
+    }
+  }
+
+  small_path(small_path &&other) noexcept
+      : size_(other.size_), overflow_(std::move(other.overflow_)) {
+    if (size_ < N) {
+      std::memcpy(buffer_, other.buffer_, size_ + 1);
+    }
+    other.clear();
+  }
+
+  ~small_path() = default;
+
+  //@}
+
+  /// @name Assignments
+  //@{
+
+  auto operator=(const small_path &other) -> small_path & {
+    if (this != &other) {
+      assign(other.c_str(), other.size_);
+    }
+    return *this;
+  }
+
+  auto operator=(small_path &&other) noexcept -> small_path & {
+    if (this != &other) {
+      size_ = other.size_;
+      overflow_ = std::move(other.overflow_);
+      if (size_ < N) {
+        std::memcpy(buffer_, other.buffer_, size_ + 1);
+      }
+      other.clear();
+    }
+    return *this;
+  }
+
+  auto operator=(const value_type *source) -> small_path & {
+    assign(source, std::char_traits<value_type>::length(source));
+    return *this;
+  }
+
+  auto operator=(const string_type &source) -> small_path & {
+    assign(source.data(), source.size());
+    return *this;
+  }
+
+  auto operator=(const path &p) -> small_path & { return *this = p.native(); }
+
+  //@}
+
+  /// @name Appends
+  //@{
+
+  auto operator/=(const small_path &other) -> small_path & {
+    if (this == &other) {
+      return *this /= small_path(other);
+    }
+    return append(other.c_str(), other.size_);
+  }
+
+  auto operator/=(const value_type *source) -> small_path & {
+    return append(source, std::char_traits<value_type>::length(source));
+  }
+
+  auto operator/=(const string_type &source) -> small_path & {
+    return append(source.data(), source.size());
+  }
+
+  auto operator/=(const path &p) -> small_path & { return *this /= p.native(); }
+
+  //@}
+
+  /// @name Concatenation
+  //@{
+
+  auto operator+=(const small_path &other) -> small_path & {
+    if (this == &other) {
+      return *this += small_path(other);
+    }
+    concat(other.c_str(), other.size_);
+    return *this;
+  }
+
+  auto operator+=(const value_type *source) -> small_path & {
+    concat(source, std::char_traits<value_type>::length(source));
+    return *this;
+  }
+
+  auto operator+=(const string_type &source) -> small_path & {
+    concat(source.data(), source.size());
+    return *this;
+  }
+
+  auto operator+=(value_type ch) -> small_path & {
+    concat(&ch, 1);
+    return *this;
+  }
+
+  //@}
+
+  /// @name Observers
+  //@{
+
+  auto c_str() const noexcept -> const value_type * {
+    return size_ < N ? buffer_ : overflow_.c_str();
+  }
+  auto size() const noexcept -> std::size_t { return size_; }
+  auto empty() const noexcept -> bool { return size_ == 0; }
+  /// Whether the pathname is stored inside the object.
+  auto is_inline() const noexcept -> bool { return size_ < N; }
+
+  auto string() const -> string_type { return {c_str(), size_}; }
+  auto to_path() const -> path { return path(string()); }
+  // NOLINTNEXTLINE
+  operator path() const { return to_path(); }
+
+  //@}
+
+  void clear() noexcept {
+    buffer_[0] = value_type();
+    size_ = 0;
+    overflow_.clear();
+  }
+
+  void swap(small_path &other) noexcept {
+    small_path tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+ private:
+  static auto IsDirSeparator(value_type ch) noexcept -> bool {
+    return ch == '/'
+#ifdef ASAP_WINDOWS
+           || ch == '\\'
+#endif
+        ;
+  }
+
+#ifdef ASAP_WINDOWS
+  // Whether the pathname starts with a root name, such as "c:" or "//host".
+  static auto HasRootName(const value_type *source, std::size_t len) noexcept
+      -> bool {
+    if (len > 1 && !IsDirSeparator(source[0]) && source[1] == ':') {
+      return true;
+    }
+    return len > 2 && IsDirSeparator(source[0]) && source[1] == source[0] &&
+           !IsDirSeparator(source[2]);
+  }
+#endif
+
+  void assign(const value_type *source, std::size_t len) {
+    if (len < N) {
+      // source may be in this path
+      std::memmove(buffer_, source, len);
+      buffer_[len] = value_type();
+      overflow_.clear();
+    } else {
+      overflow_.assign(source, len);
+    }
+    size_ = len;
+  }
+
+  void concat(const value_type *source, std::size_t len) {
+    const auto size = size_ + len;
+    if (size < N) {
+      std::memmove(buffer_ + size_, source, len);
+      buffer_[size] = value_type();
+    } else if (size_ < N) {
+      string_type grown;
+      grown.reserve(size);
+      grown.append(buffer_, size_);
+      grown.append(source, len);
+      overflow_.swap(grown);
+    } else {
+      overflow_.append(source, len);
+    }
+    size_ = size;
+  }
+
+  auto append(const value_type *source, std::size_t len) -> small_path & {
+#ifdef ASAP_WINDOWS
+    // Root names follow rules of their own, only path knows them
+    if (HasRootName(c_str(), size_) || HasRootName(source, len)) {
+      return *this = path(c_str()) /= path(string_type(source, len));
+    }
+#endif
+    if (len != 0 && IsDirSeparator(source[0])) {
+      // An absolute path replaces this one
+      assign(source, len);
+      return *this;
+    }
+    if (size_ != 0 && !IsDirSeparator(c_str()[size_ - 1])) {
+      const value_type separator = path::preferred_separator;
+      concat(&separator, 1);
+    }
+    concat(source, len);
+    return *this;
+  }
+
+  value_type buffer_[N];
+  std::size_t size_{0};
+  // Holds the pathname when it does not fit in buffer_
+  string_type overflow_;
+};
+
+template <std::size_t N>
+inline void swap(small_path<N> &lhs, small_path<N> &rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+}  // namespace filesystem
+}  // namespace asap
@@ -0,0 +1,82 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/asap_filesystem_api.h>
+#include <filesystem/fs_path.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                               stat cache
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Controls the cache of file attributes enabled with enable_stat_cache().
+
+This is an extension to the standard. When enabled, status(), symlink_status(),
+file_size(), last_write_time() and is_empty() share the attributes they get
+from the system, so that asking for several attributes of the same file in a
+row costs a single system call. The absence of a file is cached as well.
+
+The changes made through this library (create_directory(), remove(), rename(),
+permissions()...) are seen immediately, including the new modification time of
+the directory an entry was added to or removed from, when that directory is
+named like the parent of the entry (e.g. "d" for "d/x", "." for "x"). The
+changes made by other processes, or through other paths to the same file such
+as symlinks, are only seen once the cached attributes are older than `ttl`, or
+after calling invalidate_stat_cache(). The cache is shared by all threads of
+the process.
+
+On Windows, the cache is not consulted yet.
+*/
+struct stat_cache_options {
+  /// How long the attributes of a file are used before being fetched again.
+  std::chrono::milliseconds ttl{1000};
+  /// The maximum number of files in the cache. The least recently used are
+  /// dropped to make room for new ones.
+  std::size_t max_entries{65536};
+};
+
+/// How well the cache is doing since it was enabled.
+struct stat_cache_stats {
+  /// Lookups answered from the cache.
+  std::uint64_t hits{0};
+  /// Lookups that went to the system, including those finding expired
+  /// attributes.
+  std::uint64_t misses{0};
+  /// Files dropped to make room for others.
+  std::uint64_t evictions{0};
+  /// Files currently in the cache.
+  std::size_t size{0};
+};
+
+/// Enables the cache, emptying it and resetting its statistics.
+ASAP_FILESYSTEM_API void enable_stat_cache(
+    const stat_cache_options &options = {});
+
+/// Disables the cache and empties it. It is disabled by default.
+ASAP_FILESYSTEM_API void disable_stat_cache();
+
+/// Whether the cache is enabled.
+ASAP_FILESYSTEM_API auto stat_cache_enabled() noexcept -> bool;
+
+/// Drops the attributes of `p` from the cache, with and without following
+/// symlinks.
+ASAP_FILESYSTEM_API void invalidate_stat_cache(const path &p);
+
+/// Drops all the attributes from the cache.
+ASAP_FILESYSTEM_API void clear_stat_cache();
+
+ASAP_FILESYSTEM_API auto stat_cache_statistics() -> stat_cache_stats;
+
+}  // namespace filesystem
+}  // namespace asap
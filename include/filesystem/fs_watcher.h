@@ -0,0 +1,126 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <filesystem/asap_filesystem_api.h>
+#include <filesystem/fs_path.h>
+
+#include <hedley/hedley.h>
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace asap {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------
+//                                 watcher
+// -----------------------------------------------------------------------------
+
+/// What happened to a watched path.
+enum class watch_event_kind : unsigned char {
+  created,
+  modified,
+  removed,
+  /// Moved or renamed within the watched tree.
+  renamed,
+  /// Too many events happened to report them all, and some were dropped. The
+  /// watched tree should be looked at again as a whole.
+  overflow
+};
+
+struct watch_event {
+  watch_event_kind kind;
+  /// The affected path, or the old path when renamed. Empty on overflow.
+  filesystem::path path;
+  /// The new path when renamed, empty otherwise.
+  filesystem::path new_path;
+};
+
+/// Controls how a watcher looks for changes and reports them.
+struct watch_options {
+  /// Whether the changes in the sub-directories are reported too.
+  bool recursive{false};
+  /// How long the events are collected after the first one before being
+  /// reported in one batch.
+  std::chrono::milliseconds latency{50};
+  /// How often the tree is scanned for changes when the system does not
+  /// notify them.
+  std::chrono::milliseconds poll_interval{1000};
+  /// The maximum number of events kept for one batch. Beyond that, the events
+  /// of the batch are replaced by a single overflow event.
+  std::size_t max_events{4096};
+  /// Whether the system may notify the changes. When false, the tree is always
+  /// scanned instead.
+  bool allow_notifications{true};
+  /// The maximum number of directories the system watches for this watcher, or
+  /// 0 for no other limit than the system's, e.g. to leave inotify watches to
+  /// other programs. A tree needing more is scanned instead.
+  std::size_t max_watches{0};
+};
+
+/*!
+@brief Reports the changes made to a file, or to the entries of a directory,
+as they happen.
+
+This is an extension to the standard, to use instead of calling
+last_write_time() or iterating over a directory in a loop. On Linux, the kernel
+notifies the changes through inotify. Elsewhere, or when the kernel cannot
+watch the whole tree, the tree is scanned every `poll_interval` and compared to
+the previous scan; only the type, size and modification time of the entries
+are compared then, and renames are reported as a removal and a creation. When
+the tree grows beyond what the kernel can watch while being watched, an
+overflow event is reported and the tree is scanned from then on.
+
+The events are collected for `latency` after the first one and then passed to
+the callback in one batch, in the order they happened. The events of a batch
+are coalesced: a path appears only once, e.g. a file created and written to is
+reported as created, and a file created and removed is not reported at all.
+When the watched path itself is removed or moved, it is reported as removed
+and nothing more is reported.
+
+The callback is called from a thread owned by the watcher, one batch at a
+time. It must not throw and must not destroy the watcher. The destructor
+stops watching and waits for the callback to return.
+*/
+class ASAP_FILESYSTEM_API watcher {
+ public:
+  using callback = std::function<void(std::vector<watch_event>)>;
+
+  /// Starts watching `p`, which must exist. The changes made after the
+  /// constructor returns are reported.
+  watcher(const path &p, callback on_events, const watch_options &options = {});
+  /// Same as above, but reports the errors in `ec`. On error, the watcher
+  /// reports nothing.
+  watcher(const path &p, callback on_events, const watch_options &options,
+          std::error_code &ec);
+  watcher(const watcher &) = delete;
+  auto operator=(const watcher &) -> watcher & = delete;
+  ~watcher();
+
+  /// Whether the changes are notified by the system, rather than found by
+  /// scanning the watched tree.
+  auto uses_notifications() const noexcept -> bool;
+
+ private:
+  class Impl;
+
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+  std::unique_ptr<Impl> impl_;
+#if defined(HEDLEY_MSVC_VERSION)
+#pragma warning(pop)
+#endif
+};
+
+}  // namespace filesystem
+}  // namespace asap
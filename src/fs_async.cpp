@@ -0,0 +1,960 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <filesystem/fs_async.h>
+#include <filesystem/fs_ops.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fs_error.h"
+#include "fs_portability.h"
+#include "fs_stat_cache.h"
+#include "fs_thread_pool.h"
+
+namespace asap {
+namespace filesystem {
+
+using detail::ErrorHandler;
+
+namespace {
+
+// -----------------------------------------------------------------------------
+//                          detail: AsyncOperation
+// -----------------------------------------------------------------------------
+
+enum class OperationKind {
+  STATUS,
+  SYMLINK_STATUS,
+  FILE_SIZE,
+  LAST_WRITE_TIME,
+  CREATE_DIRECTORY,
+  REMOVE,
+  RENAME,
+  OPEN
+};
+
+// An operation and its result, kept alive until it completes.
+struct AsyncOperation {
+  explicit AsyncOperation(OperationKind k) : kind(k) {}
+
+  OperationKind kind;
+  path p1;
+  path p2;
+  open_flags flags{open_flags::read};
+
+  // The result, as the synchronous operation taking an error code gives it
+  std::error_code ec;
+  file_status status;
+  std::uintmax_t size{0};
+  file_time_type write_time{file_time_type::min()};
+  bool result{false};
+  file_handle handle;
+
+  // Called once the result is set
+  std::function<void(AsyncOperation &)> complete;
+
+  // Whether the operation takes a slot of the ring while in flight
+  bool on_ring{false};
+#if defined(ASAP_FS_USE_IO_URING)
+  struct ::statx stx {};
+  // remove() first tries to unlink the path as a file, then as a directory
+  bool removing_directory{false};
+#endif  // ASAP_FS_USE_IO_URING
+};
+
+using AsyncOperationPtr = std::unique_ptr<AsyncOperation>;
+
+// Runs the operation in the calling thread.
+void RunOperation(AsyncOperation &op) {
+  switch (op.kind) {
+    case OperationKind::STATUS:
+      op.status = status_impl(op.p1, &op.ec);
+      break;
+    case OperationKind::SYMLINK_STATUS:
+      op.status = symlink_status_impl(op.p1, &op.ec);
+      break;
+    case OperationKind::FILE_SIZE:
+      op.size = file_size_impl(op.p1, &op.ec);
+      break;
+    case OperationKind::LAST_WRITE_TIME:
+      op.write_time = last_write_time_impl(op.p1, &op.ec);
+      break;
+    case OperationKind::CREATE_DIRECTORY:
+      op.result = create_directory_impl(op.p1, &op.ec);
+      break;
+    case OperationKind::REMOVE:
+      op.result = remove_impl(op.p1, &op.ec);
+      break;
+    case OperationKind::RENAME:
+      rename_impl(op.p1, op.p2, &op.ec);
+      break;
+    case OperationKind::OPEN:
+      op.handle = file_handle(op.p1, op.flags, op.ec);
+      break;
+  }
+}
+
+#if defined(ASAP_FS_USE_IO_URING)
+// -----------------------------------------------------------------------------
+//                              detail: IoUring
+// -----------------------------------------------------------------------------
+
+namespace linux_port = detail::linux_port;
+
+/*!
+@brief A minimal io_uring submission and completion ring, driven directly with
+the system calls.
+
+The ring is not thread safe: the caller serializes the staging of submissions,
+and makes sure there are never more entries staged or in flight than Entries(),
+which also guarantees that the completion ring never overflows. Submit() and
+Reap() may be called concurrently with the staging of new entries.
+*/
+class IoUring {
+ public:
+  IoUring() = default;
+  IoUring(const IoUring &) = delete;
+  auto operator=(const IoUring &) -> IoUring & = delete;
+  ~IoUring() { Close(); }
+
+  // Sets up a ring with room for at least `entries` submissions. Returns false
+  // when io_uring is not available, e.g. on kernels older than 5.6 or when it
+  // is disabled by a seccomp filter or by the administrator.
+  auto Open(unsigned entries) -> bool {
+    struct ::io_uring_params params {};
+    params.flags = IORING_SETUP_CLAMP;
+    fd_ = static_cast<int>(
+        linux_port::syscall(SYS_io_uring_setup, entries, &params));
+    if (fd_ == -1) {
+      return false;
+    }
+    entries_ = params.sq_entries;
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes +
+               params.cq_entries * sizeof(struct ::io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ring_ = Map(sq_size_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == nullptr) {
+      Close();
+      return false;
+    }
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = Map(cq_size_, IORING_OFF_CQ_RING);
+      if (cq_ring_ == nullptr) {
+        Close();
+        return false;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct ::io_uring_sqe);
+    sqes_ = static_cast<struct ::io_uring_sqe *>(
+        Map(sqes_size_, IORING_OFF_SQES));
+    if (sqes_ == nullptr) {
+      Close();
+      return false;
+    }
+
+    auto *sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct ::io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    Probe();
+    return true;
+  }
+
+  auto IsOpen() const noexcept -> bool { return fd_ != -1; }
+
+  auto Entries() const noexcept -> unsigned { return entries_; }
+
+  // Whether the running kernel supports the operation `opcode`.
+  auto Supports(unsigned opcode) const noexcept -> bool {
+    return opcode < supported_.size() && supported_[opcode];
+  }
+
+  // Returns the entry to fill for the next submission, which is sent to the
+  // kernel by the next call to Submit() after Stage().
+  auto NextEntry() -> struct ::io_uring_sqe & {
+    const unsigned index = *sq_tail_ & sq_mask_;
+    auto &sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sq_array_[index] = index;
+    return sqe;
+  }
+
+  void Stage() { __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE); }
+
+  // Whether some staged entries were not taken by the kernel yet.
+  auto HasStaged() const noexcept -> bool {
+    return __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) !=
+           __atomic_load_n(sq_tail_, __ATOMIC_ACQUIRE);
+  }
+
+  // Sends all the staged entries to the kernel and, when `wait` is true, then
+  // blocks until at least one operation completes. Returns false on failure,
+  // with errno set.
+  auto Submit(bool wait) -> bool {
+    const unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+      // The kernel never submits more entries than are staged.
+      if (linux_port::syscall(SYS_io_uring_enter, fd_, entries_,
+                              wait ? 1U : 0U, flags, nullptr, 0) != -1) {
+        return true;
+      }
+      if (errno == EAGAIN || errno == EBUSY) {
+        // Out of memory for the requests, or completions are backed up: give
+        // the kernel some time to catch up.
+        std::this_thread::yield();
+      } else if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  // Calls `handler(user_data, res)` for each completed operation.
+  template <typename Handler>
+  void Reap(Handler &&handler) {
+    unsigned head = *cq_head_;
+    for (;;) {
+      if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      const auto &cqe = cqes_[head & cq_mask_];
+      const auto user_data = cqe.user_data;
+      const auto res = cqe.res;
+      ++head;
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      handler(user_data, res);
+    }
+  }
+
+  void Close() noexcept {
+    if (sqes_ != nullptr) {
+      linux_port::munmap(sqes_, sqes_size_);
+      sqes_ = nullptr;
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      linux_port::munmap(cq_ring_, cq_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_ != nullptr) {
+      linux_port::munmap(sq_ring_, sq_size_);
+      sq_ring_ = nullptr;
+    }
+    if (fd_ != -1) {
+      detail::posix_port::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+ private:
+  auto Map(std::size_t size, off_t offset) -> void * {
+    void *addr = linux_port::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return addr == MAP_FAILED ? nullptr : addr;
+  }
+
+  // Finds out which operations the kernel supports. Kernels too old to tell
+  // are treated as supporting none of them.
+  void Probe() {
+    constexpr unsigned ops = 256;
+    std::vector<char> buffer(sizeof(struct ::io_uring_probe) +
+                             ops * sizeof(struct ::io_uring_probe_op));
+    auto *probe = reinterpret_cast<struct ::io_uring_probe *>(buffer.data());
+    if (linux_port::syscall(SYS_io_uring_register, fd_, IORING_REGISTER_PROBE,
+                            probe, ops) == -1) {
+      return;
+    }
+    supported_.assign(ops, false);
+    for (unsigned op = 0; op <= probe->last_op && op < probe->ops_len; ++op) {
+      supported_[op] = (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+  }
+
+  int fd_{-1};
+  unsigned entries_{0};
+  std::vector<bool> supported_;
+
+  void *sq_ring_{nullptr};
+  std::size_t sq_size_{0};
+  unsigned *sq_head_{nullptr};
+  unsigned *sq_tail_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned *sq_array_{nullptr};
+  struct ::io_uring_sqe *sqes_{nullptr};
+  std::size_t sqes_size_{0};
+
+  void *cq_ring_{nullptr};
+  std::size_t cq_size_{0};
+  unsigned *cq_head_{nullptr};
+  unsigned *cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  struct ::io_uring_cqe *cqes_{nullptr};
+};
+
+auto Opcode(OperationKind kind) -> unsigned {
+  switch (kind) {
+    case OperationKind::STATUS:
+    case OperationKind::SYMLINK_STATUS:
+    case OperationKind::FILE_SIZE:
+    case OperationKind::LAST_WRITE_TIME:
+      return IORING_OP_STATX;
+    case OperationKind::CREATE_DIRECTORY:
+      return IORING_OP_MKDIRAT;
+    case OperationKind::REMOVE:
+      return IORING_OP_UNLINKAT;
+    case OperationKind::RENAME:
+      return IORING_OP_RENAMEAT;
+    case OperationKind::OPEN:
+      // Never on the ring
+      break;
+  }
+  HEDLEY_UNREACHABLE();
+}
+
+auto PathAddress(const path &p) -> std::uint64_t {
+  return reinterpret_cast<std::uintptr_t>(p.c_str());
+}
+
+void PrepareEntry(struct ::io_uring_sqe &sqe, AsyncOperation &op) {
+  sqe.opcode = static_cast<std::uint8_t>(Opcode(op.kind));
+  sqe.fd = AT_FDCWD;
+  sqe.addr = PathAddress(op.p1);
+  sqe.user_data = reinterpret_cast<std::uintptr_t>(&op);
+  switch (op.kind) {
+    case OperationKind::STATUS:
+    case OperationKind::SYMLINK_STATUS:
+    case OperationKind::FILE_SIZE:
+    case OperationKind::LAST_WRITE_TIME:
+      // Same flags as stat() and lstat(), which never trigger an automount
+      sqe.statx_flags =
+          AT_NO_AUTOMOUNT | AT_STATX_SYNC_AS_STAT |
+          (op.kind == OperationKind::SYMLINK_STATUS ? AT_SYMLINK_NOFOLLOW : 0);
+      sqe.len = STATX_TYPE | STATX_MODE |
+                (op.kind == OperationKind::FILE_SIZE ? STATX_SIZE : 0U) |
+                (op.kind == OperationKind::LAST_WRITE_TIME ? STATX_MTIME : 0U);
+      sqe.off = reinterpret_cast<std::uintptr_t>(&op.stx);
+      break;
+    case OperationKind::CREATE_DIRECTORY:
+      sqe.len = static_cast<unsigned>(perms::all);
+      break;
+    case OperationKind::REMOVE:
+      sqe.unlink_flags = op.removing_directory ? AT_REMOVEDIR : 0;
+      break;
+    case OperationKind::RENAME:
+      sqe.len = static_cast<unsigned>(AT_FDCWD);
+      sqe.addr2 = PathAddress(op.p2);
+      break;
+    case OperationKind::OPEN:
+      // Never on the ring
+      HEDLEY_UNREACHABLE();
+  }
+}
+
+// Sets the result of the operation from the result `res` of its system call,
+// the same way the synchronous operation does. Returns false when the
+// operation must be submitted again.
+auto FinishOperation(AsyncOperation &op, int res) -> bool {
+  std::error_code m_ec;
+  if (res < 0) {
+    m_ec = std::error_code(-res, std::generic_category());
+  }
+  // Like the synchronous operations, the changes drop the cached attributes
+  if (detail::StatCacheEnabled()) {
+    if (op.kind == OperationKind::CREATE_DIRECTORY ||
+        op.kind == OperationKind::REMOVE) {
+      detail::InvalidateEntry(op.p1);
+    } else if (op.kind == OperationKind::RENAME) {
+      detail::ClearStats();
+    }
+  }
+  switch (op.kind) {
+    case OperationKind::STATUS:
+    case OperationKind::SYMLINK_STATUS:
+    case OperationKind::FILE_SIZE:
+    case OperationKind::LAST_WRITE_TIME: {
+      detail::posix_port::StatT st{};
+      st.st_mode = op.stx.stx_mode;
+      st.st_mtim.tv_sec =
+          static_cast<decltype(st.st_mtim.tv_sec)>(op.stx.stx_mtime.tv_sec);
+      st.st_mtim.tv_nsec =
+          static_cast<decltype(st.st_mtim.tv_nsec)>(op.stx.stx_mtime.tv_nsec);
+      op.status = detail::posix_port::CreateFileStatus(m_ec, op.p1, st, &op.ec);
+      if (op.kind == OperationKind::LAST_WRITE_TIME && !op.ec) {
+        op.write_time =
+            detail::posix_port::ExtractLastWriteTime(op.p1, st, &op.ec);
+      }
+      if (op.kind != OperationKind::FILE_SIZE) {
+        break;
+      }
+      if (!is_regular_file(op.status)) {
+        if (!op.ec) {
+          op.ec = make_error_code(is_directory(op.status)
+                                      ? std::errc::is_a_directory
+                                      : std::errc::not_supported);
+        }
+        op.size = static_cast<std::uintmax_t>(-1);
+      } else {
+        op.size = op.stx.stx_size;
+      }
+      break;
+    }
+    case OperationKind::CREATE_DIRECTORY:
+      op.result = res == 0;
+      if (res != -EEXIST) {
+        op.ec = m_ec;
+      }
+      break;
+    case OperationKind::REMOVE:
+      // Like remove(), which unlinks the path and then removes it as a
+      // directory when it turns out to be one.
+      if (res == -EISDIR && !op.removing_directory) {
+        op.removing_directory = true;
+        return false;
+      }
+      op.result = res == 0;
+      if (res != -ENOENT) {
+        op.ec = m_ec;
+      }
+      break;
+    case OperationKind::RENAME:
+      op.ec = m_ec;
+      break;
+    case OperationKind::OPEN:
+      HEDLEY_UNREACHABLE();
+  }
+  return true;
+}
+#endif  // ASAP_FS_USE_IO_URING
+
+// Stores in `promise` the exception that the throwing synchronous operation
+// would have thrown.
+template <typename Promise>
+void SetError(Promise &promise, const char *func_name,
+              const std::error_code &ec, const path &p1,
+              const path *p2 = nullptr) {
+  try {
+    ErrorHandler<void>(func_name, nullptr, &p1, p2).report(ec);
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+//                            async_queue::Impl
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Keeps track of the operations in flight, and runs them on the ring or
+the thread pool.
+
+With io_uring, a dedicated thread waits for the completions and calls the
+callbacks. The thread submitting an operation also sends it to the kernel,
+together with the ones staged by other threads in the meantime.
+*/
+class async_queue::Impl {
+ public:
+  Impl(std::size_t queue_depth, bool allow_io_uring)
+      : depth_(std::max<std::size_t>(1, queue_depth)) {
+#if defined(ASAP_FS_USE_IO_URING)
+    const auto entries = static_cast<unsigned>(
+        std::min<std::size_t>(depth_, std::numeric_limits<unsigned>::max()));
+    if (allow_io_uring && ring_.Open(entries)) {
+      depth_ = std::min<std::size_t>(depth_, ring_.Entries());
+      reaper_ = std::thread([this]() { Reap(); });
+    }
+#else
+    (void)allow_io_uring;
+#endif  // ASAP_FS_USE_IO_URING
+  }
+
+  Impl(const Impl &) = delete;
+  auto operator=(const Impl &) -> Impl & = delete;
+
+  ~Impl() {
+    Wait();
+#if defined(ASAP_FS_USE_IO_URING)
+    if (reaper_.joinable()) {
+      // Wake up the reaper with an operation that tells it to stop.
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &sqe = ring_.NextEntry();
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = 0;
+        ring_.Stage();
+      }
+      ring_.Submit(false);
+      reaper_.join();
+    }
+#endif  // ASAP_FS_USE_IO_URING
+  }
+
+  void Submit(AsyncOperationPtr op) {
+#if defined(ASAP_FS_USE_IO_URING)
+    // remove() of an empty path succeeds without doing anything. The files are
+    // opened by file_handle, which knows how.
+    if (ring_.IsOpen() && op->kind != OperationKind::OPEN &&
+        ring_.Supports(Opcode(op->kind)) && !op->p1.empty()) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (std::this_thread::get_id() != reaper_.get_id()) {
+        space_.wait(lock, [this]() { return on_ring_ < depth_; });
+      }
+      // The reaper cannot wait for itself to free a slot.
+      if (on_ring_ < depth_) {
+        ++in_flight_;
+        ++on_ring_;
+        op->on_ring = true;
+        PrepareEntry(ring_.NextEntry(), *op.release());
+        ring_.Stage();
+        lock.unlock();
+        SendStaged();
+        return;
+      }
+    }
+#endif  // ASAP_FS_USE_IO_URING
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++in_flight_;
+    }
+    auto *raw_op = op.release();
+    detail::ThreadPool::Instance().Submit([this, raw_op]() {
+      RunOperation(*raw_op);
+      Complete(raw_op);
+    });
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return in_flight_ == 0; });
+  }
+
+  auto UsesIoUring() const noexcept -> bool {
+#if defined(ASAP_FS_USE_IO_URING)
+    return ring_.IsOpen();
+#else
+    return false;
+#endif  // ASAP_FS_USE_IO_URING
+  }
+
+ private:
+  void Complete(AsyncOperation *op) {
+    const bool on_ring = op->on_ring;
+    op->complete(*op);
+    delete op;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (on_ring) {
+      --on_ring_;
+      space_.notify_one();
+    }
+    if (--in_flight_ == 0) {
+      idle_.notify_all();
+    }
+  }
+
+#if defined(ASAP_FS_USE_IO_URING)
+  void SendStaged() {
+    // On failure, the entries stay staged and are sent by the reaper when it
+    // next waits for completions.
+    if (ring_.HasStaged()) {
+      ring_.Submit(false);
+    }
+  }
+
+  void Reap() {
+    bool stop = false;
+    while (!stop) {
+      if (!ring_.Submit(true)) {
+        // Nothing sensible left to do with a broken ring: keep reaping what
+        // already completed, and let the next submission try again.
+        std::this_thread::yield();
+      }
+      ring_.Reap([this, &stop](std::uint64_t user_data, int res) {
+        if (user_data == 0) {
+          stop = true;
+          return;
+        }
+        auto *op = reinterpret_cast<AsyncOperation *>(user_data);
+        if (FinishOperation(*op, res)) {
+          Complete(op);
+          return;
+        }
+        // The operation keeps its slot in the ring.
+        std::lock_guard<std::mutex> lock(mutex_);
+        PrepareEntry(ring_.NextEntry(), *op);
+        ring_.Stage();
+      });
+    }
+  }
+
+  IoUring ring_;
+  std::thread reaper_;
+#endif  // ASAP_FS_USE_IO_URING
+
+  std::size_t depth_;
+
+  std::mutex mutex_;
+  // Signaled when a slot of the ring becomes free
+  std::condition_variable space_;
+  // Signaled when no operation is in flight anymore
+  std::condition_variable idle_;
+  std::size_t in_flight_{0};
+  std::size_t on_ring_{0};
+};
+
+// -----------------------------------------------------------------------------
+//                               async_queue
+// -----------------------------------------------------------------------------
+
+namespace {
+auto MakeOperation(OperationKind kind, const path &p1,
+                   const path &p2 = path()) -> AsyncOperationPtr {
+  AsyncOperationPtr op(new AsyncOperation(kind));
+  op->p1 = p1;
+  op->p2 = p2;
+  return op;
+}
+}  // namespace
+
+async_queue::async_queue(std::size_t queue_depth, bool allow_io_uring)
+    : impl_(new Impl(queue_depth, allow_io_uring)) {}
+
+async_queue::~async_queue() = default;
+
+void async_queue::status(const path &p, status_callback done) {
+  auto op = MakeOperation(OperationKind::STATUS, p);
+  op->complete = [done](AsyncOperation &completed) {
+    done(completed.status, completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::status(const path &p) -> std::future<file_status> {
+  auto promise = std::make_shared<std::promise<file_status>>();
+  auto op = MakeOperation(OperationKind::STATUS, p);
+  op->complete = [promise](AsyncOperation &completed) {
+    // A missing file is not an error for the throwing status()
+    if (completed.ec && completed.status.type() == file_type::none) {
+      SetError(*promise, "async_queue::status", completed.ec, completed.p1);
+    } else {
+      promise->set_value(completed.status);
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::symlink_status(const path &p, status_callback done) {
+  auto op = MakeOperation(OperationKind::SYMLINK_STATUS, p);
+  op->complete = [done](AsyncOperation &completed) {
+    done(completed.status, completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::symlink_status(const path &p) -> std::future<file_status> {
+  auto promise = std::make_shared<std::promise<file_status>>();
+  auto op = MakeOperation(OperationKind::SYMLINK_STATUS, p);
+  op->complete = [promise](AsyncOperation &completed) {
+    if (completed.ec && completed.status.type() == file_type::none) {
+      SetError(*promise, "async_queue::symlink_status", completed.ec,
+               completed.p1);
+    } else {
+      promise->set_value(completed.status);
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::file_size(const path &p, size_callback done) {
+  auto op = MakeOperation(OperationKind::FILE_SIZE, p);
+  op->complete = [done](AsyncOperation &completed) {
+    done(completed.size, completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::file_size(const path &p) -> std::future<std::uintmax_t> {
+  auto promise = std::make_shared<std::promise<std::uintmax_t>>();
+  auto op = MakeOperation(OperationKind::FILE_SIZE, p);
+  op->complete = [promise](AsyncOperation &completed) {
+    if (completed.ec) {
+      SetError(*promise, "async_queue::file_size", completed.ec, completed.p1);
+    } else {
+      promise->set_value(completed.size);
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::last_write_time(const path &p, time_callback done) {
+  auto op = MakeOperation(OperationKind::LAST_WRITE_TIME, p);
+  op->complete = [done](AsyncOperation &completed) {
+    done(completed.write_time, completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::last_write_time(const path &p)
+    -> std::future<file_time_type> {
+  auto promise = std::make_shared<std::promise<file_time_type>>();
+  auto op = MakeOperation(OperationKind::LAST_WRITE_TIME, p);
+  op->complete = [promise](AsyncOperation &completed) {
+    if (completed.ec) {
+      SetError(*promise, "async_queue::last_write_time", completed.ec,
+               completed.p1);
+    } else {
+      promise->set_value(completed.write_time);
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::create_directory(const path &p, bool_callback done) {
+  auto op = MakeOperation(OperationKind::CREATE_DIRECTORY, p);
+  op->complete = [done](AsyncOperation &completed) {
+    done(completed.result, completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::create_directory(const path &p) -> std::future<bool> {
+  auto promise = std::make_shared<std::promise<bool>>();
+  auto op = MakeOperation(OperationKind::CREATE_DIRECTORY, p);
+  op->complete = [promise](AsyncOperation &completed) {
+    if (completed.ec) {
+      SetError(*promise, "async_queue::create_directory", completed.ec,
+               completed.p1);
+    } else {
+      promise->set_value(completed.result);
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::remove(const path &p, bool_callback done) {
+  auto op = MakeOperation(OperationKind::REMOVE, p);
+  op->complete = [done](AsyncOperation &completed) {
+    done(completed.result, completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::remove(const path &p) -> std::future<bool> {
+  auto promise = std::make_shared<std::promise<bool>>();
+  auto op = MakeOperation(OperationKind::REMOVE, p);
+  op->complete = [promise](AsyncOperation &completed) {
+    if (completed.ec) {
+      SetError(*promise, "async_queue::remove", completed.ec, completed.p1);
+    } else {
+      promise->set_value(completed.result);
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::rename(const path &from, const path &to,
+                         void_callback done) {
+  auto op = MakeOperation(OperationKind::RENAME, from, to);
+  op->complete = [done](AsyncOperation &completed) {
+    done(completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::rename(const path &from, const path &to)
+    -> std::future<void> {
+  auto promise = std::make_shared<std::promise<void>>();
+  auto op = MakeOperation(OperationKind::RENAME, from, to);
+  op->complete = [promise](AsyncOperation &completed) {
+    if (completed.ec) {
+      SetError(*promise, "async_queue::rename", completed.ec, completed.p1,
+               &completed.p2);
+    } else {
+      promise->set_value();
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::open(const path &p, open_flags flags,
+                       handle_callback done) {
+  auto op = MakeOperation(OperationKind::OPEN, p);
+  op->flags = flags;
+  op->complete = [done](AsyncOperation &completed) {
+    done(std::move(completed.handle), completed.ec);
+  };
+  impl_->Submit(std::move(op));
+}
+
+auto async_queue::open(const path &p, open_flags flags)
+    -> std::future<file_handle> {
+  auto promise = std::make_shared<std::promise<file_handle>>();
+  auto op = MakeOperation(OperationKind::OPEN, p);
+  op->flags = flags;
+  op->complete = [promise](AsyncOperation &completed) {
+    if (completed.ec) {
+      SetError(*promise, "async_queue::open", completed.ec, completed.p1);
+    } else {
+      promise->set_value(std::move(completed.handle));
+    }
+  };
+  impl_->Submit(std::move(op));
+  return promise->get_future();
+}
+
+void async_queue::wait() { impl_->Wait(); }
+
+auto async_queue::uses_io_uring() const noexcept -> bool {
+  return impl_->UsesIoUring();
+}
+
+// -----------------------------------------------------------------------------
+//                          async_directory_reader
+// -----------------------------------------------------------------------------
+
+namespace {
+// Reading a directory mostly waits on the file system, so the reads get their
+// own threads instead of occupying the workers of the library's thread pool.
+// A few of them keep one slow mount from holding up the other directories.
+constexpr std::size_t IO_THREADS = 4;
+
+auto IoPool() -> detail::ThreadPool & {
+  static detail::ThreadPool pool(IO_THREADS);
+  return pool;
+}
+}  // namespace
+
+constexpr std::size_t async_directory_reader::batch_size;
+
+// Shared with the pending read, which may outlive the reader.
+struct async_directory_reader::State {
+  State(const filesystem::path &p, directory_options opts,
+        parallel_policy::executor_type exec)
+      : path(p), options(opts), executor(std::move(exec)) {}
+
+  void Read(std::vector<directory_entry> &entries, std::error_code &ec);
+
+  // Only used by the pending read, and never by two reads at the same time
+  filesystem::path path;
+  directory_options options;
+  directory_iterator iter;
+  bool opened{false};
+
+  parallel_policy::executor_type executor;
+
+  std::mutex mutex;
+  bool pending{false};
+  bool cancelled{false};
+  // The thread calling `done`, if any
+  std::thread::id delivering;
+
+  // Held while `done` is called, so that the reader is not destroyed under it
+  std::mutex delivery;
+};
+
+// Reads the next batch of entries from the I/O thread.
+void async_directory_reader::State::Read(std::vector<directory_entry> &entries,
+                                         std::error_code &ec) {
+  if (!opened) {
+    opened = true;
+    iter = directory_iterator(path, options, ec);
+    if (ec) {
+      return;
+    }
+  }
+  const directory_iterator end;
+  while (iter != end && entries.size() < batch_size) {
+    entries.push_back(*iter);
+    iter.increment(ec);
+    if (ec) {
+      // Stop here for good, the entries read so far are lost
+      iter = end;
+      entries.clear();
+      return;
+    }
+  }
+}
+
+async_directory_reader::async_directory_reader(
+    const filesystem::path &p, directory_options options,
+    parallel_policy::executor_type executor)
+    : path_(p),
+      state_(std::make_shared<State>(p, options, std::move(executor))) {}
+
+async_directory_reader::~async_directory_reader() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->cancelled = true;
+    // Destroyed by `done` itself, which is not waited for then
+    if (state_->delivering == std::this_thread::get_id()) {
+      return;
+    }
+  }
+  // Waits for `done` to return, if it is being called
+  std::lock_guard<std::mutex> lock(state_->delivery);
+}
+
+void async_directory_reader::next(batch_callback done) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    ASAP_ASSERT(!state_->pending &&
+                "only one read can be pending on an async_directory_reader");
+    state_->pending = true;
+  }
+  auto state = state_;
+  IoPool().Submit([state, done]() {
+    std::vector<directory_entry> entries;
+    std::error_code ec;
+    state->Read(entries, ec);
+
+    auto deliver = [state, done, entries = std::move(entries), ec]() mutable {
+      std::lock_guard<std::mutex> delivery(state->delivery);
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->pending = false;
+        if (state->cancelled) {
+          return;
+        }
+        state->delivering = std::this_thread::get_id();
+      }
+      done(std::move(entries), ec);
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->delivering = std::thread::id();
+    };
+    if (state->executor) {
+      state->executor(std::move(deliver));
+    } else {
+      deliver();
+    }
+  });
+}
+
+}  // namespace filesystem
+}  // namespace asap
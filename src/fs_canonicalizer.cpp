@@ -0,0 +1,287 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <filesystem/filesystem.h>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "fs_error.h"
+#include "fs_portability.h"
+#include "fs_thread_pool.h"
+
+namespace asap {
+namespace filesystem {
+
+using detail::ErrorHandler;
+
+namespace {
+
+// -----------------------------------------------------------------------------
+//                          detail: path resolution
+// -----------------------------------------------------------------------------
+
+// Paths are handed out in chunks of this many to the tasks of a parallel
+// canonical_many().
+constexpr std::size_t PATHS_PER_TASK = 64;
+
+// Spreads the directories over several independently locked maps, so that the
+// tasks of a parallel canonical_many() rarely wait for each other.
+constexpr std::size_t SHARDS = 16;
+
+#if defined(ASAP_POSIX)
+// The same limit as the kernel when it resolves a path.
+constexpr int MAX_SYMLINKS = 40;
+
+auto Join(const path::string_type &dir, const path::string_type &name)
+    -> path::string_type {
+  path::string_type joined;
+  joined.reserve(dir.size() + 1 + name.size());
+  joined.append(dir);
+  if (dir.size() != 1) {
+    joined.push_back('/');
+  }
+  joined.append(name);
+  return joined;
+}
+
+// `dir` is canonical, so its parent is found by removing its last component.
+auto Parent(const path::string_type &dir) -> path::string_type {
+  const auto pos = dir.rfind('/');
+  return pos == 0 || pos == path::string_type::npos ? dir.substr(0, 1)
+                                                    : dir.substr(0, pos);
+}
+
+auto ReadLink(const path::string_type &p, path::string_type &target)
+    -> std::error_code {
+  char buff[PATH_MAX + 1];
+  ::ssize_t size = detail::posix_port::readlink(p.c_str(), buff, PATH_MAX);
+  if (size == -1) {
+    return detail::capture_errno();
+  }
+  if (size == 0) {
+    return std::make_error_code(std::errc::no_such_file_or_directory);
+  }
+  if (size == PATH_MAX) {
+    return std::make_error_code(std::errc::filename_too_long);
+  }
+  target.assign(buff, static_cast<std::size_t>(size));
+  return {};
+}
+#endif  // ASAP_POSIX
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+//                              canonicalizer
+// -----------------------------------------------------------------------------
+
+class canonicalizer::Impl {
+ public:
+  // Uses fewer shards than directories, so that at most `max_directories` are
+  // remembered in all.
+  explicit Impl(std::size_t max_directories)
+      : shard_count_(std::max<std::size_t>(
+            1, std::min(SHARDS, max_directories))),
+        shard_capacity_(std::max<std::size_t>(1, max_directories) /
+                        shard_count_) {}
+
+#if defined(ASAP_POSIX)
+  // Resolves the absolute path `p` component by component, starting from the
+  // root, like realpath() does. The directories are looked up in the memo
+  // first, and added to it once resolved.
+  auto Resolve(const path &p, std::error_code &ec) -> path::string_type {
+    std::deque<path::string_type> components;
+    for (const auto &part : p.relative_path()) {
+      components.push_back(part.native());
+    }
+
+    // The symlinks being followed, with the number of components left once
+    // their target is resolved.
+    struct Link {
+      path::string_type name;
+      std::size_t remaining;
+    };
+    std::vector<Link> links;
+    int followed = 0;
+
+    path::string_type current(1, '/');
+    bool is_directory = true;
+    while (true) {
+      // Where the symlinks whose target was just resolved lead
+      while (!links.empty() && components.size() <= links.back().remaining) {
+        if (is_directory) {
+          Store(links.back().name, current);
+        }
+        links.pop_back();
+      }
+      if (components.empty()) {
+        break;
+      }
+      if (!is_directory) {
+        ec = std::make_error_code(std::errc::not_a_directory);
+        return {};
+      }
+
+      auto name = std::move(components.front());
+      components.pop_front();
+      if (name.empty() || name == ".") {
+        continue;
+      }
+      if (name == "..") {
+        current = Parent(current);
+        continue;
+      }
+
+      auto candidate = Join(current, name);
+      if (Lookup(candidate, current)) {
+        continue;
+      }
+      detail::posix_port::StatT st{};
+      if (detail::posix_port::lstat(candidate.c_str(), &st) == -1) {
+        ec = detail::capture_errno();
+        return {};
+      }
+      if (S_ISLNK(st.st_mode)) {
+        if (++followed > MAX_SYMLINKS) {
+          ec = std::make_error_code(std::errc::too_many_symbolic_link_levels);
+          return {};
+        }
+        path::string_type target;
+        ec = ReadLink(candidate, target);
+        if (ec) {
+          return {};
+        }
+        links.push_back({std::move(candidate), components.size()});
+        const path target_path(std::move(target));
+        std::vector<path::string_type> parts;
+        for (const auto &part : target_path.relative_path()) {
+          parts.push_back(part.native());
+        }
+        components.insert(components.begin(), parts.begin(), parts.end());
+        if (target_path.is_absolute()) {
+          current.assign(1, '/');
+        }
+        continue;
+      }
+      is_directory = S_ISDIR(st.st_mode);
+      if (is_directory) {
+        Store(candidate, candidate);
+      }
+      current = std::move(candidate);
+    }
+    return current;
+  }
+#endif  // ASAP_POSIX
+
+  void Clear() {
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.directories.clear();
+    }
+  }
+
+  auto Size() const -> std::size_t {
+    std::size_t size = 0;
+    for (const auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      size += shard.directories.size();
+    }
+    return size;
+  }
+
+ private:
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<path::string_type, path::string_type> directories;
+  };
+
+  // Gets where the directory `name` leads, with its parent already canonical.
+  auto Lookup(const path::string_type &name, path::string_type &resolved)
+      -> bool {
+    auto &shard = ShardOf(name);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.directories.find(name);
+    if (found == shard.directories.end()) {
+      return false;
+    }
+    resolved = found->second;
+    return true;
+  }
+
+  void Store(const path::string_type &name, const path::string_type &resolved) {
+    auto &shard = ShardOf(name);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.directories.size() >= shard_capacity_) {
+      shard.directories.clear();
+    }
+    shard.directories[name] = resolved;
+  }
+
+  auto ShardOf(const path::string_type &name) -> Shard & {
+    return shards_[std::hash<path::string_type>()(name) % shard_count_];
+  }
+
+  const std::size_t shard_count_;
+  const std::size_t shard_capacity_;
+  std::array<Shard, SHARDS> shards_;
+};
+
+canonicalizer::canonicalizer(std::size_t max_directories)
+    : impl_(new Impl(max_directories)) {}
+
+canonicalizer::~canonicalizer() = default;
+
+void canonicalizer::clear() { impl_->Clear(); }
+
+auto canonicalizer::size() const -> std::size_t { return impl_->Size(); }
+
+auto canonicalizer::do_canonical(const path &p, std::error_code *ec) -> path {
+#if defined(ASAP_POSIX)
+  ErrorHandler<path> err("canonical", ec, &p);
+  std::error_code m_ec;
+  const auto absolute = absolute_impl(p, &m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  auto resolved = impl_->Resolve(absolute, m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  return path(std::move(resolved));
+#else
+  return canonical_impl(p, ec);
+#endif
+}
+
+void canonicalizer::do_canonical_many(const path *paths, std::size_t count,
+                                      canonical_result *results,
+                                      const parallel_policy *policy) {
+  const auto resolve = [this, paths, results](std::size_t first,
+                                              std::size_t last) {
+    for (auto index = first; index < last; ++index) {
+      results[index].path = do_canonical(paths[index], &results[index].ec);
+    }
+  };
+  if (policy == nullptr) {
+    resolve(0, count);
+    return;
+  }
+  detail::TaskGroup tasks(*policy);
+  for (std::size_t first = 0; first < count; first += PATHS_PER_TASK) {
+    tasks.Run([&resolve, first, count]() {
+      resolve(first, std::min(first + PATHS_PER_TASK, count));
+    });
+  }
+  tasks.Wait();
+}
+
+}  // namespace filesystem
+}  // namespace asap
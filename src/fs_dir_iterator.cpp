@@ -6,10 +6,18 @@
 #include <filesystem/filesystem.h>
 #include <hedley/hedley.h>
 
-#include <stack>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "fs_error.h"
 #include "fs_portability.h"
+#include "fs_thread_pool.h"
 
 namespace asap {
 namespace filesystem {
@@ -20,11 +28,11 @@ using detail::ErrorHandler;
 //                           directory entry definitions
 // -----------------------------------------------------------------------------
 
+#if defined(ASAP_WINDOWS)
 void directory_entry::UpdateBasicFileInformation(bool follow_symlinks,
                                                  std::error_code *ec) const {
   ErrorHandler<void> err("UpdateBasicFileInformation", ec, &path_);
 
-#if defined(ASAP_WINDOWS)
   auto wpath = path_.wstring();
   DWORD attr(detail::win32_port::GetFileAttributesW(wpath.c_str()));
   if (attr == INVALID_FILE_ATTRIBUTES) {
@@ -99,52 +107,12 @@ void directory_entry::UpdateBasicFileInformation(bool follow_symlinks,
   }
 
   cached_data_.cache_type = CacheType_::BASIC;
-#else   // !ASAP_WINDOWS
-  std::error_code m_ec;
-  detail::posix_port::StatT full_st;
-  file_status st = detail::posix_port::GetFileStatus(path_, full_st, &m_ec);
-
-  if (cached_data_.cache_type == CacheType_::EMPTY) {
-    if (m_ec || !status_known(st)) {
-      return err.report(m_ec);
-    }
-    cached_data_.symlink = filesystem::is_symlink(st);
-    cached_data_.type = st.type();
-    if (cached_data_.symlink) {
-      cached_data_.nlink = static_cast<uintmax_t>(full_st.st_nlink);
-      cached_data_.symlink_perms = st.permissions();
-    }
-  }
-
-  if ((cached_data_.symlink) && follow_symlinks) {
-    cached_data_.type = st.type();
-    cached_data_.non_symlink_perms = st.permissions();
-    cached_data_.type_resolved = true;
-    cached_data_.extra_resolved = true;
-    cached_data_.perms_resolved = true;
-  }
-
-  if (asap::filesystem::is_regular_file(st)) {
-    cached_data_.size = static_cast<uintmax_t>(full_st.st_size);
-  }
-
-  if (asap::filesystem::exists(st)) {
-    // Attempt to extract the mtime, and fail if it's not representable using
-    // file_time_type. For now we ignore the error, as we'll report it when
-    // the value is actually used.
-    std::error_code ignored_ec;
-    cached_data_.write_time =
-        detail::posix_port::ExtractLastWriteTime(path_, full_st, &ignored_ec);
-  }
-  cached_data_.cache_type = CacheType_::FULL;
-#endif  // ASAP_WINDOWS
 }
 
 void directory_entry::UpdateExtraFileInformation(bool follow_symlinks,
                                                  std::error_code *ec) const {
   ErrorHandler<void> err("UpdateExtraFileInformation", ec, &path_);
 
-#if defined(ASAP_WINDOWS)
   ASAP_ASSERT((cached_data_.cache_type == CacheType_::BASIC) ||
               (cached_data_.cache_type == CacheType_::EXTRA));
   // Open the file handle without following symlinks to get the number of hard
@@ -205,12 +173,6 @@ void directory_entry::UpdateExtraFileInformation(bool follow_symlinks,
 
     cached_data_.extra_resolved = true;
   }
-#else   // !ASAP_WINDOWS
-  ASAP_ASSERT(cached_data_.cache_type == CacheType_::FULL);
-  if (cached_data_.symlink && follow_symlinks && !cached_data_.extra_resolved) {
-    UpdateBasicFileInformation(true, ec);
-  }
-#endif  // ASAP_WINDOWS
 
   cached_data_.cache_type = CacheType_::EXTRA;
 }
@@ -219,7 +181,6 @@ void directory_entry::UpdatePermissionsInformation(bool follow_symlinks,
                                                    std::error_code *ec) const {
   ErrorHandler<void> err("UpdatePermissionsInformation", ec, &path_);
 
-#if defined(ASAP_WINDOWS)
   ASAP_ASSERT((cached_data_.cache_type == CacheType_::EXTRA) ||
               (cached_data_.cache_type == CacheType_::FULL));
   // Open the file handle without following symlinks
@@ -274,12 +235,6 @@ void directory_entry::UpdatePermissionsInformation(bool follow_symlinks,
     }
     cached_data_.perms_resolved = true;
   }
-#else   // !ASAP_WINDOWS
-  ASAP_ASSERT(cached_data_.cache_type == CacheType_::FULL);
-  if (cached_data_.symlink && follow_symlinks && !cached_data_.perms_resolved) {
-    UpdateBasicFileInformation(true, ec);
-  }
-#endif  // ASAP_WINDOWS
 
   cached_data_.cache_type = CacheType_::FULL;
 }  // namespace filesystem
@@ -515,14 +470,30 @@ auto directory_entry::GetSymLinkStatus(std::error_code *ec) const
   return file_status(cached_data_.type, cached_data_.symlink_perms);
 }
 
-#ifndef ASAP_WINDOWS
-auto directory_entry::DoRefresh_impl() const noexcept -> std::error_code {
-  cached_data_.Reset();
-  std::error_code failure_ec;
-  UpdateBasicFileInformation(true, &failure_ec);
-  return failure_ec;
+auto directory_entry::GetBirthTime(std::error_code *ec) const
+    -> file_time_type {
+  ErrorHandler<file_time_type> err("directory_entry::birth_time", ec, &path_);
+
+  std::error_code m_ec;
+  auto file = detail::FileDescriptor::Create(
+      &path_, m_ec, 0, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,
+      nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  FILETIME creation;
+  if (detail::win32_port::GetFileTime(file.fd_, &creation, nullptr, nullptr) ==
+      0) {
+    return err.report(detail::capture_errno());
+  }
+  auto time =
+      detail::win32_port::FileTimeTypeFromWindowsFileTime(creation, m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  return time;
 }
-#else
+
 auto directory_entry::DoRefresh_impl() const noexcept -> std::error_code {
   cached_data_.Reset();
   std::error_code failure_ec;
@@ -537,7 +508,267 @@ auto directory_entry::DoRefresh_impl() const noexcept -> std::error_code {
   UpdatePermissionsInformation(true, &failure_ec);
   return failure_ec;
 }
-#endif
+#else   // !ASAP_WINDOWS
+// Each attribute is fetched the first time it is needed, together with the
+// other ones needed at that time. Whether the entry is a symlink is always
+// found out first. When it is not, everything comes from that single call.
+// Otherwise the attributes of the target need another one, following the
+// symlink.
+void directory_entry::Resolve(unsigned attributes, std::error_code &ec) const {
+  using detail::posix_port::FileStat;
+  using detail::posix_port::StatField;
+
+  ec.clear();
+  auto &data = cached_data_;
+  auto needed = attributes & ~data.resolved;
+  if (needed == 0) {
+    return;
+  }
+
+  const auto stat_fields = [](unsigned attrs) {
+    unsigned fields = 0;
+    if ((attrs & ATTR_NLINK) != 0) {
+      fields |= StatField::STAT_NLINK;
+    }
+    if ((attrs & ATTR_SIZE) != 0) {
+      fields |= StatField::STAT_SIZE;
+    }
+    if ((attrs & ATTR_WRITE_TIME) != 0) {
+      fields |= StatField::STAT_MTIME;
+    }
+    if ((attrs & ATTR_BIRTH_TIME) != 0) {
+      fields |= StatField::STAT_BTIME;
+    }
+    return fields;
+  };
+  // The attributes not returned by the file system are marked as known too,
+  // so that they are not asked for again, and are reported as unavailable.
+  const auto store_target = [this, &data](const file_status &st,
+                                          const FileStat &file_stat,
+                                          unsigned attrs) {
+    data.type = st.type();
+    data.non_symlink_perms = st.permissions();
+    if ((file_stat.fields & StatField::STAT_SIZE) != 0 &&
+        filesystem::is_regular_file(st)) {
+      data.size = static_cast<uintmax_t>(file_stat.st.st_size);
+    }
+    if ((file_stat.fields & StatField::STAT_MTIME) != 0) {
+      // Not representable times are reported when the value is used
+      std::error_code ignored_ec;
+      data.write_time = detail::posix_port::ExtractLastWriteTime(
+          path_, file_stat.st, &ignored_ec);
+    }
+    if ((file_stat.fields & StatField::STAT_BTIME) != 0) {
+      data.birth_time =
+          detail::posix_port::FileTimeTypeFromPosixTimeSpec(file_stat.birth_time);
+    }
+    data.resolved |= attrs | ATTR_TYPE | ATTR_PERMS;
+  };
+
+  // Relative to the directory being iterated when it is still open
+  const auto fetch = [this, &data, &stat_fields, &ec](bool follow_symlinks,
+                                                       unsigned attrs,
+                                                       FileStat &file_stat) {
+#if defined(ASAP_FS_USE_OPENAT)
+    if (dir_fd_ != -1) {
+      return detail::posix_port::GetFileStatAt(
+          dir_fd_, path_.c_str() + name_pos_, path_, follow_symlinks,
+          stat_fields(attrs), data.dont_sync, file_stat, &ec);
+    }
+#endif  // ASAP_FS_USE_OPENAT
+    return detail::posix_port::GetFileStat(path_, follow_symlinks,
+                                           stat_fields(attrs), data.dont_sync,
+                                           file_stat, &ec);
+  };
+
+  const unsigned link_attributes =
+      ATTR_LINK_TYPE | ATTR_LINK_PERMS | ATTR_NLINK;
+  FileStat file_stat;
+  if ((data.resolved & ATTR_LINK_TYPE) == 0 ||
+      (needed & link_attributes) != 0 || !data.symlink) {
+    const auto st = fetch(false, needed, file_stat);
+    if (ec) {
+      return;
+    }
+    data.symlink = filesystem::is_symlink(st);
+    data.symlink_perms = st.permissions();
+    if ((file_stat.fields & StatField::STAT_NLINK) != 0) {
+      data.nlink = static_cast<uintmax_t>(file_stat.st.st_nlink);
+    }
+    data.resolved |= needed & link_attributes;
+    data.resolved |= ATTR_LINK_TYPE | ATTR_LINK_PERMS;
+    if (!data.symlink) {
+      store_target(st, file_stat, needed);
+      return;
+    }
+    needed &= ~link_attributes;
+    if (needed == 0) {
+      return;
+    }
+  }
+
+  const auto st = fetch(true, needed, file_stat);
+  if (ec) {
+    if (IsDoesNotExistError(ec)) {
+      // A dangling symlink
+      ec.clear();
+      data.type = file_type::not_found;
+      data.resolved |= needed;
+    }
+    return;
+  }
+  store_target(st, file_stat, needed);
+}
+
+auto directory_entry::GetSymLinkFileType(std::error_code *ec) const
+    -> file_type {
+  if (ec != nullptr) {
+    ec->clear();
+  }
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE, m_ec);
+  if (m_ec) {
+    HandleError("in directory_entry::GetSymLinkFileType", ec, m_ec);
+    return file_type::none;
+  }
+  if (cached_data_.symlink) {
+    return file_type::symlink;
+  }
+  if (!asap::filesystem::exists(file_status(cached_data_.type))) {
+    HandleError("in directory_entry::GetSymLinkFileType", ec,
+                make_error_code(std::errc::no_such_file_or_directory));
+  }
+  return cached_data_.type;
+}
+
+auto directory_entry::GetFileType(std::error_code *ec) const -> file_type {
+  if (ec != nullptr) {
+    ec->clear();
+  }
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_TYPE, m_ec);
+  if (m_ec) {
+    HandleError("in directory_entry::GetFileType", ec, m_ec);
+    return file_type::none;
+  }
+  if (!asap::filesystem::exists(file_status(cached_data_.type))) {
+    HandleError("in directory_entry::GetFileType", ec,
+                make_error_code(std::errc::no_such_file_or_directory));
+  }
+  return cached_data_.type;
+}
+
+auto directory_entry::GetSize(std::error_code *ec) const -> uintmax_t {
+  ErrorHandler<uintmax_t> err("directory_entry::file_size", ec, &path_);
+
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_TYPE | ATTR_SIZE, m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  // Check that the entry type supports querying the size
+  file_status st(cached_data_.type);
+  if (!asap::filesystem::exists(st)) {
+    return err.report(std::errc::no_such_file_or_directory);
+  }
+  if (!asap::filesystem::is_regular_file(st)) {
+    std::errc err_kind = asap::filesystem::is_directory(st)
+                             ? std::errc::is_a_directory
+                             : std::errc::not_supported;
+    return err.report(err_kind,
+                      "can only query size of regular files that do exist");
+  }
+  return cached_data_.size;
+}
+
+auto directory_entry::GetHardLinkCount(std::error_code *ec) const -> uintmax_t {
+  ErrorHandler<uintmax_t> err("directory_entry::hard_link_count", ec, &path_);
+
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_NLINK, m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  return cached_data_.nlink;
+}
+
+auto directory_entry::GetLastWriteTime(std::error_code *ec) const
+    -> file_time_type {
+  ErrorHandler<file_time_type> err("directory_entry::last_write_time", ec,
+                                   &path_);
+
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_TYPE | ATTR_WRITE_TIME, m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  if (!asap::filesystem::exists(file_status(cached_data_.type))) {
+    return err.report(std::errc::no_such_file_or_directory);
+  }
+  if (cached_data_.write_time == file_time_type::min()) {
+    return err.report(std::errc::value_too_large);
+  }
+  return cached_data_.write_time;
+}
+
+auto directory_entry::GetBirthTime(std::error_code *ec) const
+    -> file_time_type {
+  ErrorHandler<file_time_type> err("directory_entry::birth_time", ec, &path_);
+
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_TYPE | ATTR_BIRTH_TIME, m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  if (!asap::filesystem::exists(file_status(cached_data_.type))) {
+    return err.report(std::errc::no_such_file_or_directory);
+  }
+  if (cached_data_.birth_time == file_time_type::min()) {
+    return err.report(std::errc::not_supported,
+                      "the file system does not report the creation time");
+  }
+  return cached_data_.birth_time;
+}
+
+auto directory_entry::GetStatus(std::error_code *ec) const -> file_status {
+  if (ec != nullptr) {
+    ec->clear();
+  }
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_TYPE | ATTR_PERMS, m_ec);
+  if (m_ec) {
+    HandleError("in directory_entry::status", ec, m_ec, /*allow_dne*/ true);
+    return file_status(IsDoesNotExistError(m_ec) ? file_type::not_found
+                                                 : file_type::none);
+  }
+  return file_status(cached_data_.type, cached_data_.non_symlink_perms);
+}
+
+auto directory_entry::GetSymLinkStatus(std::error_code *ec) const
+    -> file_status {
+  if (ec != nullptr) {
+    ec->clear();
+  }
+  std::error_code m_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_LINK_PERMS, m_ec);
+  if (m_ec) {
+    HandleError("in directory_entry::symlink_status", ec, m_ec,
+                /*allow_dne*/ true);
+    return file_status(IsDoesNotExistError(m_ec) ? file_type::not_found
+                                                 : file_type::none);
+  }
+  return file_status(
+      cached_data_.symlink ? file_type::symlink : cached_data_.type,
+      cached_data_.symlink_perms);
+}
+
+auto directory_entry::DoRefresh_impl() const noexcept -> std::error_code {
+  cached_data_.Reset();
+  std::error_code failure_ec;
+  Resolve(ATTR_LINK_TYPE | ATTR_TYPE, failure_ec);
+  return failure_ec;
+}
+#endif  // ASAP_WINDOWS
 
 namespace detail {
 namespace {
@@ -571,19 +802,239 @@ auto get_file_type(DirEntT *ent) -> file_type {
   return file_type::none;
 }
 
-auto posix_readdir(DIR *dir_stream, std::error_code &ec)
-    -> std::pair<std::string, file_type> {
-  struct dirent *dir_entry_ptr = nullptr;
-  errno = 0;  // zero errno in order to detect errors
-  ec.clear();
-  if ((dir_entry_ptr = posix_port::readdir(dir_stream)) == nullptr) {
-    if (errno) {
-      ec = detail::capture_errno();
+auto IsDotOrDotDot(const char *name) -> bool {
+  return name[0] == '.' &&
+         (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+#if defined(ASAP_FS_USE_GETDENTS64)
+// The layout of the records returned by the getdents64 system call, which is
+// not declared by all C libraries. The name is null terminated and the record
+// is padded to `d_reclen` bytes.
+struct LinuxDirent64 {
+  std::uint64_t d_ino;
+  std::int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+
+/*!
+@brief Reads the entries of a directory in batches, with as few system calls
+and allocations as possible.
+
+The entries are read with getdents64 into a buffer big enough for hundreds of
+entries, and handed out directly from that buffer until it is exhausted. The
+name of the current entry is only valid until the next call to Next(). The
+buffer of a closed reader is kept for the next reader opened on the same
+thread, so that walking a tree does not allocate one per directory.
+*/
+class DirectoryReader {
+ public:
+  DirectoryReader() = default;
+  DirectoryReader(const DirectoryReader &) = delete;
+  auto operator=(const DirectoryReader &) -> DirectoryReader & = delete;
+  DirectoryReader(DirectoryReader &&other) noexcept
+      : fd_(other.fd_),
+        buffer_(std::move(other.buffer_)),
+        size_(other.size_),
+        offset_(other.offset_),
+        current_(other.current_) {
+    other.fd_ = -1;
+  }
+  ~DirectoryReader() { Close(); }
+
+  auto Open(const path &dir, std::error_code &ec) -> bool {
+    fd_ = posix_port::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd_ == -1) {
+      ec = capture_errno();
+      return false;
+    }
+    AcquireBuffer();
+    return true;
+  }
+
+#if defined(ASAP_FS_USE_OPENAT)
+  // Open the directory `name` relative to the open directory `parent_fd`.
+  auto OpenAt(int parent_fd, const char *name, bool follow_symlink,
+              std::error_code &ec) -> bool {
+    fd_ = posix_port::openat(
+        parent_fd, name,
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC | (follow_symlink ? 0 : O_NOFOLLOW));
+    if (fd_ == -1) {
+      ec = capture_errno();
+      return false;
     }
-    return {};
+    AcquireBuffer();
+    return true;
   }
-  return {dir_entry_ptr->d_name, get_file_type(dir_entry_ptr)};
-}
+#endif  // ASAP_FS_USE_OPENAT
+
+  auto IsOpen() const noexcept -> bool { return fd_ != -1; }
+  auto Fd() const noexcept -> int { return fd_; }
+
+  // Move to the next entry other than "." and "..". Returns false at the end
+  // of the directory, and sets `ec` on failure.
+  auto Next(std::error_code &ec) -> bool {
+    for (;;) {
+      if (offset_ >= size_ && !Fill(ec)) {
+        return false;
+      }
+      current_ = offset_;
+      offset_ += Current()->d_reclen;
+      if (!IsDotOrDotDot(Current()->d_name)) {
+        return true;
+      }
+    }
+  }
+
+  auto Name() const -> const char * { return Current()->d_name; }
+  auto Type() const -> file_type { return get_file_type(Current()); }
+
+  auto Close() noexcept -> std::error_code {
+    std::error_code ec;
+    if (fd_ == -1) {
+      return ec;
+    }
+    if (posix_port::close(fd_) == -1) {
+      ec = capture_errno();
+    }
+    fd_ = -1;
+    size_ = offset_ = current_ = 0;
+    if (!SpareBuffer()) {
+      SpareBuffer() = std::move(buffer_);
+    }
+    buffer_.reset();
+    return ec;
+  }
+
+ private:
+  // Big enough to hold the entries of most directories in one go, small enough
+  // to not be a burden when recursing in deep trees.
+  static constexpr std::size_t BUFFER_SIZE = 32 * 1024;
+
+  static auto SpareBuffer() -> std::unique_ptr<char[]> & {
+    static thread_local std::unique_ptr<char[]> buffer;
+    return buffer;
+  }
+
+  void AcquireBuffer() {
+    buffer_ = std::move(SpareBuffer());
+    if (!buffer_) {
+      buffer_.reset(new char[BUFFER_SIZE]);
+    }
+  }
+
+  auto Fill(std::error_code &ec) -> bool {
+    long size = 0;
+    do {
+      size = linux_port::syscall(SYS_getdents64, fd_, buffer_.get(),
+                                 BUFFER_SIZE);
+    } while (size == -1 && errno == EINTR);
+    if (size == -1) {
+      ec = capture_errno();
+      return false;
+    }
+    size_ = static_cast<std::size_t>(size);
+    offset_ = 0;
+    return size_ != 0;
+  }
+
+  auto Current() const -> const LinuxDirent64 * {
+    return reinterpret_cast<const LinuxDirent64 *>(buffer_.get() + current_);
+  }
+
+  int fd_{-1};
+  std::unique_ptr<char[]> buffer_;
+  std::size_t size_{0};
+  std::size_t offset_{0};
+  std::size_t current_{0};
+};
+#else
+/*!
+@brief Reads the entries of a directory with readdir().
+
+The name of the current entry is only valid until the next call to Next().
+*/
+class DirectoryReader {
+ public:
+  DirectoryReader() = default;
+  DirectoryReader(const DirectoryReader &) = delete;
+  auto operator=(const DirectoryReader &) -> DirectoryReader & = delete;
+  DirectoryReader(DirectoryReader &&other) noexcept
+      : stream_(other.stream_), entry_(other.entry_) {
+    other.stream_ = nullptr;
+  }
+  ~DirectoryReader() { Close(); }
+
+  auto Open(const path &dir, std::error_code &ec) -> bool {
+    if ((stream_ = ::opendir(dir.c_str())) == nullptr) {
+      ec = capture_errno();
+      return false;
+    }
+    return true;
+  }
+
+#if defined(ASAP_FS_USE_OPENAT)
+  // Open the directory `name` relative to the open directory `parent_fd`.
+  auto OpenAt(int parent_fd, const char *name, bool follow_symlink,
+              std::error_code &ec) -> bool {
+    const int fd = posix_port::openat(
+        parent_fd, name,
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC | (follow_symlink ? 0 : O_NOFOLLOW));
+    if (fd == -1) {
+      ec = capture_errno();
+      return false;
+    }
+    if ((stream_ = posix_port::fdopendir(fd)) == nullptr) {
+      ec = capture_errno();
+      posix_port::close(fd);
+      return false;
+    }
+    return true;
+  }
+
+  auto Fd() const noexcept -> int { return posix_port::dirfd(stream_); }
+#endif  // ASAP_FS_USE_OPENAT
+
+  auto IsOpen() const noexcept -> bool { return stream_ != nullptr; }
+
+  // Move to the next entry other than "." and "..". Returns false at the end
+  // of the directory, and sets `ec` on failure.
+  auto Next(std::error_code &ec) -> bool {
+    do {
+      errno = 0;  // zero errno in order to detect errors
+      if ((entry_ = posix_port::readdir(stream_)) == nullptr) {
+        if (errno != 0) {
+          ec = capture_errno();
+        }
+        return false;
+      }
+    } while (IsDotOrDotDot(entry_->d_name));
+    return true;
+  }
+
+  auto Name() const -> const char * { return entry_->d_name; }
+  auto Type() const -> file_type { return get_file_type(entry_); }
+
+  auto Close() noexcept -> std::error_code {
+    std::error_code ec;
+    if (stream_ == nullptr) {
+      return ec;
+    }
+    if (::closedir(stream_) == -1) {
+      ec = capture_errno();
+    }
+    stream_ = nullptr;
+    entry_ = nullptr;
+    return ec;
+  }
+
+ private:
+  DIR *stream_{nullptr};
+  struct dirent *entry_{nullptr};
+};
+#endif  // ASAP_FS_USE_GETDENTS64
 #else
 
 auto get_file_type(const WIN32_FIND_DATAW &data) -> file_type {
@@ -762,67 +1213,163 @@ class DirectoryStream {
   auto operator=(const DirectoryStream &) -> DirectoryStream & = delete;
 
   DirectoryStream(DirectoryStream &&other) noexcept
-      : stream_(other.stream_),
+      : reader_(std::move(other.reader_)),
+        prefix_size_(other.prefix_size_),
+        detached_(other.detached_),
+        detached_names_(std::move(other.detached_names_)),
+        detached_types_(std::move(other.detached_types_)),
+        detached_next_(other.detached_next_),
+        detached_offset_(other.detached_offset_),
+        detached_ec_(other.detached_ec_),
         root_(std::move(other.root_)),
-        entry_(std::move(other.entry_)) {
-    other.stream_ = nullptr;
-  }
+        entry_(std::move(other.entry_)) {}
 
   DirectoryStream(const path &root, directory_options opts, std::error_code &ec)
       : root_(root) {
-    if ((stream_ = ::opendir(root.c_str())) == nullptr) {
-      ec = detail::capture_errno();
-      const auto allow_eacess =
-          bool(opts & directory_options::skip_permission_denied);
-      if (allow_eacess && ec.value() == EACCES) {
-        ec.clear();
-      }
+    entry_.cached_data_.dont_sync =
+        bool(opts & directory_options::allow_stale_attributes);
+    if (!reader_.Open(root, ec)) {
+      IgnorePermissionDenied(opts, ec);
       return;
     }
     advance(ec);
   }
 
-  ~DirectoryStream() noexcept {
-    if (stream_ != nullptr) {
-      close();
+#if defined(ASAP_FS_USE_OPENAT)
+  // Open the directory of the current entry of `parent` relative to the parent
+  // directory, instead of resolving its full path again. This is cheaper in
+  // deep trees and not affected by the ancestors being renamed. Unless
+  // directory symlinks are followed, the entry is opened with O_NOFOLLOW, and
+  // an entry replaced by a symlink after its type was checked is skipped.
+  DirectoryStream(const DirectoryStream &parent, directory_options opts,
+                  std::error_code &ec)
+      : root_(parent.entry_.path()) {
+    entry_.cached_data_.dont_sync =
+        bool(opts & directory_options::allow_stale_attributes);
+    // A detached parent no longer has a descriptor to open relative to.
+    if (!parent.reader_.IsOpen()) {
+      if (!reader_.Open(root_, ec)) {
+        IgnorePermissionDenied(opts, ec);
+        return;
+      }
+      advance(ec);
+      return;
+    }
+    const auto follow_symlink =
+        bool(opts & directory_options::follow_directory_symlink);
+    if (!reader_.OpenAt(parent.reader_.Fd(), parent.reader_.Name(),
+                        follow_symlink, ec)) {
+      if (!follow_symlink && ec.value() == ELOOP) {
+        ec.clear();
+      }
+      IgnorePermissionDenied(opts, ec);
+      return;
     }
+    advance(ec);
   }
+#endif  // ASAP_FS_USE_OPENAT
+
+  ~DirectoryStream() noexcept = default;
 
-  auto good() const noexcept -> bool { return stream_ != nullptr; }
+  auto good() const noexcept -> bool { return reader_.IsOpen() || detached_; }
 
   auto advance(std::error_code &ec) -> bool {
-    while (true) {
-      auto entry_data_ = detail::posix_readdir(stream_, ec);
-      auto &str = entry_data_.first;
-      if (str == "." || str == "..") {
-        continue;
-      }
-      if (ec || str.empty()) {
-        close();
-        return false;
-      }
-      entry_.path_ = root_ / path(str);
-      entry_.cached_data_.type = entry_data_.second;
-      entry_.cached_data_.cache_type = directory_entry::CacheType_::BASIC;
-      if (entry_.cached_data_.type == file_type::symlink) {
-        entry_.cached_data_.symlink = true;
-        // FIXME: check if read_dir follows sumlinks or not
-      }
-      return true;
+    if (detached_) {
+      return AdvanceDetached(ec);
+    }
+    if (!reader_.Next(ec)) {
+      reader_.Close();
+      entry_.dir_fd_ = -1;
+      return false;
     }
+    SetEntry(reader_.Name(), reader_.Type());
+    return true;
+  }
+
+  // Read the remaining entries into memory and close the directory, so that it
+  // no longer holds a descriptor. The iteration then continues from the
+  // buffered entries. A read error is kept and reported after them.
+  void Detach() {
+    if (!reader_.IsOpen()) {
+      return;
+    }
+    while (reader_.Next(detached_ec_)) {
+      const char *name = reader_.Name();
+      detached_names_.append(name, std::strlen(name) + 1);
+      detached_types_.push_back(reader_.Type());
+    }
+    reader_.Close();
+    entry_.dir_fd_ = -1;
+    detached_ = true;
   }
 
  private:
-  auto close() noexcept -> std::error_code {
-    std::error_code m_ec;
-    if (::closedir(stream_) == -1) {
-      m_ec = detail::capture_errno();
+  auto AdvanceDetached(std::error_code &ec) -> bool {
+    if (detached_next_ == detached_types_.size()) {
+      ec = detached_ec_;
+      detached_ = false;
+      detached_names_.clear();
+      detached_types_.clear();
+      return false;
+    }
+    const char *name = detached_names_.data() + detached_offset_;
+    detached_offset_ += std::strlen(name) + 1;
+    SetEntry(name, detached_types_[detached_next_++]);
+    return true;
+  }
+
+  void SetEntry(const char *name, file_type type) {
+    SetEntryPath(name);
+#if defined(ASAP_FS_USE_OPENAT)
+    entry_.dir_fd_ = reader_.IsOpen() ? reader_.Fd() : -1;
+    entry_.name_pos_ = prefix_size_;
+#endif  // ASAP_FS_USE_OPENAT
+    auto &data = entry_.cached_data_;
+    data.Reset();
+    data.type = type;
+    data.cache_type = directory_entry::CacheType_::BASIC;
+    if (type == file_type::symlink) {
+      data.symlink = true;
+      data.resolved = directory_entry::ATTR_LINK_TYPE;
+    } else if (type != file_type::none) {
+      data.resolved =
+          directory_entry::ATTR_LINK_TYPE | directory_entry::ATTR_TYPE;
     }
-    stream_ = nullptr;
-    return m_ec;
   }
 
-  DIR *stream_{nullptr};
+  static void IgnorePermissionDenied(directory_options opts,
+                                     std::error_code &ec) {
+    const auto allow_eacess =
+        bool(opts & directory_options::skip_permission_denied);
+    if (allow_eacess && ec.value() == EACCES) {
+      ec.clear();
+    }
+  }
+
+  // The path of the first entry is built as `root_ / name`, and the following
+  // ones by only replacing the name at its end.
+  void SetEntryPath(const char *name) {
+    const auto len = std::strlen(name);
+    if (prefix_size_ != 0) {
+      entry_.path_.ReplaceTrailingFilename(prefix_size_, name, len);
+    } else {
+      entry_.path_ = root_ / path(name);
+      prefix_size_ = entry_.path_.native().size() - len;
+    }
+  }
+
+  detail::DirectoryReader reader_;
+  // The size of the part of the entry's path before the name of the entry
+  std::size_t prefix_size_{0};
+
+  // The entries left when the stream was detached, as consecutive null
+  // terminated names and their types.
+  bool detached_{false};
+  std::string detached_names_;
+  std::vector<file_type> detached_types_;
+  std::size_t detached_next_{0};
+  std::size_t detached_offset_{0};
+  std::error_code detached_ec_;
 
  public:
   path root_;
@@ -874,8 +1421,41 @@ auto directory_iterator::dereference() const -> directory_entry const & {
 
 // recursive_directory_iterator
 
+namespace {
+// Deep enough for almost any real tree to be walked without detaching a
+// directory, while keeping many concurrent iterations within RLIMIT_NOFILE.
+constexpr std::size_t DEFAULT_MAX_OPEN_DIRECTORIES = 64;
+}  // namespace
+
 struct recursive_directory_iterator::SharedImpl {
-  std::stack<DirectoryStream> dir_stack;
+  auto top() -> DirectoryStream & { return dir_stack.back(); }
+
+  void push(DirectoryStream &&stream) {
+    dir_stack.push_back(std::move(stream));
+    EnforceOpenLimit();
+  }
+
+  void pop() {
+    dir_stack.pop_back();
+    if (first_open > dir_stack.size()) {
+      first_open = dir_stack.size();
+    }
+  }
+
+  // Detach the oldest directories still open until no more than `max_open`
+  // of them are. Those are always at the bottom of the stack, below
+  // `first_open`.
+  void EnforceOpenLimit() {
+#if !defined(ASAP_WINDOWS)
+    while (dir_stack.size() - first_open > max_open) {
+      dir_stack[first_open++].Detach();
+    }
+#endif
+  }
+
+  std::deque<DirectoryStream> dir_stack;
+  std::size_t first_open{0};
+  std::size_t max_open{DEFAULT_MAX_OPEN_DIRECTORIES};
   directory_options options{directory_options::none};
 };
 
@@ -895,13 +1475,13 @@ recursive_directory_iterator::recursive_directory_iterator(
 
   impl_ = std::make_shared<SharedImpl>();
   impl_->options = opt;
-  impl_->dir_stack.push(std::move(new_s));
+  impl_->push(std::move(new_s));
 }
 
 void recursive_directory_iterator::pop_impl(std::error_code *ec) {
   ErrorHandler<void> err("directory_iterator::pop()", ec);
   if (impl_) {
-    impl_->dir_stack.pop();
+    impl_->pop();
     if (impl_->dir_stack.empty()) {
       impl_.reset();
     } else {
@@ -926,10 +1506,23 @@ auto recursive_directory_iterator::depth() const -> int {
   return static_cast<int>(impl_->dir_stack.size() - 1);
 }
 
+auto recursive_directory_iterator::max_open_directories() const
+    -> std::size_t {
+  ASAP_ASSERT(impl_ && "attempt to dereference an invalid iterator");
+  return impl_->max_open;
+}
+
+void recursive_directory_iterator::set_max_open_directories(
+    std::size_t max_open) {
+  ASAP_ASSERT(impl_ && "attempt to dereference an invalid iterator");
+  impl_->max_open = max_open == 0 ? 1 : max_open;
+  impl_->EnforceOpenLimit();
+}
+
 auto recursive_directory_iterator::dereference() const
     -> const directory_entry & {
   ASAP_ASSERT(impl_ && "attempt to dereference an invalid iterator");
-  return impl_->dir_stack.top().entry_;
+  return impl_->top().entry_;
 }
 
 auto recursive_directory_iterator::do_increment(std::error_code *ec)
@@ -954,20 +1547,19 @@ void recursive_directory_iterator::Advance(std::error_code *ec) {
   }
 
   const directory_iterator end_it;
-  auto &stack = impl_->dir_stack;
   std::error_code m_ec;
-  while (!stack.empty()) {
-    if (stack.top().advance(m_ec)) {
+  while (!impl_->dir_stack.empty()) {
+    if (impl_->top().advance(m_ec)) {
       return;
     }
     if (m_ec) {
       break;
     }
-    stack.pop();
+    impl_->pop();
   }
 
   if (m_ec) {
-    path root = std::move(stack.top().root_);
+    path root = std::move(impl_->top().root_);
     impl_.reset();
     err.report(m_ec, "at root \"{" + root.string() + "}\"");
   } else {
@@ -984,7 +1576,7 @@ auto recursive_directory_iterator::TryRecursion(std::error_code *ec) -> bool {
 
   auto rec_sym = bool(options() & directory_options::follow_directory_symlink);
 
-  auto &curr_it = impl_->dir_stack.top();
+  auto &curr_it = impl_->top();
 
   bool skip_rec = false;
   std::error_code m_ec;
@@ -1007,9 +1599,14 @@ auto recursive_directory_iterator::TryRecursion(std::error_code *ec) -> bool {
   }
 
   if (!skip_rec) {
+#if defined(ASAP_FS_USE_OPENAT)
+    DirectoryStream new_it(curr_it, impl_->options, m_ec);
+#else
     DirectoryStream new_it(curr_it.entry_.path(), impl_->options, m_ec);
+#endif
+
     if (new_it.good()) {
-      impl_->dir_stack.push(std::move(new_it));
+      impl_->push(std::move(new_it));
       return true;
     }
   }
@@ -1030,5 +1627,124 @@ auto recursive_directory_iterator::TryRecursion(std::error_code *ec) -> bool {
   return false;
 }
 
+// parallel_walk
+
+// Each directory is listed by one task, which visits its entries and schedules
+// a task for each subdirectory to walk into. The first error, or exception
+// thrown by the visitor, stops the walk.
+class ParallelWalk {
+ public:
+  ParallelWalk(directory_options options, const walk_visitor &visitor,
+               const parallel_policy &policy)
+      : options_(options), visitor_(visitor), tasks_(policy) {}
+
+  void Run(const path &root, std::error_code *ec) {
+    ErrorHandler<void> err("parallel_walk", ec, &root);
+    std::error_code m_ec;
+    {
+      DirectoryStream stream(root, options_, m_ec);
+      if (m_ec) {
+        return err.report(m_ec);
+      }
+      Walk(stream);
+    }
+    tasks_.Wait();
+    if (error_) {
+      ErrorHandler<void> walk_err("parallel_walk", ec, &root, &error_path_);
+      walk_err.report(error_);
+    }
+  }
+
+ private:
+  void Schedule(const path &dir) {
+    tasks_.Run([this, dir]() {
+      if (stopped_) {
+        return;
+      }
+      std::error_code ec;
+      DirectoryStream stream(dir, options_, ec);
+      if (ec) {
+        return Fail(dir, ec);
+      }
+      Walk(stream);
+    });
+  }
+
+  void Walk(DirectoryStream &stream) {
+    std::error_code ec;
+    while (stream.good() && !stopped_) {
+      const auto &entry = stream.entry_;
+      if (Visit(entry)) {
+        const auto walk_into = IsDirectory(entry, ec);
+        if (ec) {
+          return Fail(entry.path(), ec);
+        }
+        if (walk_into) {
+          Schedule(entry.path());
+        }
+      }
+      if (!stream.advance(ec) && ec) {
+        return Fail(stream.root_, ec);
+      }
+    }
+  }
+
+  auto Visit(const directory_entry &entry) -> bool {
+    try {
+      return visitor_(entry);
+    } catch (...) {
+      stopped_ = true;
+      throw;
+    }
+  }
+
+  // Uses the type read with the directory, and only asks the file system when
+  // it did not provide it or to follow a symlink.
+  auto IsDirectory(const directory_entry &entry, std::error_code &ec) const
+      -> bool {
+    const auto follow_symlink =
+        bool(options_ & directory_options::follow_directory_symlink);
+    const auto &data = entry.cached_data_;
+    if (data.type != file_type::none && !data.symlink) {
+      return data.type == file_type::directory;
+    }
+    if (data.symlink && !follow_symlink) {
+      return false;
+    }
+    const auto st = follow_symlink ? status(entry.path(), ec)
+                                   : symlink_status(entry.path(), ec);
+    if (ec == std::errc::no_such_file_or_directory) {
+      // A dangling symlink, or an entry removed since it was listed
+      ec.clear();
+    }
+    return is_directory(st);
+  }
+
+  void Fail(const path &p, const std::error_code &ec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+      error_ = ec;
+      error_path_ = p;
+      stopped_ = true;
+    }
+  }
+
+  const directory_options options_;
+  const walk_visitor &visitor_;
+  std::atomic<bool> stopped_{false};
+  std::mutex mutex_;
+  std::error_code error_;
+  path error_path_;
+
+  // Last, so that the tasks are done before the state they use is destroyed
+  detail::TaskGroup tasks_;
+};
+
+void parallel_walk_impl(const path &root, directory_options options,
+                        const walk_visitor &visitor,
+                        const parallel_policy &policy, std::error_code *ec) {
+  ParallelWalk(options, visitor, policy).Run(root, ec);
+}
+
 }  // namespace filesystem
 }  // namespace asap
@@ -0,0 +1,413 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <filesystem/filesystem.h>
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "fs_error.h"
+#include "fs_portability.h"
+
+namespace asap {
+namespace filesystem {
+
+using detail::ErrorHandler;
+
+namespace {
+
+// -----------------------------------------------------------------------------
+//                          detail: directory listing
+// -----------------------------------------------------------------------------
+
+auto EmptyListing() -> const directory_cache::listing & {
+  static const directory_cache::listing empty =
+      std::make_shared<const std::vector<directory_cache::entry>>();
+  return empty;
+}
+
+auto ReadListing(const path &dir, std::error_code &ec)
+    -> directory_cache::listing {
+  auto entries = std::make_shared<std::vector<directory_cache::entry>>();
+  const directory_iterator end;
+  for (directory_iterator iter(dir, ec); !ec && iter != end;
+       iter.increment(ec)) {
+    // The type comes from the directory itself when it reports it
+    std::error_code type_ec;
+    auto type = iter->symlink_status(type_ec).type();
+    if (type_ec) {
+      type = file_type::none;
+    }
+    entries->push_back({iter->path().filename(), type});
+  }
+  if (ec) {
+    return nullptr;
+  }
+  return entries;
+}
+
+// The modification time of the directory, always asked to the system: the stat
+// cache may still hold the one from before the change we are looking for.
+auto CurrentWriteTime(const path &dir, std::error_code &ec) -> file_time_type {
+#if defined(ASAP_WINDOWS)
+  return last_write_time_impl(dir, &ec);
+#else
+  detail::posix_port::StatT st{};
+  detail::posix_port::GetFileStatus(dir, st, &ec);
+  if (ec) {
+    return file_time_type::min();
+  }
+  return detail::posix_port::ExtractLastWriteTime(dir, st, &ec);
+#endif
+}
+
+// How far apart two modifications must be for the modification time of a
+// directory to tell them apart. FAT counts in 2 seconds, and the other file
+// systems in 1 second at worst.
+constexpr auto WRITE_TIME_GRANULARITY = std::chrono::seconds(2);
+
+// Whether the listing read after getting `write_time` can be checked against
+// the modification time later on. It cannot when the directory was modified
+// while being read, or so recently that a change made right after the read
+// could leave the modification time as it is, in which case the listing is
+// not kept.
+auto IsSettled(const path &dir, file_time_type write_time) -> bool {
+  std::error_code ec;
+  return CurrentWriteTime(dir, ec) == write_time && !ec &&
+         file_time_type::clock::now() - write_time >= WRITE_TIME_GRANULARITY;
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+//                           directory_cache::Impl
+// -----------------------------------------------------------------------------
+
+class directory_cache::Impl {
+ public:
+  Impl(std::size_t max_directories, bool allow_notifications)
+      : max_(max_directories) {
+#if defined(ASAP_FS_USE_INOTIFY)
+    if (allow_notifications) {
+      notify_fd_ =
+          detail::linux_port::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+#else
+    (void)allow_notifications;
+#endif
+  }
+
+  Impl(const Impl &) = delete;
+  auto operator=(const Impl &) -> Impl & = delete;
+
+  ~Impl() {
+#if defined(ASAP_FS_USE_INOTIFY)
+    if (notify_fd_ != -1) {
+      // Removes all the watches with it
+      detail::posix_port::close(notify_fd_);
+    }
+#endif
+  }
+
+  auto List(const path &dir, std::error_code &ec) -> listing {
+    const auto &key = dir.native();
+    std::unique_lock<std::mutex> lock(mutex_);
+    ReadEvents();
+
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      auto &cached = *found->second;
+      lru_.splice(lru_.begin(), lru_, found->second);
+      if (cached.watch != NO_WATCH) {
+        return cached.entries;
+      }
+      // Still valid if the directory was not modified since it was read
+      auto entries = cached.entries;
+      const auto write_time = cached.write_time;
+      lock.unlock();
+      if (CurrentWriteTime(dir, ec) == write_time && !ec) {
+        return entries;
+      }
+      ec.clear();
+      lock.lock();
+    }
+
+    // Watch the directory before reading it, so that no change is missed.
+    // Changes made while reading it are seen after, and only mean that we
+    // cannot keep what we read.
+    const auto watch = AddWatch(key);
+    const auto changes = watch != NO_WATCH ? watches_[watch].changes : 0;
+    lock.unlock();
+
+    auto write_time = file_time_type::min();
+    if (watch == NO_WATCH) {
+      write_time = CurrentWriteTime(dir, ec);
+    }
+    auto entries = ec ? nullptr : ReadListing(dir, ec);
+    const bool settled =
+        watch != NO_WATCH || (!ec && IsSettled(dir, write_time));
+
+    lock.lock();
+    ReadEvents();
+    const bool changed =
+        watch != NO_WATCH && watches_[watch].changes != changes;
+    if (!ec && !changed && settled) {
+      Insert(key, entries, watch, write_time);
+    } else if (!settled) {
+      // What is cached is older still
+      auto stale = index_.find(key);
+      if (stale != index_.end()) {
+        Erase(stale->second);
+      }
+    }
+    if (watch != NO_WATCH) {
+      --watches_[watch].pending;
+      ReleaseWatch(watch);
+    }
+    return entries;
+  }
+
+  void Invalidate(const path &dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(dir.native());
+    if (found != index_.end()) {
+      Erase(found->second);
+    }
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!lru_.empty()) {
+      Erase(lru_.begin());
+    }
+  }
+
+  auto Size() const -> std::size_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+  }
+
+  auto UsesNotifications() const noexcept -> bool {
+#if defined(ASAP_FS_USE_INOTIFY)
+    return notify_fd_ != -1;
+#else
+    return false;
+#endif
+  }
+
+ private:
+  static constexpr int NO_WATCH = -1;
+
+  struct Cached {
+    path::string_type key;
+    listing entries;
+    // The inotify watch descriptor of the directory, or NO_WATCH when the
+    // listing is checked against the modification time of the directory.
+    int watch;
+    file_time_type write_time;
+  };
+  // Most recently used first
+  using Lru = std::list<Cached>;
+
+  struct Watch {
+    // How many change notifications were received for the directory
+    std::uint64_t changes{0};
+    // The listings kept up to date by the watch. There can be more than one
+    // when several paths lead to the same directory.
+    std::vector<path::string_type> keys;
+    // How many listings are being read with the watch
+    std::size_t pending{0};
+    // Whether the kernel still has the watch
+    bool alive{true};
+  };
+
+  void Insert(const path::string_type &key, listing entries, int watch,
+              file_time_type write_time) {
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      // Read by another thread in the meantime
+      Erase(found->second);
+    }
+    lru_.push_front(Cached{key, std::move(entries), watch, write_time});
+    index_.emplace(key, lru_.begin());
+    if (watch != NO_WATCH) {
+      watches_[watch].keys.push_back(key);
+    }
+    while (lru_.size() > max_) {
+      Erase(std::prev(lru_.end()));
+    }
+  }
+
+  void Erase(Lru::iterator cached) {
+    const auto watch = cached->watch;
+    if (watch != NO_WATCH) {
+      auto &keys = watches_[watch].keys;
+      for (auto key = keys.begin(); key != keys.end(); ++key) {
+        if (*key == cached->key) {
+          keys.erase(key);
+          break;
+        }
+      }
+    }
+    index_.erase(cached->key);
+    lru_.erase(cached);
+    if (watch != NO_WATCH) {
+      ReleaseWatch(watch);
+    }
+  }
+
+#if defined(ASAP_FS_USE_INOTIFY)
+  // Starts watching the directory, if possible.
+  auto AddWatch(const path::string_type &key) -> int {
+    if (notify_fd_ == -1) {
+      return NO_WATCH;
+    }
+    // Changes to the entries themselves do not change the listing
+    const auto watch = detail::linux_port::inotify_add_watch(
+        notify_fd_, key.c_str(),
+        IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+            IN_MOVE_SELF | IN_ONLYDIR);
+    if (watch == -1) {
+      // Most likely out of watches, or not a directory. The modification time
+      // of the directory is checked instead, or reading it fails.
+      return NO_WATCH;
+    }
+    ++watches_[watch].pending;
+    return watch;
+  }
+
+  // Stops watching the directory when it no longer has a listing.
+  void ReleaseWatch(int watch) {
+    auto found = watches_.find(watch);
+    if (found == watches_.end() || !found->second.keys.empty() ||
+        found->second.pending != 0) {
+      return;
+    }
+    if (found->second.alive) {
+      detail::linux_port::inotify_rm_watch(notify_fd_, watch);
+    }
+    watches_.erase(found);
+  }
+
+  // Drops the listings of the directories that changed since last time.
+  void ReadEvents() {
+    if (notify_fd_ == -1) {
+      return;
+    }
+    alignas(struct ::inotify_event) char buffer[4096];
+    for (;;) {
+      const ssize_t size =
+          detail::posix_port::read(notify_fd_, buffer, sizeof(buffer));
+      if (size <= 0) {
+        // Nothing more to read for now
+        return;
+      }
+      for (ssize_t offset = 0; offset < size;) {
+        const auto *event =
+            reinterpret_cast<const struct ::inotify_event *>(buffer + offset);
+        offset +=
+            static_cast<ssize_t>(sizeof(struct ::inotify_event) + event->len);
+        if ((event->mask & IN_Q_OVERFLOW) != 0) {
+          // Some changes were lost, so anything may have changed
+          for (auto &watch : watches_) {
+            ++watch.second.changes;
+          }
+          while (!lru_.empty()) {
+            Erase(lru_.begin());
+          }
+          continue;
+        }
+        Changed(event->wd, (event->mask & IN_IGNORED) != 0);
+      }
+    }
+  }
+
+  void Changed(int watch, bool removed) {
+    auto found = watches_.find(watch);
+    if (found == watches_.end()) {
+      // Removed by us, or before we got to use it
+      return;
+    }
+    ++found->second.changes;
+    if (removed) {
+      found->second.alive = false;
+    }
+    // Erasing the last listing may release the watch
+    auto keys = found->second.keys;
+    for (const auto &key : keys) {
+      auto cached = index_.find(key);
+      if (cached != index_.end()) {
+        Erase(cached->second);
+      }
+    }
+    if (removed) {
+      ReleaseWatch(watch);
+    }
+  }
+
+  int notify_fd_{-1};
+#else
+  auto AddWatch(const path::string_type & /*key*/) -> int { return NO_WATCH; }
+  void ReleaseWatch(int /*watch*/) {}
+  void ReadEvents() {}
+#endif  // ASAP_FS_USE_INOTIFY
+
+  mutable std::mutex mutex_;
+  std::size_t max_;
+  Lru lru_;
+  std::unordered_map<path::string_type, Lru::iterator> index_;
+  std::unordered_map<int, Watch> watches_;
+};
+
+constexpr int directory_cache::Impl::NO_WATCH;
+
+// -----------------------------------------------------------------------------
+//                              directory_cache
+// -----------------------------------------------------------------------------
+
+directory_cache::directory_cache(std::size_t max_directories,
+                                 bool allow_notifications)
+    : impl_(new Impl(max_directories == 0 ? 1 : max_directories,
+                     allow_notifications)) {}
+
+directory_cache::~directory_cache() = default;
+
+auto directory_cache::do_list(const path &p, std::error_code *ec) -> listing {
+  ErrorHandler<void> err("directory_cache::list", ec, &p);
+
+  std::error_code m_ec;
+  const auto dir = absolute_impl(p, &m_ec);
+  if (!m_ec) {
+    auto entries = impl_->List(dir, m_ec);
+    if (!m_ec) {
+      return entries;
+    }
+  }
+  err.report(m_ec);
+  return EmptyListing();
+}
+
+void directory_cache::invalidate(const path &p) {
+  std::error_code ec;
+  const auto dir = absolute_impl(p, &ec);
+  if (!ec) {
+    impl_->Invalidate(dir);
+  }
+}
+
+void directory_cache::clear() { impl_->Clear(); }
+
+auto directory_cache::size() const -> std::size_t { return impl_->Size(); }
+
+auto directory_cache::uses_notifications() const noexcept -> bool {
+  return impl_->UsesNotifications();
+}
+
+}  // namespace filesystem
+}  // namespace asap
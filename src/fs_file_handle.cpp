@@ -0,0 +1,526 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <filesystem/filesystem.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "fs_error.h"
+#include "fs_portability.h"
+#include "fs_stat_cache.h"
+
+namespace asap {
+namespace filesystem {
+
+using detail::ErrorHandler;
+using detail::FileDescriptor;
+
+namespace {
+
+// -----------------------------------------------------------------------------
+//                          detail: positional I/O
+// -----------------------------------------------------------------------------
+
+auto HasFlag(open_flags flags, open_flags flag) -> bool {
+  return (flags & flag) != open_flags::none;
+}
+
+auto CheckFlags(open_flags flags) -> bool {
+  const auto writable = HasFlag(flags, open_flags::write);
+  return (writable || HasFlag(flags, open_flags::read)) &&
+         (writable || !HasFlag(flags, open_flags::create)) &&
+         (writable || !HasFlag(flags, open_flags::truncate)) &&
+         (HasFlag(flags, open_flags::create) ||
+          !HasFlag(flags, open_flags::exclusive));
+}
+
+auto Open(const path &p, open_flags flags, std::error_code &ec)
+    -> FileDescriptor {
+#if defined(ASAP_WINDOWS)
+  DWORD access = 0;
+  if (HasFlag(flags, open_flags::read)) {
+    access |= GENERIC_READ;
+  }
+  if (HasFlag(flags, open_flags::write)) {
+    access |= GENERIC_WRITE;
+  }
+  DWORD disposition = OPEN_EXISTING;
+  if (HasFlag(flags, open_flags::create)) {
+    if (HasFlag(flags, open_flags::exclusive)) {
+      disposition = CREATE_NEW;
+    } else if (HasFlag(flags, open_flags::truncate)) {
+      disposition = CREATE_ALWAYS;
+    } else {
+      disposition = OPEN_ALWAYS;
+    }
+  } else if (HasFlag(flags, open_flags::truncate)) {
+    disposition = TRUNCATE_EXISTING;
+  }
+  return FileDescriptor::Create(
+      &p, ec, access, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,
+      nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+  int oflags = O_CLOEXEC;
+  if ((flags & open_flags::read_write) == open_flags::read_write) {
+    oflags |= O_RDWR;
+  } else if (HasFlag(flags, open_flags::write)) {
+    oflags |= O_WRONLY;
+  } else {
+    oflags |= O_RDONLY;
+  }
+  if (HasFlag(flags, open_flags::create)) {
+    oflags |= O_CREAT;
+  }
+  if (HasFlag(flags, open_flags::exclusive)) {
+    oflags |= O_EXCL;
+  }
+  if (HasFlag(flags, open_flags::truncate)) {
+    oflags |= O_TRUNC;
+  }
+  // The permissions of a created file are restricted by the umask
+  return FileDescriptor::Create(&p, ec, oflags, 0666);
+#endif
+}
+
+#if defined(ASAP_POSIX)
+// The offsets beyond what off_t can hold are rejected by the system as
+// negative.
+auto ToOffset(std::uintmax_t offset) -> ::off_t {
+  return static_cast<::off_t>(offset);
+}
+
+#if defined(ASAP_FS_USE_PREADV)
+// The number of buffers passed to the system at once. More buffers are
+// transferred in several calls.
+constexpr std::size_t IOV_BATCH = 64;
+
+// Transfers the buffers with preadv() or pwritev(), IOV_BATCH at a time, until
+// the system transfers less than a whole batch.
+template <typename Buffer, typename Transfer>
+auto TransferVector(int fd, const Buffer *buffers, std::size_t count,
+                    std::uintmax_t offset, Transfer transfer,
+                    std::error_code &ec) -> std::size_t {
+  std::size_t total = 0;
+  ::iovec iov[IOV_BATCH];
+  while (count > 0) {
+    const auto batch = std::min(count, IOV_BATCH);
+    std::size_t expected = 0;
+    for (std::size_t index = 0; index < batch; ++index) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      iov[index].iov_base = const_cast<void *>(
+          static_cast<const void *>(buffers[index].data));
+      iov[index].iov_len = buffers[index].size;
+      expected += buffers[index].size;
+    }
+    ::ssize_t size = 0;
+    do {
+      size = transfer(fd, iov, static_cast<int>(batch),
+                      ToOffset(offset + total));
+    } while (size == -1 && errno == EINTR);
+    if (size == -1) {
+      // What was transferred by the previous batches is still reported
+      if (total == 0) {
+        ec = detail::capture_errno();
+      }
+      return total;
+    }
+    total += static_cast<std::size_t>(size);
+    if (static_cast<std::size_t>(size) < expected) {
+      break;
+    }
+    buffers += batch;
+    count -= batch;
+  }
+  return total;
+}
+#endif  // ASAP_FS_USE_PREADV
+#endif  // ASAP_POSIX
+
+#if defined(ASAP_WINDOWS)
+auto ToOverlapped(std::uintmax_t offset) -> OVERLAPPED {
+  OVERLAPPED overlapped{};
+  overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFU);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32U);
+  return overlapped;
+}
+
+// ReadFile() and WriteFile() take 32 bits sizes
+auto ClampSize(std::size_t size) -> DWORD {
+  return static_cast<DWORD>(
+      std::min<std::size_t>(size, std::numeric_limits<DWORD>::max()));
+}
+#endif  // ASAP_WINDOWS
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+//                               file_handle
+// -----------------------------------------------------------------------------
+
+class file_handle::Impl {
+ public:
+  Impl(const filesystem::path &p, open_flags flags, std::error_code &ec)
+      : path_(p), file_(Open(path_, flags, ec)) {}
+
+  // Referred to by file_, which must not outlive it
+  filesystem::path path_;
+  FileDescriptor file_;
+};
+
+file_handle::file_handle() noexcept = default;
+
+file_handle::file_handle(const filesystem::path &p, open_flags flags) {
+  do_open(p, flags, nullptr);
+}
+
+file_handle::file_handle(const filesystem::path &p, open_flags flags,
+                         std::error_code &ec) {
+  do_open(p, flags, &ec);
+}
+
+file_handle::file_handle(file_handle &&other) noexcept = default;
+auto file_handle::operator=(file_handle &&other) noexcept
+    -> file_handle & = default;
+file_handle::~file_handle() = default;
+
+auto file_handle::is_open() const noexcept -> bool {
+  return static_cast<bool>(impl_);
+}
+
+auto file_handle::path() const noexcept -> const filesystem::path & {
+  static const filesystem::path empty;
+  return impl_ ? impl_->path_ : empty;
+}
+
+auto file_handle::status() const noexcept -> file_status {
+  return impl_ ? impl_->file_.Status() : file_status{};
+}
+
+auto file_handle::refresh_status() -> file_status {
+  return do_refresh_status(nullptr);
+}
+
+auto file_handle::refresh_status(std::error_code &ec) noexcept
+    -> file_status {
+  return do_refresh_status(&ec);
+}
+
+auto file_handle::pread(void *buffer, std::size_t size, std::uintmax_t offset)
+    -> std::size_t {
+  return do_pread(buffer, size, offset, nullptr);
+}
+
+auto file_handle::pread(void *buffer, std::size_t size, std::uintmax_t offset,
+                        std::error_code &ec) noexcept -> std::size_t {
+  return do_pread(buffer, size, offset, &ec);
+}
+
+auto file_handle::pwrite(const void *buffer, std::size_t size,
+                         std::uintmax_t offset) -> std::size_t {
+  return do_pwrite(buffer, size, offset, nullptr);
+}
+
+auto file_handle::pwrite(const void *buffer, std::size_t size,
+                         std::uintmax_t offset, std::error_code &ec) noexcept
+    -> std::size_t {
+  return do_pwrite(buffer, size, offset, &ec);
+}
+
+auto file_handle::preadv(const io_buffer *buffers, std::size_t count,
+                         std::uintmax_t offset) -> std::size_t {
+  return do_preadv(buffers, count, offset, nullptr);
+}
+
+auto file_handle::preadv(const io_buffer *buffers, std::size_t count,
+                         std::uintmax_t offset, std::error_code &ec) noexcept
+    -> std::size_t {
+  return do_preadv(buffers, count, offset, &ec);
+}
+
+auto file_handle::pwritev(const const_io_buffer *buffers, std::size_t count,
+                          std::uintmax_t offset) -> std::size_t {
+  return do_pwritev(buffers, count, offset, nullptr);
+}
+
+auto file_handle::pwritev(const const_io_buffer *buffers, std::size_t count,
+                          std::uintmax_t offset, std::error_code &ec) noexcept
+    -> std::size_t {
+  return do_pwritev(buffers, count, offset, &ec);
+}
+
+void file_handle::fallocate(std::uintmax_t offset, std::uintmax_t length) {
+  do_fallocate(offset, length, nullptr);
+}
+
+void file_handle::fallocate(std::uintmax_t offset, std::uintmax_t length,
+                            std::error_code &ec) noexcept {
+  do_fallocate(offset, length, &ec);
+}
+
+void file_handle::fdatasync() { do_fdatasync(nullptr); }
+
+void file_handle::fdatasync(std::error_code &ec) noexcept {
+  do_fdatasync(&ec);
+}
+
+void file_handle::close() noexcept { impl_.reset(); }
+
+void file_handle::do_open(const filesystem::path &p, open_flags flags,
+                          std::error_code *ec) {
+  ErrorHandler<void> err("file_handle", ec, &p);
+  std::error_code m_ec;
+  if (!CheckFlags(flags)) {
+    return err.report(std::make_error_code(std::errc::invalid_argument));
+  }
+  std::unique_ptr<Impl> impl(new Impl(p, flags, m_ec));
+  // Creating or truncating the file changes its attributes, even when opening
+  // it fails afterwards. Creating it changes its directory too.
+  if (detail::StatCacheEnabled()) {
+    if (HasFlag(flags, open_flags::create)) {
+      detail::InvalidateEntry(p);
+    } else if (HasFlag(flags, open_flags::truncate)) {
+      detail::InvalidateStat(p);
+    }
+  }
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  impl->file_.RefreshStatus(true, m_ec);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  impl_ = std::move(impl);
+}
+
+auto file_handle::do_refresh_status(std::error_code *ec) -> file_status {
+  ErrorHandler<void> err("refresh_status", ec, &path());
+  if (!impl_) {
+    err.report(std::make_error_code(std::errc::bad_file_descriptor));
+    return file_status{};
+  }
+  std::error_code m_ec;
+  auto status = impl_->file_.RefreshStatus(true, m_ec);
+  if (m_ec) {
+    err.report(m_ec);
+  }
+  return status;
+}
+
+auto file_handle::do_pread(void *buffer, std::size_t size,
+                           std::uintmax_t offset, std::error_code *ec)
+    -> std::size_t {
+  ErrorHandler<void> err("pread", ec, &path());
+  if (!impl_) {
+    err.report(std::make_error_code(std::errc::bad_file_descriptor));
+    return 0;
+  }
+#if defined(ASAP_WINDOWS)
+  auto overlapped = ToOverlapped(offset);
+  DWORD read = 0;
+  if (detail::win32_port::ReadFile(impl_->file_.fd_, buffer, ClampSize(size),
+                                   &read, &overlapped) == 0) {
+    const auto error = detail::capture_errno();
+    if (error.value() != ERROR_HANDLE_EOF) {
+      err.report(error);
+    }
+    return 0;
+  }
+  return read;
+#else
+  ::ssize_t read = 0;
+  do {
+    read = detail::posix_port::pread(impl_->file_.fd_, buffer, size,
+                                     ToOffset(offset));
+  } while (read == -1 && errno == EINTR);
+  if (read == -1) {
+    err.report(detail::capture_errno());
+    return 0;
+  }
+  return static_cast<std::size_t>(read);
+#endif
+}
+
+auto file_handle::do_pwrite(const void *buffer, std::size_t size,
+                            std::uintmax_t offset, std::error_code *ec)
+    -> std::size_t {
+  ErrorHandler<void> err("pwrite", ec, &path());
+  if (!impl_) {
+    err.report(std::make_error_code(std::errc::bad_file_descriptor));
+    return 0;
+  }
+  detail::InvalidateStatOnExit invalidate_stat(impl_->path_);
+#if defined(ASAP_WINDOWS)
+  auto overlapped = ToOverlapped(offset);
+  DWORD written = 0;
+  if (detail::win32_port::WriteFile(impl_->file_.fd_, buffer, ClampSize(size),
+                                    &written, &overlapped) == 0) {
+    err.report(detail::capture_errno());
+    return 0;
+  }
+  return written;
+#else
+  ::ssize_t written = 0;
+  do {
+    written = detail::posix_port::pwrite(impl_->file_.fd_, buffer, size,
+                                         ToOffset(offset));
+  } while (written == -1 && errno == EINTR);
+  if (written == -1) {
+    err.report(detail::capture_errno());
+    return 0;
+  }
+  return static_cast<std::size_t>(written);
+#endif
+}
+
+auto file_handle::do_preadv(const io_buffer *buffers, std::size_t count,
+                            std::uintmax_t offset, std::error_code *ec)
+    -> std::size_t {
+  ErrorHandler<void> err("preadv", ec, &path());
+  if (!impl_) {
+    err.report(std::make_error_code(std::errc::bad_file_descriptor));
+    return 0;
+  }
+  std::error_code m_ec;
+  std::size_t total = 0;
+#if defined(ASAP_FS_USE_PREADV)
+  total = TransferVector(impl_->file_.fd_, buffers, count, offset,
+                         detail::posix_port::preadv, m_ec);
+#else
+  for (std::size_t index = 0; index < count; ++index) {
+    const auto read = do_pread(buffers[index].data, buffers[index].size,
+                               offset + total, &m_ec);
+    total += read;
+    if (m_ec || read < buffers[index].size) {
+      break;
+    }
+  }
+  // What was transferred by the previous buffers is still reported
+  if (total != 0) {
+    m_ec.clear();
+  }
+#endif
+  if (m_ec) {
+    err.report(m_ec);
+  }
+  return total;
+}
+
+auto file_handle::do_pwritev(const const_io_buffer *buffers, std::size_t count,
+                             std::uintmax_t offset, std::error_code *ec)
+    -> std::size_t {
+  ErrorHandler<void> err("pwritev", ec, &path());
+  if (!impl_) {
+    err.report(std::make_error_code(std::errc::bad_file_descriptor));
+    return 0;
+  }
+  detail::InvalidateStatOnExit invalidate_stat(impl_->path_);
+  std::error_code m_ec;
+  std::size_t total = 0;
+#if defined(ASAP_FS_USE_PREADV)
+  total = TransferVector(impl_->file_.fd_, buffers, count, offset,
+                         detail::posix_port::pwritev, m_ec);
+#else
+  for (std::size_t index = 0; index < count; ++index) {
+    const auto written = do_pwrite(buffers[index].data, buffers[index].size,
+                                   offset + total, &m_ec);
+    total += written;
+    if (m_ec || written < buffers[index].size) {
+      break;
+    }
+  }
+  // What was transferred by the previous buffers is still reported
+  if (total != 0) {
+    m_ec.clear();
+  }
+#endif
+  if (m_ec) {
+    err.report(m_ec);
+  }
+  return total;
+}
+
+void file_handle::do_fallocate(std::uintmax_t offset, std::uintmax_t length,
+                               std::error_code *ec) {
+  ErrorHandler<void> err("fallocate", ec, &path());
+  if (!impl_) {
+    return err.report(std::make_error_code(std::errc::bad_file_descriptor));
+  }
+  if (length > std::numeric_limits<std::uintmax_t>::max() - offset) {
+    return err.report(std::make_error_code(std::errc::file_too_large));
+  }
+  detail::InvalidateStatOnExit invalidate_stat(impl_->path_);
+  const auto end = offset + length;
+  const auto fd = impl_->file_.fd_;
+#if defined(ASAP_WINDOWS)
+  // Only grows the file. The storage is reserved by the system as it does
+  LARGE_INTEGER size;
+  if (detail::win32_port::GetFileSizeEx(fd, &size) == 0) {
+    return err.report(detail::capture_errno());
+  }
+  if (end <= static_cast<std::uintmax_t>(size.QuadPart)) {
+    return;
+  }
+  LARGE_INTEGER new_end;
+  new_end.QuadPart = static_cast<LONGLONG>(end);
+  if (detail::win32_port::SetFilePointerEx(fd, new_end, nullptr, FILE_BEGIN) ==
+          0 ||
+      detail::win32_port::SetEndOfFile(fd) == 0) {
+    return err.report(detail::capture_errno());
+  }
+#else
+#if defined(ASAP_FS_USE_POSIX_FALLOCATE)
+  int res = 0;
+  do {
+    res = detail::posix_port::posix_fallocate(fd, ToOffset(offset),
+                                              ToOffset(length));
+  } while (res == EINTR);
+  // Reports the error instead of setting errno. Some file systems cannot
+  // reserve storage, and only growing the file is left then.
+  if (res != EINVAL && res != EOPNOTSUPP) {
+    if (res != 0) {
+      return err.report(std::error_code(res, std::generic_category()));
+    }
+    return;
+  }
+#endif  // ASAP_FS_USE_POSIX_FALLOCATE
+  detail::posix_port::StatT st{};
+  if (detail::posix_port::fstat(fd, &st) == -1) {
+    return err.report(detail::capture_errno());
+  }
+  if (end > static_cast<std::uintmax_t>(st.st_size) &&
+      detail::posix_port::ftruncate(fd, ToOffset(end)) == -1) {
+    return err.report(detail::capture_errno());
+  }
+#endif  // ASAP_WINDOWS
+}
+
+void file_handle::do_fdatasync(std::error_code *ec) {
+  ErrorHandler<void> err("fdatasync", ec, &path());
+  if (!impl_) {
+    return err.report(std::make_error_code(std::errc::bad_file_descriptor));
+  }
+#if defined(ASAP_WINDOWS)
+  if (detail::win32_port::FlushFileBuffers(impl_->file_.fd_) == 0) {
+    return err.report(detail::capture_errno());
+  }
+#else
+  int res = 0;
+  do {
+#if defined(ASAP_FS_USE_FDATASYNC)
+    res = detail::posix_port::fdatasync(impl_->file_.fd_);
+#else
+    res = detail::posix_port::fsync(impl_->file_.fd_);
+#endif
+  } while (res == -1 && errno == EINTR);
+  if (res == -1) {
+    return err.report(detail::capture_errno());
+  }
+#endif  // ASAP_WINDOWS
+}
+
+}  // namespace filesystem
+}  // namespace asap
@@ -0,0 +1,321 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <filesystem/filesystem.h>
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "fs_error.h"
+#include "fs_portability.h"
+#include "fs_stat_cache.h"
+
+namespace asap {
+namespace filesystem {
+
+using detail::ErrorHandler;
+
+namespace {
+
+// -----------------------------------------------------------------------------
+//                          detail: memory mapping
+// -----------------------------------------------------------------------------
+
+// The boundary a mapping must start at in the file.
+auto MapGranularity() -> std::uintmax_t {
+  static const std::uintmax_t granularity = [] {
+#if defined(ASAP_WINDOWS)
+    SYSTEM_INFO info;
+    detail::win32_port::GetSystemInfo(&info);
+    return static_cast<std::uintmax_t>(info.dwAllocationGranularity);
+#else
+    const auto page_size = detail::posix_port::sysconf(_SC_PAGESIZE);
+    return static_cast<std::uintmax_t>(page_size > 0 ? page_size : 4096);
+#endif
+  }();
+  return granularity;
+}
+
+#if defined(ASAP_POSIX)
+auto ToPosixAdvice(map_advice advice) -> int {
+  switch (advice) {
+    case map_advice::sequential:
+      return POSIX_MADV_SEQUENTIAL;
+    case map_advice::random:
+      return POSIX_MADV_RANDOM;
+    case map_advice::will_need:
+      return POSIX_MADV_WILLNEED;
+    case map_advice::dont_need:
+      return POSIX_MADV_DONTNEED;
+    case map_advice::normal:
+    default:
+      return POSIX_MADV_NORMAL;
+  }
+}
+
+// Extends [data, data + size) to the page boundaries, as madvise() requires.
+void Advise(const char *data, std::size_t size, int advice) noexcept {
+  if (size == 0) {
+    return;
+  }
+  const auto page_size = static_cast<std::uintptr_t>(MapGranularity());
+  const auto start = reinterpret_cast<std::uintptr_t>(data);
+  const auto aligned = start - start % page_size;
+  // Only a hint: failing to apply it changes nothing but the performance
+  detail::posix_port::posix_madvise(reinterpret_cast<void *>(aligned),
+                                    size + (start - aligned), advice);
+}
+#endif  // ASAP_POSIX
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+//                             mapped_file_view
+// -----------------------------------------------------------------------------
+
+constexpr std::size_t mapped_file_view::npos;
+
+auto mapped_file_view::subview(std::size_t offset, std::size_t count) const
+    -> mapped_file_view {
+  if (offset > size_) {
+    throw std::out_of_range("mapped_file_view::subview: offset out of range");
+  }
+  const auto available = size_ - offset;
+  return mapped_file_view(data_ + offset,
+                          count < available ? count : available);
+}
+
+void mapped_file_view::advise(map_advice advice) const noexcept {
+#if defined(ASAP_POSIX)
+  Advise(data_, size_, ToPosixAdvice(advice));
+#else
+  (void)advice;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+//                               mapped_file
+// -----------------------------------------------------------------------------
+
+mapped_file::mapped_file(const path &p, const map_options &options) {
+  open(p, options, nullptr);
+}
+
+mapped_file::mapped_file(const path &p, const map_options &options,
+                         std::error_code &ec) {
+  open(p, options, &ec);
+}
+
+mapped_file::mapped_file(mapped_file &&other) noexcept
+    : base_(other.base_),
+      mapped_length_(other.mapped_length_),
+      data_(other.data_),
+      size_(other.size_),
+      handle_(other.handle_),
+      path_(std::move(other.path_)),
+      mode_(other.mode_),
+      open_(other.open_) {
+  other.base_ = nullptr;
+  other.mapped_length_ = 0;
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.handle_ = nullptr;
+  other.open_ = false;
+}
+
+auto mapped_file::operator=(mapped_file &&other) noexcept -> mapped_file & {
+  if (this != &other) {
+    close();
+    std::swap(base_, other.base_);
+    std::swap(mapped_length_, other.mapped_length_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(handle_, other.handle_);
+    path_.swap(other.path_);
+    std::swap(mode_, other.mode_);
+    std::swap(open_, other.open_);
+  }
+  return *this;
+}
+
+mapped_file::~mapped_file() { close(); }
+
+void mapped_file::open(const path &p, const map_options &options,
+                       std::error_code *ec) {
+  ErrorHandler<void> err("mapped_file", ec, &p);
+  std::error_code m_ec;
+  const auto writable = options.mode == map_mode::read_write;
+
+#if defined(ASAP_WINDOWS)
+  auto file = detail::FileDescriptor::Create(
+      &p, m_ec, GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+      FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  LARGE_INTEGER file_size;
+  if (detail::win32_port::GetFileSizeEx(file.fd_, &file_size) == 0) {
+    return err.report(detail::capture_errno());
+  }
+  const auto size = static_cast<std::uintmax_t>(file_size.QuadPart);
+#else
+  auto file = detail::FileDescriptor::Create(
+      &p, m_ec, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+  if (m_ec) {
+    return err.report(m_ec);
+  }
+  detail::posix_port::StatT st{};
+  if (detail::posix_port::fstat(file.fd_, &st) == -1) {
+    return err.report(detail::capture_errno());
+  }
+  if (S_ISDIR(st.st_mode)) {
+    return err.report(std::make_error_code(std::errc::is_a_directory));
+  }
+  if (!S_ISREG(st.st_mode)) {
+    return err.report(std::make_error_code(std::errc::not_supported));
+  }
+  const auto size = static_cast<std::uintmax_t>(st.st_size);
+#endif
+
+  if (options.offset > size) {
+    return err.report(std::make_error_code(std::errc::invalid_argument),
+                      "region starts past the end of the file");
+  }
+  auto length = size - options.offset;
+  if (options.length != 0) {
+    if (options.length > length) {
+      return err.report(std::make_error_code(std::errc::invalid_argument),
+                        "region ends past the end of the file");
+    }
+    length = options.length;
+  }
+
+  // The mapping starts at a page boundary, and the requested region a few
+  // bytes after that when the offset is not aligned
+  const auto granularity = MapGranularity();
+  const auto aligned_offset = options.offset - options.offset % granularity;
+  const auto delta = options.offset - aligned_offset;
+  if (length > std::numeric_limits<std::size_t>::max() - delta) {
+    return err.report(std::make_error_code(std::errc::file_too_large));
+  }
+  const auto mapped_length = static_cast<std::size_t>(length + delta);
+
+  if (length != 0) {
+#if defined(ASAP_WINDOWS)
+    auto mapping = detail::win32_port::CreateFileMappingW(
+        file.fd_, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0,
+        nullptr);
+    if (mapping == nullptr) {
+      return err.report(detail::capture_errno());
+    }
+    auto *base = detail::win32_port::MapViewOfFile(
+        mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+        static_cast<DWORD>(aligned_offset >> 32U),
+        static_cast<DWORD>(aligned_offset & 0xFFFFFFFFU), mapped_length);
+    // The view keeps the mapping alive
+    m_ec = base == nullptr ? detail::capture_errno() : std::error_code{};
+    detail::win32_port::CloseHandle(mapping);
+    if (m_ec) {
+      return err.report(m_ec);
+    }
+#else
+    int flags = MAP_SHARED;
+#if defined(MAP_POPULATE)
+    if (options.populate) {
+      flags |= MAP_POPULATE;
+    }
+#endif
+    auto *base = detail::posix_port::mmap(
+        nullptr, mapped_length, PROT_READ | (writable ? PROT_WRITE : 0), flags,
+        file.fd_, static_cast<off_t>(aligned_offset));
+    if (base == MAP_FAILED) {
+      return err.report(detail::capture_errno());
+    }
+#if defined(ASAP_LINUX) && defined(MADV_HUGEPAGE)
+    if (options.huge_pages) {
+      // Fails when the kernel does not support huge pages for this file,
+      // which is fine: the regular pages are used then
+      detail::linux_port::madvise(base, mapped_length, MADV_HUGEPAGE);
+    }
+#endif
+#endif  // ASAP_WINDOWS
+    base_ = base;
+    mapped_length_ = mapped_length;
+    data_ = static_cast<char *>(base) + delta;
+    size_ = static_cast<std::size_t>(length);
+
+#if defined(ASAP_POSIX)
+    if (options.advice != map_advice::normal) {
+      Advise(data_, size_, ToPosixAdvice(options.advice));
+    }
+#if !defined(MAP_POPULATE)
+    // Without MAP_POPULATE, ask for the pages to be read ahead instead
+    if (options.populate && options.advice != map_advice::will_need) {
+      Advise(data_, size_, POSIX_MADV_WILLNEED);
+    }
+#endif
+#endif  // ASAP_POSIX
+  }
+
+#if defined(ASAP_WINDOWS)
+  // Keep the file open to flush it later
+  handle_ = file.fd_;
+  file.fd_ = detail::FileDescriptor::invalid_value;
+#endif
+  path_ = p;
+  mode_ = options.mode;
+  open_ = true;
+}
+
+void mapped_file::flush() { do_flush(nullptr); }
+
+void mapped_file::flush(std::error_code &ec) { do_flush(&ec); }
+
+void mapped_file::do_flush(std::error_code *ec) {
+  ErrorHandler<void> err("flush", ec, &path_);
+  if (base_ == nullptr || mode_ != map_mode::read_write) {
+    return;
+  }
+  // Writing the pages changes the modification time of the file
+  detail::InvalidateStatOnExit invalidate_stat(path_);
+#if defined(ASAP_WINDOWS)
+  if (detail::win32_port::FlushViewOfFile(base_, mapped_length_) == 0 ||
+      detail::win32_port::FlushFileBuffers(handle_) == 0) {
+    return err.report(detail::capture_errno());
+  }
+#else
+  if (detail::posix_port::msync(base_, mapped_length_, MS_SYNC) == -1) {
+    return err.report(detail::capture_errno());
+  }
+#endif
+}
+
+void mapped_file::close() noexcept {
+  if (base_ != nullptr) {
+#if defined(ASAP_WINDOWS)
+    detail::win32_port::UnmapViewOfFile(base_);
+#else
+    detail::posix_port::munmap(base_, mapped_length_);
+#endif
+  }
+#if defined(ASAP_WINDOWS)
+  if (handle_ != nullptr) {
+    detail::win32_port::CloseHandle(handle_);
+  }
+#endif
+  base_ = nullptr;
+  mapped_length_ = 0;
+  data_ = nullptr;
+  size_ = 0;
+  handle_ = nullptr;
+  path_.clear();
+  open_ = false;
+}
+
+}  // namespace filesystem
+}  // namespace asap
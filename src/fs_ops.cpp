@@ -3,12 +3,20 @@
 //    (See accompanying file LICENSE or copy at
 //   https://opensource.org/licenses/BSD-3-Clause)
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <stack>
 
 #include "fs_portability.h"
+#include "fs_stat_cache.h"
+#include "fs_thread_pool.h"
 
 namespace asap {
 namespace filesystem {
@@ -32,6 +40,104 @@ using detail::FileDescriptor;
 using detail::posix_port::StatT;
 #endif
 
+// -----------------------------------------------------------------------------
+//                        detail: current path cache
+// -----------------------------------------------------------------------------
+
+namespace {
+
+// A snapshot of the current working directory, so that making relative paths
+// absolute does not ask the system for it every time. It is dropped when the
+// current directory is changed through this library, and taken again the next
+// time it is needed.
+class CurrentPathCache {
+ public:
+  static auto Instance() -> CurrentPathCache & {
+    static CurrentPathCache cache;
+    return cache;
+  }
+
+  auto Enabled() const noexcept -> bool {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void Enable(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_.store(enabled, std::memory_order_relaxed);
+    DropLocked();
+  }
+
+  // Gets the snapshot when taken. Otherwise, returns the generation to store
+  // the snapshot taken by the caller with.
+  auto Lookup(path &cwd, std::uint64_t &generation) -> bool {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!valid_) {
+      generation = generation_;
+      return false;
+    }
+    cwd = snapshot_;
+    return true;
+  }
+
+  // Keeps `cwd` unless the current directory was changed since the lookup
+  // that returned `generation`, in which case `cwd` may be stale.
+  void Store(const path &cwd, std::uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Enabled() && generation == generation_) {
+      snapshot_ = cwd;
+      valid_ = true;
+    }
+  }
+
+  void Drop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DropLocked();
+  }
+
+ private:
+  void DropLocked() {
+    snapshot_.clear();
+    valid_ = false;
+    ++generation_;
+  }
+
+  std::atomic<bool> enabled_{true};
+  std::mutex mutex_;
+  path snapshot_;
+  bool valid_{false};
+  std::uint64_t generation_{0};
+};
+
+auto CachedCurrentPath(std::error_code *ec) -> path {
+  auto &cache = CurrentPathCache::Instance();
+  if (!cache.Enabled()) {
+    return current_path_impl(ec);
+  }
+  path cwd;
+  std::uint64_t generation = 0;
+  if (cache.Lookup(cwd, generation)) {
+    if (ec != nullptr) {
+      ec->clear();
+    }
+    return cwd;
+  }
+  cwd = current_path_impl(ec);
+  if ((ec == nullptr) || !*ec) {
+    cache.Store(cwd, generation);
+  }
+  return cwd;
+}
+
+}  // namespace
+
+auto current_path_cache_enabled() noexcept -> bool {
+  return CurrentPathCache::Instance().Enabled();
+}
+
+void current_path_cache_enabled(bool enabled) {
+  CurrentPathCache::Instance().Enable(enabled);
+}
+
 // -----------------------------------------------------------------------------
 //                               absolute
 // -----------------------------------------------------------------------------
@@ -48,7 +154,7 @@ static auto do_absolute_impl(const path &p, path *cwd, std::error_code *ec)
   ) {
     return p;
   }
-  *cwd = current_path_impl(ec);
+  *cwd = CachedCurrentPath(ec);
   if ((ec != nullptr) && *ec) {
     return {};
   }
@@ -173,8 +279,88 @@ auto stat_equivalent(const StatT &st1, const StatT &st2) -> bool {
 }  // namespace
 #endif  // ASAP_POSIX
 
-void copy_impl(const path &from, const path &to, copy_options options,
-               std::error_code *ec) {
+namespace {
+// Shared state of a parallel copy(). The walk of the source tree, including the
+// creation of the directories, is done by the calling thread in the same order
+// as the sequential copy, and only the copies of the files are run
+// concurrently.
+//
+// Every operation gets a sequence number in the order of the walk. When several
+// of them fail, the error reported is the one with the lowest sequence number,
+// which is the error the sequential copy would have stopped at.
+class ParallelCopy {
+ public:
+  using Operation = std::function<void(std::error_code *)>;
+
+  explicit ParallelCopy(const parallel_policy &policy) : tasks_(policy) {}
+
+  void Run(Operation operation, const path &from, const path &to) {
+    const auto sequence = next_sequence_++;
+    tasks_.Run([this, sequence, operation, from, to]() {
+      if (FailedBefore(sequence)) {
+        return;
+      }
+      std::error_code m_ec;
+      operation(&m_ec);
+      if (m_ec) {
+        Record(sequence, from, to, m_ec);
+      }
+    });
+  }
+
+  // Record an error of the walk itself, which comes after everything that was
+  // scheduled so far.
+  void Fail(const path &from, const path &to, const std::error_code &ec) {
+    Record(next_sequence_++, from, to, ec);
+  }
+
+  auto Failed() -> bool {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<bool>(error_);
+  }
+
+  void Report(std::error_code *ec) {
+    tasks_.Wait();
+    if (error_) {
+      ErrorHandler<void> err("copy", ec, &error_from_, &error_to_);
+      err.report(error_);
+    }
+  }
+
+ private:
+  auto FailedBefore(std::size_t sequence) -> bool {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_ && error_sequence_ < sequence;
+  }
+
+  void Record(std::size_t sequence, const path &from, const path &to,
+              const std::error_code &ec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_ || sequence < error_sequence_) {
+      error_sequence_ = sequence;
+      error_ = ec;
+      error_from_ = from;
+      error_to_ = to;
+    }
+  }
+
+  // Only used by the thread walking the tree
+  std::size_t next_sequence_{0};
+
+  std::mutex mutex_;
+  std::size_t error_sequence_{0};
+  std::error_code error_;
+  path error_from_;
+  path error_to_;
+
+  // Last, so that the tasks are done before the state they use is destroyed
+  detail::TaskGroup tasks_;
+};
+
+// When `parallel` is not null, the files are scheduled to be copied by its
+// tasks instead of being copied immediately.
+void do_copy_impl(const path &from, const path &to, copy_options options,
+                  std::error_code *ec, ParallelCopy *parallel) {
   ErrorHandler<void> err("copy", ec, &from, &to);
 
   const bool skip_symlinks =
@@ -253,15 +439,24 @@ void copy_impl(const path &from, const path &to, copy_options options,
   }
   if (is_regular_file(f)) {
     if (detail::is_set(options, copy_options::directories_only)) {
-      // do nothing
-    } else if (create_symlinks) {
-      create_symlink_impl(from, to, ec);
-    } else if (detail::is_set(options, copy_options::create_hard_links)) {
-      create_hard_link_impl(from, to, ec);
-    } else if (is_directory(t)) {
-      copy_file_impl(from, to / from.filename(), options, ec);
+      return;
+    }
+    auto copy_regular_file = [from, to, t, options,
+                              create_symlinks](std::error_code *m_ec) {
+      if (create_symlinks) {
+        create_symlink_impl(from, to, m_ec);
+      } else if (detail::is_set(options, copy_options::create_hard_links)) {
+        create_hard_link_impl(from, to, m_ec);
+      } else if (is_directory(t)) {
+        copy_file_impl(from, to / from.filename(), options, m_ec);
+      } else {
+        copy_file_impl(from, to, options, m_ec);
+      }
+    };
+    if (parallel != nullptr) {
+      parallel->Run(copy_regular_file, from, to);
     } else {
-      copy_file_impl(from, to, options, ec);
+      copy_regular_file(ec);
     }
     return;
   }
@@ -287,18 +482,54 @@ void copy_impl(const path &from, const path &to, copy_options options,
       if (m_ec2) {
         return err.report(m_ec2);
       }
-      copy_impl(it->path(), to / it->path().filename(), options, ec);
+      if (parallel != nullptr && parallel->Failed()) {
+        // The copy of a file failed, don't go any further
+        return;
+      }
+      do_copy_impl(it->path(), to / it->path().filename(), options, ec,
+                   parallel);
       if ((ec != nullptr) && *ec) {
         return;
       }
     }
   }
 }
+}  // namespace
+
+void copy_impl(const path &from, const path &to, copy_options options,
+               std::error_code *ec) {
+  detail::ClearStatsOnExit clear_stats;
+  do_copy_impl(from, to, options, ec, nullptr);
+}
+
+void copy_impl(const path &from, const path &to, copy_options options,
+               const parallel_policy &policy, std::error_code *ec) {
+  detail::ClearStatsOnExit clear_stats;
+  if (ec != nullptr) {
+    ec->clear();
+  }
+  ParallelCopy parallel(policy);
+  std::error_code m_ec;
+  do_copy_impl(from, to, options, &m_ec, &parallel);
+  if (m_ec) {
+    parallel.Fail(from, to, m_ec);
+  }
+  parallel.Report(ec);
+}
 
 namespace {
+// Big enough to amortize the cost of the system calls and let the disk stream,
+// small enough to not be a burden for every thread that copies files.
+constexpr size_t MIN_COPY_BUFFER_SIZE = 64 * 1024;
+constexpr size_t MAX_COPY_BUFFER_SIZE = 16 * 1024 * 1024;
+constexpr size_t DEFAULT_COPY_BUFFER_SIZE = 1024 * 1024;
+std::atomic<size_t> copy_buffer_size{DEFAULT_COPY_BUFFER_SIZE};
+std::atomic<bool> copy_in_userspace{false};
+
 #if defined(ASAP_WINDOWS)
 auto do_copy_file_win32(FileDescriptor &read_fd, FileDescriptor &write_fd,
-                        std::error_code &ec) -> bool {
+                        copy_file_strategy &strategy, std::error_code &ec)
+    -> bool {
   auto read_wpath = read_fd.name_.wstring();
   auto write_wpath = write_fd.name_.wstring();
   if (detail::win32_port::CopyFileW(read_wpath.c_str(), write_wpath.c_str(),
@@ -307,42 +538,116 @@ auto do_copy_file_win32(FileDescriptor &read_fd, FileDescriptor &write_fd,
     return false;
   }
 
+  strategy = copy_file_strategy::win32_copy_file;
   ec.clear();
   return true;
 }
 #else  // ASAP_WINDOWS
+
+// All the copy methods below transfer data from the current offset of the
+// source file to the current offset of the destination file and advance both
+// offsets by the amount of data copied. This allows a method to give up in the
+// middle of the copy and let the next method continue from where it stopped.
+//
+// A method returns false without setting `ec` when it is not supported for the
+// files being copied, so that the next method can be tried. It returns false
+// and sets `ec` when the copy failed.
+
+#if ASAP_FS_USE_FICLONE
+// Share the data blocks of the source file with the destination file, which
+// is both the fastest and the most space efficient copy we can get. This is
+// only supported by copy-on-write filesystems (btrfs, xfs, ...), and when both
+// files are on the same filesystem.
+auto do_copy_file_clone(FileDescriptor &read_fd, FileDescriptor &write_fd)
+    -> bool {
+  // Errors are not reported as this is an optimization: any failure just
+  // means that we need to actually copy the data.
+  return detail::linux_port::ioctl(write_fd.fd_, FICLONE, read_fd.fd_) == 0;
+}
+#endif  // ASAP_FS_USE_FICLONE
+
+#if ASAP_FS_USE_COPY_FILE_RANGE
+// Copy the data inside the kernel and let the filesystem optimize the copy
+// (server side copy for NFS/CIFS, reflinks, ...).
+auto do_copy_file_range(FileDescriptor &read_fd, FileDescriptor &write_fd,
+                        uintmax_t &count, std::error_code &ec) -> bool {
+  // Limit the size of each request so that we can handle interruptions and
+  // keep the size within the range of a ssize_t on all platforms.
+  constexpr uintmax_t COPY_FILE_RANGE_CHUNK = 1U << 30U;
+  bool first_request = true;
+  while (count > 0) {
+    const auto chunk =
+        static_cast<size_t>(std::min(count, COPY_FILE_RANGE_CHUNK));
+    auto res = detail::linux_port::copy_file_range(
+        read_fd.fd_, nullptr, write_fd.fd_, nullptr, chunk, 0);
+    if (res == -1) {
+      switch (errno) {
+        case EINTR:
+          continue;
+        // Not supported by the kernel or for this pair of files (e.g. files
+        // on different filesystems with older kernels).
+        case ENOSYS:
+        case EXDEV:
+        case EINVAL:
+        case EOPNOTSUPP:
+        case EBADF:
+        case EPERM:
+          return false;
+        default:
+          ec = capture_errno();
+          return false;
+      }
+    }
+    if (res == 0) {
+      // Some special filesystems (e.g. procfs) report a non-zero size but
+      // do not support copy_file_range and just return 0.
+      return !first_request;
+    }
+    first_request = false;
+    count -= static_cast<uintmax_t>(res);
+  }
+  return true;
+}
+#endif  // ASAP_FS_USE_COPY_FILE_RANGE
+
 #if ASAP_FS_USE_SENDFILE
 // NOTE:
-// The LINUX method using sendfile() has a major problem in that it can
-// not copy files more than 2GB in size!
+// sendfile() will transfer at most 0x7ffff000 (2,147,479,552) bytes per call,
+// returning the number of bytes actually transferred. (This is true on both
+// 32-bit and 64-bit systems.) Bigger files are copied with multiple calls.
 // http://man7.org/linux/man-pages/man2/sendfile.2.html
-//
-//    sendfile() will transfer at most 0x7ffff000 (2,147,479,552) bytes,
-//    returning the number of bytes actually transferred. (This is true on
-//    both 32-bit and 64-bit systems.)
 auto do_copy_file_sendfile(FileDescriptor &read_fd, FileDescriptor &write_fd,
-                           std::error_code &ec) -> bool {
-  const auto SENDFILE_MAX_BYTES = 0x7ffff000;
-  auto count = read_fd.PosixStatus().st_size;
-  if (count < 0 || count > SENDFILE_MAX_BYTES) {
-    return false;
-  }
-  do {
-    ssize_t res = 0;
-    if ((res = detail::linux_port::sendfile(write_fd.fd_, read_fd.fd_, nullptr,
-                                            static_cast<size_t>(count))) ==
-        -1) {
-      ec = capture_errno();
-      return false;
+                           uintmax_t &count, std::error_code &ec) -> bool {
+  constexpr uintmax_t SENDFILE_MAX_BYTES = 0x7ffff000;
+  bool first_request = true;
+  while (count > 0) {
+    const auto chunk =
+        static_cast<size_t>(std::min(count, SENDFILE_MAX_BYTES));
+    auto res = detail::linux_port::sendfile(write_fd.fd_, read_fd.fd_, nullptr,
+                                            chunk);
+    if (res == -1) {
+      switch (errno) {
+        case EINTR:
+          continue;
+        case ENOSYS:
+        case EINVAL:
+          return false;
+        default:
+          ec = capture_errno();
+          return false;
+      }
     }
-    count -= res;
-  } while (count > 0);
-
-  ec.clear();
-
+    if (res == 0) {
+      return !first_request;
+    }
+    first_request = false;
+    count -= static_cast<uintmax_t>(res);
+  }
   return true;
 }
-#elif ASAP_FS_USE_COPYFILE
+#endif  // ASAP_FS_USE_SENDFILE
+
+#if ASAP_FS_USE_COPYFILE
 bool do_copy_file_copyfile(FileDescriptor &read_fd, FileDescriptor &write_fd,
                            std::error_code &ec) {
   struct CopyFileState {
@@ -367,56 +672,274 @@ bool do_copy_file_copyfile(FileDescriptor &read_fd, FileDescriptor &write_fd,
 }
 #endif
 
+// A page aligned buffer for the userspace copy, allocated once per thread and
+// reused by all the copies made by that thread. It only grows when the
+// configured buffer size changes, so that copying many files does not
+// allocate anything past the first copy.
+class CopyBuffer {
+ public:
+  CopyBuffer() = default;
+  CopyBuffer(const CopyBuffer &) = delete;
+  auto operator=(const CopyBuffer &) -> CopyBuffer & = delete;
+  ~CopyBuffer() { std::free(data_); }
+
+  static auto ForThisThread() -> CopyBuffer & {
+    static thread_local CopyBuffer buffer;
+    return buffer;
+  }
+
+  // Make the buffer `size` bytes big, rounded up to a multiple of the page
+  // size. Returns false if the memory could not be allocated.
+  auto Reserve(size_t size) -> bool {
+    static const auto page_size = PageSize();
+    size = (size + page_size - 1) / page_size * page_size;
+    if (data_ != nullptr && size_ == size) {
+      return true;
+    }
+    std::free(data_);
+    data_ = nullptr;
+    size_ = 0;
+    void *data = nullptr;
+    if (detail::posix_port::posix_memalign(&data, page_size, size) != 0) {
+      return false;
+    }
+    data_ = static_cast<char *>(data);
+    size_ = size;
+    return true;
+  }
+
+  auto Data() const -> char * { return data_; }
+  auto Size() const -> size_t { return size_; }
+
+ private:
+  static auto PageSize() -> size_t {
+    const auto page_size = detail::posix_port::sysconf(_SC_PAGESIZE);
+    constexpr size_t DEFAULT_PAGE_SIZE = 4096;
+    return page_size > 0 ? static_cast<size_t>(page_size) : DEFAULT_PAGE_SIZE;
+  }
+
+  char *data_{nullptr};
+  size_t size_{0};
+};
+
+// Copy through a userspace buffer, stopping after `count` bytes or at the end
+// of the source file. This works with any kind of file and is always used as
+// the last resort.
 auto do_copy_file_default(FileDescriptor &read_fd, FileDescriptor &write_fd,
-                          std::error_code &ec) -> bool {
-  // BUFSIZ defaults to 8192
-  // BUFSIZ of  means one chareter at time
-  // good values should fit to blocksize, like 1024 or 4096
-  // higher values reduce number of system calls
-  // constexpr size_t BUFFER_SIZE = 4096;
-  char buf[BUFSIZ];
-  ssize_t size = 0;
-
-  while ((size = detail::posix_port::read(read_fd.fd_, buf, BUFSIZ)) > 0) {
-    if (detail::posix_port::write(write_fd.fd_, buf,
-                                  static_cast<size_t>(size)) < 0) {
+                          uintmax_t count, std::error_code &ec) -> bool {
+  auto &buffer = CopyBuffer::ForThisThread();
+  if (!buffer.Reserve(copy_buffer_size.load(std::memory_order_relaxed))) {
+    ec = std::make_error_code(std::errc::not_enough_memory);
+    return false;
+  }
+#if ASAP_FS_USE_POSIX_FADVISE
+  // Only a hint, the copy works the same if it is ignored.
+  detail::posix_port::posix_fadvise(read_fd.fd_, 0, 0,
+                                    POSIX_FADV_SEQUENTIAL);
+#endif
+
+  while (count > 0) {
+    const auto size = detail::posix_port::read(
+        read_fd.fd_, buffer.Data(),
+        static_cast<size_t>(std::min<uintmax_t>(count, buffer.Size())));
+    if (size == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
       ec = capture_errno();
       return false;
     }
+    if (size == 0) {
+      break;
+    }
+    // A write may be interrupted or only take part of the data (e.g. when the
+    // destination is a pipe), and must then be resumed for the remainder.
+    const char *data = buffer.Data();
+    auto left = static_cast<size_t>(size);
+    while (left > 0) {
+      const auto written =
+          detail::posix_port::write(write_fd.fd_, data, left);
+      if (written == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        ec = capture_errno();
+        return false;
+      }
+      data += written;
+      left -= static_cast<size_t>(written);
+    }
+    count -= static_cast<uintmax_t>(size);
   }
-  if (size == -1) {
+
+  ec.clear();
+  return true;
+}
+
+// Copy `count` bytes with the fastest method that works for the files.
+auto do_copy_file_data(FileDescriptor &from, FileDescriptor &to,
+                       uintmax_t count, copy_file_strategy &strategy,
+                       std::error_code &ec) -> bool {
+  if (!copy_in_userspace.load(std::memory_order_relaxed)) {
+#if ASAP_FS_USE_COPY_FILE_RANGE
+    if (do_copy_file_range(from, to, count, ec)) {
+      strategy = copy_file_strategy::copy_file_range;
+      return true;
+    }
+    if (ec) {
+      return false;
+    }
+#endif
+#if ASAP_FS_USE_SENDFILE
+    if (do_copy_file_sendfile(from, to, count, ec)) {
+      strategy = copy_file_strategy::sendfile;
+      return true;
+    }
+    if (ec) {
+      return false;
+    }
+#endif
+  }
+  if (do_copy_file_default(from, to, count, ec)) {
+    strategy = copy_file_strategy::read_write;
+    return true;
+  }
+  return false;
+}
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+// Copy only the data extents of a sparse file, leaving holes in the
+// destination where the source has holes. Returns false without setting `ec`
+// if the filesystem cannot report the holes. `strategy` is the one used for
+// the extents, only set once they are all copied.
+auto do_copy_file_sparse(FileDescriptor &from, FileDescriptor &to,
+                         copy_file_strategy &strategy, std::error_code &ec)
+    -> bool {
+  const auto size = from.PosixStatus().st_size;
+  // Holes only are made by ftruncate() below
+  auto extents_strategy = copy_file_strategy::read_write;
+  ::off_t data = 0;
+  while (data < size) {
+    data = detail::posix_port::lseek(from.fd_, data, SEEK_DATA);
+    if (data == -1) {
+      if (errno == ENXIO) {
+        // No more data until the end of the file
+        break;
+      }
+      if (errno == EINVAL) {
+        // SEEK_DATA is not supported by the filesystem. The first call
+        // did not move the offset and we can fall back to a normal copy.
+        return false;
+      }
+      ec = capture_errno();
+      return false;
+    }
+    auto hole = detail::posix_port::lseek(from.fd_, data, SEEK_HOLE);
+    if (hole == -1 ||
+        detail::posix_port::lseek(from.fd_, data, SEEK_SET) == -1 ||
+        detail::posix_port::lseek(to.fd_, data, SEEK_SET) == -1) {
+      ec = capture_errno();
+      return false;
+    }
+    if (!do_copy_file_data(from, to, static_cast<uintmax_t>(hole - data),
+                           extents_strategy, ec)) {
+      if (!ec) {
+        ec = std::make_error_code(std::errc::io_error);
+      }
+      return false;
+    }
+    data = hole;
+  }
+  // Trailing holes are not written, but still count in the file size.
+  if (detail::posix_port::ftruncate(to.fd_, size) != 0) {
     ec = capture_errno();
     return false;
   }
-
-  ec.clear();
+  strategy = extents_strategy;
   return true;
 }
+#endif  // SEEK_DATA && SEEK_HOLE
 #endif  // ASAP_WINDOWS
 
-auto do_copy_file(FileDescriptor &from, FileDescriptor &to, std::error_code &ec)
-    -> bool {
+auto do_copy_file(FileDescriptor &from, FileDescriptor &to,
+                  copy_file_strategy &strategy, std::error_code &ec) -> bool {
+  ec.clear();
 #if defined(ASAP_WINDOWS)
-  return do_copy_file_win32(from, to, ec);
+  return do_copy_file_win32(from, to, strategy, ec);
 #else  // ASAP_WINDOWS
-#if ASAP_FS_USE_SENDFILE
-  // Prefer to use sendfile when it is available.
-  // Check if sendfile cannot handle the large files and if so, fallback
-  // to copyfile() or default implementation.
-  if (do_copy_file_sendfile(from, to, ec)) {
+  const auto &from_stat = from.PosixStatus();
+  // Files reporting a size of 0 may still have contents (e.g. procfs), and
+  // can only be reliably copied by reading them until the end.
+  if (from_stat.st_size == 0) {
+    if (do_copy_file_default(from, to, static_cast<uintmax_t>(-1), ec)) {
+      strategy = copy_file_strategy::read_write;
+      return true;
+    }
+    return false;
+  }
+
+#if ASAP_FS_USE_FICLONE
+  if (!copy_in_userspace.load(std::memory_order_relaxed) &&
+      do_copy_file_clone(from, to)) {
+    strategy = copy_file_strategy::clone;
+    return true;
+  }
+#endif
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  // Files using less blocks than needed for their size have holes, which we
+  // preserve instead of filling them with zeroes in the destination.
+  constexpr ::off_t STAT_BLOCK_SIZE = 512;
+  if (from_stat.st_blocks * STAT_BLOCK_SIZE < from_stat.st_size) {
+    if (do_copy_file_sparse(from, to, strategy, ec)) {
+      return true;
+    }
+    if (ec) {
+      return false;
+    }
+  }
+#endif
+#if ASAP_FS_USE_COPYFILE
+  if (!copy_in_userspace.load(std::memory_order_relaxed) &&
+      do_copy_file_copyfile(from, to, ec)) {
+    strategy = copy_file_strategy::copyfile;
     return true;
   }
-#elif ASAP_FS_USE_COPYFILE
-  if (do_copy_file_copyfile(from, to, ec)) return true;
 #endif
-  return do_copy_file_default(from, to, ec);
+  return do_copy_file_data(from, to, static_cast<uintmax_t>(from_stat.st_size),
+                           strategy, ec);
 #endif  // ASAP_WINDOWS
 }
 
+// The strategy used by the last successful copy_file() on this thread.
+thread_local copy_file_strategy last_strategy = copy_file_strategy::none;
+
 }  // namespace
 
+auto last_copy_file_strategy() noexcept -> copy_file_strategy {
+  return last_strategy;
+}
+
+auto copy_file_buffer_size() noexcept -> std::size_t {
+  return copy_buffer_size.load(std::memory_order_relaxed);
+}
+
+void copy_file_buffer_size(std::size_t size) noexcept {
+  copy_buffer_size.store(
+      std::min(std::max(size, MIN_COPY_BUFFER_SIZE), MAX_COPY_BUFFER_SIZE),
+      std::memory_order_relaxed);
+}
+
+auto copy_file_in_userspace() noexcept -> bool {
+  return copy_in_userspace.load(std::memory_order_relaxed);
+}
+
+void copy_file_in_userspace(bool enabled) noexcept {
+  copy_in_userspace.store(enabled, std::memory_order_relaxed);
+}
+
 auto copy_file_impl(const path &from, const path &to, copy_options options,
                     std::error_code *ec) -> bool {
+  detail::InvalidateEntryOnExit invalidate_stat(to);
   ErrorHandler<bool> err("copy_file", ec, &to, &from);
 
   std::error_code m_ec;
@@ -486,6 +1009,7 @@ auto copy_file_impl(const path &from, const path &to, copy_options options,
     return err.report(capture_errno());
   }
 
+  last_strategy = copy_file_strategy::win32_copy_file;
   return true;
 #else   // ASAP_WINDOWS
   FileDescriptor from_fd =
@@ -584,18 +1108,21 @@ auto copy_file_impl(const path &from, const path &to, copy_options options,
     }
   }
 
-  if (!do_copy_file(from_fd, to_fd, m_ec)) {
+  auto strategy = copy_file_strategy::none;
+  if (!do_copy_file(from_fd, to_fd, strategy, m_ec)) {
     // FIXME: Remove the dest file if we failed, and it didn't exist
     // previously.
     return err.report(m_ec);
   }
 
+  last_strategy = strategy;
   return true;
 #endif  // ASAP_WINDOWS
 }
 
 void copy_symlink_impl(const path &existing_symlink, const path &new_symlink,
                        std::error_code *ec) {
+  detail::InvalidateEntryOnExit invalidate_stat(new_symlink);
   ErrorHandler<void> err("copy_symlink", ec, &existing_symlink, &new_symlink);
 
   std::error_code m_ec;
@@ -628,6 +1155,7 @@ void copy_symlink_impl(const path &existing_symlink, const path &new_symlink,
 // -----------------------------------------------------------------------------
 
 auto create_directories_impl(const path &p, std::error_code *ec) -> bool {
+  detail::ClearStatsOnExit clear_stats;
   ErrorHandler<bool> err("create_directories", ec, &p);
 
   if (p.empty()) {
@@ -688,6 +1216,7 @@ auto create_directories_impl(const path &p, std::error_code *ec) -> bool {
 }
 
 auto create_directory_impl(const path &p, std::error_code *ec) -> bool {
+  detail::InvalidateEntryOnExit invalidate_stat(p);
   ErrorHandler<bool> err("create_directory", ec, &p);
 #if defined(ASAP_WINDOWS)
   auto wpath = p.wstring();
@@ -711,6 +1240,7 @@ auto create_directory_impl(const path &p, std::error_code *ec) -> bool {
 
 auto create_directory_impl(path const &p, path const &existing_template,
                            std::error_code *ec) -> bool {
+  detail::InvalidateEntryOnExit invalidate_stat(p);
   ErrorHandler<bool> err("create_directory", ec, &p, &existing_template);
 #if defined(ASAP_WINDOWS)
   auto wpath = p.wstring();
@@ -752,6 +1282,7 @@ auto create_directory_impl(path const &p, path const &existing_template,
 
 void create_directory_symlink_impl(path const &target, path const &new_symlink,
                                    std::error_code *ec) {
+  detail::InvalidateEntryOnExit invalidate_stat(new_symlink);
   ErrorHandler<void> err("create_directory_symlink", ec, &target, &new_symlink);
 #if defined(ASAP_WINDOWS)
   auto link_wpath = new_symlink.wstring();
@@ -771,6 +1302,8 @@ void create_directory_symlink_impl(path const &target, path const &new_symlink,
 
 void create_hard_link_impl(const path &target, const path &new_hard_link,
                            std::error_code *ec) {
+  // The target gets one more link
+  detail::InvalidateEntryOnExit invalidate_stat(new_hard_link, &target);
   ErrorHandler<void> err("create_hard_link", ec, &target, &new_hard_link);
 #if defined(ASAP_WINDOWS)
   auto link_wpath = new_hard_link.wstring();
@@ -788,6 +1321,7 @@ void create_hard_link_impl(const path &target, const path &new_hard_link,
 
 void create_symlink_impl(path const &target, path const &new_symlink,
                          std::error_code *ec) {
+  detail::InvalidateEntryOnExit invalidate_stat(new_symlink);
   ErrorHandler<void> err("create_symlink", ec, &target, &new_symlink);
 #if defined(ASAP_WINDOWS)
   auto link_wpath = new_symlink.wstring();
@@ -832,17 +1366,20 @@ auto current_path_impl(std::error_code *ec) -> path {
 }
 
 void current_path_impl(const path &p, std::error_code *ec) {
+  // Relative paths now lead elsewhere
+  detail::ClearStatsOnExit clear_stats;
   ErrorHandler<void> err("current_path", ec, &p);
 #if defined(ASAP_WINDOWS)
   auto wpath = p.wstring();
   if (detail::win32_port::SetCurrentDirectoryW(wpath.c_str()) == 0) {
-    err.report(capture_errno());
+    return err.report(capture_errno());
   }
 #else
   if (detail::posix_port::chdir(p.c_str()) == -1) {
-    err.report(capture_errno());
+    return err.report(capture_errno());
   }
 #endif
+  CurrentPathCache::Instance().Drop();
 }
 
 // -----------------------------------------------------------------------------
@@ -947,7 +1484,7 @@ auto file_size_impl(const path &p, std::error_code *ec) -> uintmax_t {
 #else
   std::error_code m_ec;
   StatT st;
-  file_status fst = detail::posix_port::GetFileStatus(p, st, &m_ec);
+  file_status fst = detail::posix_port::GetCachedFileStatus(p, true, st, &m_ec);
   if (!exists(fst) || !is_regular_file(fst)) {
     std::errc error_kind = is_directory(fst) ? std::errc::is_a_directory
                                              : std::errc::not_supported;
@@ -1025,7 +1562,7 @@ auto is_empty_impl(const path &p, std::error_code *ec) -> bool {
 #else
   std::error_code m_ec;
   StatT pst;
-  auto st = detail::posix_port::GetFileStatus(p, pst, &m_ec);
+  auto st = detail::posix_port::GetCachedFileStatus(p, true, pst, &m_ec);
   if (m_ec) {
     return err.report(m_ec);
   }
@@ -1070,7 +1607,7 @@ auto last_write_time_impl(const path &p, std::error_code *ec)
 #else
   std::error_code m_ec;
   StatT st;
-  detail::posix_port::GetFileStatus(p, st, &m_ec);
+  detail::posix_port::GetCachedFileStatus(p, true, st, &m_ec);
   if (m_ec) {
     return err.report(m_ec);
   }
@@ -1080,6 +1617,7 @@ auto last_write_time_impl(const path &p, std::error_code *ec)
 
 void last_write_time_impl(const path &p, file_time_type new_time,
                           std::error_code *ec) {
+  detail::InvalidateStatOnExit invalidate_stat(p);
   ErrorHandler<void> err("last_write_time", ec, &p);
 
 #if defined(ASAP_WINDOWS)
@@ -1154,6 +1692,7 @@ void last_write_time_impl(const path &p, file_time_type new_time,
 
 void permissions_impl(const path &p, perms prms, perm_options opts,
                       std::error_code *ec) {
+  detail::InvalidateStatOnExit invalidate_stat(p);
   ErrorHandler<void> err("permissions", ec, &p);
 
   auto has_opt = [&](perm_options o) { return bool(o & opts); };
@@ -1238,6 +1777,7 @@ auto read_symlink_impl(const path &p, std::error_code *ec) -> path {
 // -----------------------------------------------------------------------------
 
 auto remove_impl(const path &p, std::error_code *ec) -> bool {
+  detail::InvalidateEntryOnExit invalidate_stat(p);
   ErrorHandler<bool> err("remove", ec, &p);
 
   // If the path is empty, nothing is deleted but no error is reported.
@@ -1289,6 +1829,265 @@ auto remove_impl(const path &p, std::error_code *ec) -> bool {
 
 namespace {
 
+#if ASAP_FS_USE_OPENAT
+// Directories are opened and their entries removed relative to their parent
+// directory, with openat() and unlinkat(). Unlike going through the full path
+// of each entry, this does not resolve the same parent directories again and
+// again in the kernel, and cannot be redirected out of the tree being removed
+// by a directory being swapped for a symlink in the middle of the operation.
+
+constexpr auto remove_all_npos = static_cast<uintmax_t>(-1);
+
+// What we need to know about a directory entry to remove it.
+enum class EntryKind { directory, other, unknown };
+
+auto GetEntryKind(const struct dirent *entry) -> EntryKind {
+  switch (entry->d_type) {
+    case DT_DIR:
+      return EntryKind::directory;
+    case DT_UNKNOWN:
+      // The filesystem does not report the type of the entries
+      return EntryKind::unknown;
+    default:
+      return EntryKind::other;
+  }
+}
+
+// Only used when the type of the entry is not in the directory entry.
+auto GetEntryKindAt(int dir_fd, const char *name, std::error_code &ec)
+    -> EntryKind {
+  StatT st{};
+  if (detail::posix_port::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) ==
+      -1) {
+    // An entry which does not exist anymore is as good as removed
+    if (errno != ENOENT) {
+      ec = capture_errno();
+    }
+    return EntryKind::other;
+  }
+  return S_ISDIR(st.st_mode) ? EntryKind::directory : EntryKind::other;
+}
+
+auto IsDotOrDotDot(const char *name) -> bool {
+  return name[0] == '.' &&
+         (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// Open the directory `name` in the directory `dir_fd` for reading, without
+// following symlinks. Returns nullptr without setting `ec` if `name` is not a
+// directory (anymore) or does not exist, so that it gets removed like a file.
+auto OpenDirectoryAt(int dir_fd, const char *name, std::error_code &ec)
+    -> DIR * {
+  const int fd = detail::posix_port::openat(
+      dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno != ENOTDIR && errno != ELOOP && errno != ENOENT) {
+      ec = capture_errno();
+    }
+    return nullptr;
+  }
+  DIR *dir = detail::posix_port::fdopendir(fd);
+  if (dir == nullptr) {
+    ec = capture_errno();
+    detail::posix_port::close(fd);
+  }
+  return dir;
+}
+
+// Next entry of the directory other than "." and "..", or nullptr at the end.
+auto ReadDirectory(DIR *dir, std::error_code &ec) -> struct dirent * {
+  struct dirent *entry = nullptr;
+  do {
+    errno = 0;
+    entry = detail::posix_port::readdir(dir);
+  } while (entry != nullptr && IsDotOrDotDot(entry->d_name));
+  if (entry == nullptr && errno != 0) {
+    ec = capture_errno();
+  }
+  return entry;
+}
+
+// Remove the entry `name` of the directory `dir_fd` and return the number of
+// entries removed. An entry removed by someone else in the meantime is not an
+// error.
+auto UnlinkAt(int dir_fd, const char *name, bool directory,
+              std::error_code &ec) -> uintmax_t {
+  if (detail::posix_port::unlinkat(dir_fd, name,
+                                   directory ? AT_REMOVEDIR : 0) == -1) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    ec = capture_errno();
+    return remove_all_npos;
+  }
+  return 1;
+}
+
+// Remove the entry `name` of the directory `dir_fd` and, if it is a directory,
+// all of its contents.
+auto RemoveAllAt(int dir_fd, const char *name, EntryKind kind,
+                 std::error_code &ec) -> uintmax_t {
+  if (kind == EntryKind::unknown) {
+    kind = GetEntryKindAt(dir_fd, name, ec);
+    if (ec) {
+      return remove_all_npos;
+    }
+  }
+  if (kind == EntryKind::directory) {
+    DIR *dir = OpenDirectoryAt(dir_fd, name, ec);
+    if (ec) {
+      return remove_all_npos;
+    }
+    if (dir != nullptr) {
+      const int child_fd = detail::posix_port::dirfd(dir);
+      uintmax_t count = 0;
+      while (auto *entry = ReadDirectory(dir, ec)) {
+        const auto removed =
+            RemoveAllAt(child_fd, entry->d_name, GetEntryKind(entry), ec);
+        if (ec) {
+          break;
+        }
+        count += removed;
+      }
+      detail::posix_port::closedir(dir);
+      if (ec) {
+        return remove_all_npos;
+      }
+      const auto removed = UnlinkAt(dir_fd, name, true, ec);
+      return ec ? remove_all_npos : count + removed;
+    }
+  }
+  return UnlinkAt(dir_fd, name, false, ec);
+}
+
+// Removes a directory tree with the directories emptied concurrently. Each
+// directory is listed by one task, which removes the files it contains and
+// schedules a task for each of its subdirectories. Whichever of these tasks
+// completes last removes the directory itself.
+class ParallelRemove {
+ public:
+  explicit ParallelRemove(const parallel_policy &policy) : tasks_(policy) {}
+
+  auto Run(const path &p, std::error_code &ec) -> uintmax_t {
+    Schedule(std::make_shared<Directory>(nullptr, p.native()));
+    tasks_.Wait();
+    std::lock_guard<std::mutex> lock(mutex_);
+    ec = error_;
+    return ec ? remove_all_npos : count_.load();
+  }
+
+ private:
+  struct Directory {
+    Directory(std::shared_ptr<Directory> parent_dir, std::string dir_name)
+        : parent(std::move(parent_dir)), name(std::move(dir_name)) {}
+    Directory(const Directory &) = delete;
+    auto operator=(const Directory &) -> Directory & = delete;
+    ~Directory() {
+      if (stream != nullptr) {
+        detail::posix_port::closedir(stream);
+      }
+    }
+
+    auto ParentFd() const -> int {
+      return parent ? detail::posix_port::dirfd(parent->stream) : AT_FDCWD;
+    }
+
+    // Keeps the parent directory open until all its subdirectories are gone
+    const std::shared_ptr<Directory> parent;
+    const std::string name;
+    DIR *stream{nullptr};
+    // The listing of this directory plus its subdirectories not yet removed
+    std::atomic<std::size_t> pending{1};
+  };
+
+  void Schedule(std::shared_ptr<Directory> dir) {
+    tasks_.Run([this, dir]() {
+      std::error_code ec;
+      if (!failed_) {
+        Empty(dir, ec);
+      }
+      if (ec) {
+        Fail(ec);
+      }
+      Done(dir);
+    });
+  }
+
+  void Empty(const std::shared_ptr<Directory> &dir, std::error_code &ec) {
+    const int parent_fd = dir->ParentFd();
+    dir->stream = OpenDirectoryAt(parent_fd, dir->name.c_str(), ec);
+    if (dir->stream == nullptr) {
+      if (!ec) {
+        // Not a directory anymore, it is removed like any other file
+        const auto removed = UnlinkAt(parent_fd, dir->name.c_str(), false, ec);
+        count_ += ec ? 0 : removed;
+      }
+      return;
+    }
+    const int dir_fd = detail::posix_port::dirfd(dir->stream);
+    while (auto *entry = ReadDirectory(dir->stream, ec)) {
+      if (failed_) {
+        return;
+      }
+      auto kind = GetEntryKind(entry);
+      if (kind == EntryKind::unknown) {
+        kind = GetEntryKindAt(dir_fd, entry->d_name, ec);
+        if (ec) {
+          return;
+        }
+      }
+      if (kind == EntryKind::directory) {
+        ++dir->pending;
+        Schedule(std::make_shared<Directory>(dir, entry->d_name));
+      } else {
+        const auto removed = UnlinkAt(dir_fd, entry->d_name, false, ec);
+        if (ec) {
+          return;
+        }
+        count_ += removed;
+      }
+    }
+  }
+
+  // Called when the listing of `dir` or the removal of one of its
+  // subdirectories is complete. Removes the directories which are now empty.
+  void Done(std::shared_ptr<Directory> dir) {
+    while (dir && --dir->pending == 0) {
+      if (dir->stream != nullptr) {
+        detail::posix_port::closedir(dir->stream);
+        dir->stream = nullptr;
+        if (!failed_) {
+          std::error_code ec;
+          const auto removed =
+              UnlinkAt(dir->ParentFd(), dir->name.c_str(), true, ec);
+          if (ec) {
+            Fail(ec);
+          } else {
+            count_ += removed;
+          }
+        }
+      }
+      dir = dir->parent;
+    }
+  }
+
+  void Fail(const std::error_code &ec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+      error_ = ec;
+      failed_ = true;
+    }
+  }
+
+  std::atomic<uintmax_t> count_{0};
+  std::atomic<bool> failed_{false};
+  std::mutex mutex_;
+  std::error_code error_;
+
+  // Last, so that the tasks are done before the state they use is destroyed
+  detail::TaskGroup tasks_;
+};
+#else
 auto do_remove_all_impl(path const &p, std::error_code &ec) -> uintmax_t {
   const auto npos = static_cast<uintmax_t>(-1);
   const file_status st = symlink_status_impl(p, &ec);
@@ -1314,10 +2113,12 @@ auto do_remove_all_impl(path const &p, std::error_code &ec) -> uintmax_t {
   }
   return count;
 }
+#endif  // ASAP_FS_USE_OPENAT
 
 }  // end namespace
 
 auto remove_all_impl(const path &p, std::error_code *ec) -> uintmax_t {
+  detail::ClearStatsOnExit clear_stats;
   ErrorHandler<uintmax_t> err("remove_all", ec, &p);
 
   // If the path is empty, nothing is deleted but no error is reported.
@@ -1326,7 +2127,11 @@ auto remove_all_impl(const path &p, std::error_code *ec) -> uintmax_t {
   }
 
   std::error_code mec;
+#if ASAP_FS_USE_OPENAT
+  auto count = RemoveAllAt(AT_FDCWD, p.c_str(), EntryKind::unknown, mec);
+#else
   auto count = do_remove_all_impl(p, mec);
+#endif
   if (mec) {
     if (mec == std::errc::no_such_file_or_directory) {
       return 0;
@@ -1336,11 +2141,41 @@ auto remove_all_impl(const path &p, std::error_code *ec) -> uintmax_t {
   return count;
 }
 
+auto remove_all_impl(const path &p, const parallel_policy &policy,
+                     std::error_code *ec) -> uintmax_t {
+  detail::ClearStatsOnExit clear_stats;
+#if ASAP_FS_USE_OPENAT
+  ErrorHandler<uintmax_t> err("remove_all", ec, &p);
+
+  // If the path is empty, nothing is deleted but no error is reported.
+  if (p.empty()) {
+    return 0;
+  }
+
+  std::error_code mec;
+  auto count = ParallelRemove(policy).Run(p, mec);
+  if (mec) {
+    if (mec == std::errc::no_such_file_or_directory) {
+      return 0;
+    }
+    return err.report(mec);
+  }
+  return count;
+#else
+  // Subdirectories can only be safely removed concurrently relative to their
+  // parent directory.
+  (void)policy;
+  return remove_all_impl(p, ec);
+#endif  // ASAP_FS_USE_OPENAT
+}
+
 // -----------------------------------------------------------------------------
 //                               rename
 // -----------------------------------------------------------------------------
 
 void rename_impl(const path &from, const path &to, std::error_code *ec) {
+  // Everything below `from` moves too
+  detail::ClearStatsOnExit clear_stats;
   ErrorHandler<void> err("rename", ec, &from, &to);
   if (::rename(from.c_str(), to.c_str()) == -1) {
     err.report(capture_errno());
@@ -1352,6 +2187,7 @@ void rename_impl(const path &from, const path &to, std::error_code *ec) {
 // -----------------------------------------------------------------------------
 
 void resize_file_impl(const path &p, uintmax_t size, std::error_code *ec) {
+  detail::InvalidateStatOnExit invalidate_stat(p);
   ErrorHandler<void> err("resize_file", ec, &p);
 #if defined(ASAP_WINDOWS)
   std::error_code m_ec;
@@ -1481,7 +2317,7 @@ auto status_impl(const path &p, std::error_code *ec) -> file_status {
              : file_status(file_type::regular, prms);
 #else
   StatT path_stat;
-  return detail::posix_port::GetFileStatus(p, path_stat, ec);
+  return detail::posix_port::GetCachedFileStatus(p, true, path_stat, ec);
 #endif
 }
 
@@ -1512,10 +2348,213 @@ auto symlink_status_impl(const path &p, std::error_code *ec) -> file_status {
              : file_status(file_type::regular, prms);
 #else
   StatT path_stat;
-  return detail::posix_port::GetLinkStatus(p, path_stat, ec);
+  return detail::posix_port::GetCachedFileStatus(p, false, path_stat, ec);
 #endif
 }
 
+// -----------------------------------------------------------------------------
+//                               status_many
+// -----------------------------------------------------------------------------
+
+namespace {
+
+// Fetches the attributes of `p` into `result`. On POSIX systems, `p` is looked
+// up as `name` relative to the open directory `dir_fd` when it is not -1.
+void StatusOne(int dir_fd, const char *name, const path &p,
+               status_fields fields, status_result &result) {
+  result = status_result{};
+  const bool want_size = (fields & status_fields::size) != status_fields::none;
+  const bool want_time =
+      (fields & status_fields::last_write_time) != status_fields::none;
+#if defined(ASAP_WINDOWS)
+  (void)dir_fd;
+  (void)name;
+  result.status = status_impl(p, &result.ec);
+  if (result.ec) {
+    return;
+  }
+  std::error_code m_ec;
+  if (want_size && is_regular_file(result.status)) {
+    result.size = file_size_impl(p, &m_ec);
+  }
+  if (want_time) {
+    result.last_write_time = last_write_time_impl(p, &result.ec);
+  }
+#else
+  unsigned stat_fields = 0;
+  if (want_size) {
+    stat_fields |= detail::posix_port::STAT_SIZE;
+  }
+  if (want_time) {
+    stat_fields |= detail::posix_port::STAT_MTIME;
+  }
+  detail::posix_port::FileStat file_stat;
+#if defined(ASAP_FS_USE_OPENAT)
+  if (dir_fd != -1) {
+    result.status = detail::posix_port::GetFileStatAt(
+        dir_fd, name, p, true, stat_fields, false, file_stat, &result.ec);
+  } else
+#else
+  (void)dir_fd;
+  (void)name;
+#endif  // ASAP_FS_USE_OPENAT
+  {
+    result.status = detail::posix_port::GetFileStat(p, true, stat_fields, false,
+                                                    file_stat, &result.ec);
+  }
+  if (result.ec) {
+    return;
+  }
+  if (want_size && is_regular_file(result.status)) {
+    result.size = static_cast<uintmax_t>(file_stat.st.st_size);
+  }
+  if (want_time) {
+    result.last_write_time =
+        detail::posix_port::ExtractLastWriteTime(p, file_stat.st, &result.ec);
+  }
+#endif  // ASAP_WINDOWS
+}
+
+#if defined(ASAP_FS_USE_OPENAT)
+// Below this many paths in the same directory, opening the directory costs
+// more than it saves.
+constexpr std::size_t MIN_PATHS_PER_DIRECTORY = 2;
+
+// Paths without a directory of their own are handed out in chunks of this
+// many to the tasks of a parallel status_many().
+constexpr std::size_t PATHS_PER_TASK = 64;
+
+// The offset of the file name in `p`, or std::string::npos when `p` cannot be
+// looked up as a name in its parent directory, e.g. when it has no parent,
+// ends with a separator, or ends with "." or "..".
+auto FileNameOffset(const path &p) -> std::size_t {
+  const auto &str = p.native();
+  const auto slash = str.rfind('/');
+  if (slash == std::string::npos) {
+    return std::string::npos;
+  }
+  const auto *name = str.c_str() + slash + 1;
+  if (name[0] == '\0' ||
+      (name[0] == '.' &&
+       (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))) {
+    return std::string::npos;
+  }
+  return slash + 1;
+}
+
+// A path of a status_many(), by its index, and the offset of its file name.
+using StatusEntry = std::pair<std::size_t, std::size_t>;
+
+// The paths of a status_many(), split in the ones looked up relative to their
+// directory, grouped by directory, and the ones looked up by their full path.
+struct StatusBatches {
+  std::vector<std::vector<StatusEntry>> directories;
+  std::vector<std::size_t> others;
+};
+
+void StatusDirectory(const path *paths, status_fields fields,
+                     status_result *results,
+                     const std::vector<StatusEntry> &entries) {
+  const auto &first = paths[entries.front().first].native();
+  const auto offset = entries.front().second;
+  // The root directory keeps its separator
+  const std::string dir(first, 0, offset == 1 ? 1 : offset - 1);
+  // Only search permission is needed to look up names in the directory
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#if defined(O_PATH)
+  flags |= O_PATH;
+#endif
+  // When the directory cannot be opened, the full paths are used instead,
+  // which reports the error on each of them.
+  const int dir_fd = detail::posix_port::open(dir.c_str(), flags);
+  for (const auto &entry : entries) {
+    const auto &p = paths[entry.first];
+    StatusOne(dir_fd, p.c_str() + entry.second, p, fields,
+              results[entry.first]);
+  }
+  if (dir_fd != -1) {
+    detail::posix_port::close(dir_fd);
+  }
+}
+
+auto MakeStatusBatches(const path *paths, std::size_t count) -> StatusBatches {
+  StatusBatches batches;
+  std::vector<StatusEntry> entries;
+  entries.reserve(count);
+  for (std::size_t index = 0; index < count; ++index) {
+    const auto offset = FileNameOffset(paths[index]);
+    if (offset == std::string::npos) {
+      batches.others.push_back(index);
+    } else {
+      entries.emplace_back(index, offset);
+    }
+  }
+  // Group by directory, and keep the order of the paths within a directory
+  const auto directory_less = [paths](const StatusEntry &lhs,
+                                      const StatusEntry &rhs) {
+    return paths[lhs.first].native().compare(
+               0, lhs.second, paths[rhs.first].native(), 0, rhs.second) < 0;
+  };
+  std::stable_sort(entries.begin(), entries.end(), directory_less);
+  for (auto first = entries.begin(); first != entries.end();) {
+    auto last = first + 1;
+    while (last != entries.end() && !directory_less(*first, *last)) {
+      ++last;
+    }
+    if (static_cast<std::size_t>(last - first) >= MIN_PATHS_PER_DIRECTORY) {
+      batches.directories.emplace_back(first, last);
+    } else {
+      for (auto entry = first; entry != last; ++entry) {
+        batches.others.push_back(entry->first);
+      }
+    }
+    first = last;
+  }
+  return batches;
+}
+#endif  // ASAP_FS_USE_OPENAT
+
+}  // namespace
+
+void status_many_impl(const path *paths, std::size_t count,
+                      status_fields fields, status_result *results,
+                      const parallel_policy *policy) {
+#if defined(ASAP_FS_USE_OPENAT)
+  const auto batches = MakeStatusBatches(paths, count);
+  if (policy == nullptr) {
+    for (const auto &entries : batches.directories) {
+      StatusDirectory(paths, fields, results, entries);
+    }
+    for (const auto index : batches.others) {
+      StatusOne(-1, nullptr, paths[index], fields, results[index]);
+    }
+    return;
+  }
+  detail::TaskGroup tasks(*policy);
+  for (const auto &entries : batches.directories) {
+    tasks.Run([paths, fields, results, &entries]() {
+      StatusDirectory(paths, fields, results, entries);
+    });
+  }
+  const auto &others = batches.others;
+  for (std::size_t first = 0; first < others.size(); first += PATHS_PER_TASK) {
+    tasks.Run([paths, fields, results, &others, first]() {
+      const auto last = std::min(first + PATHS_PER_TASK, others.size());
+      for (auto index = first; index < last; ++index) {
+        StatusOne(-1, nullptr, paths[others[index]], fields,
+                  results[others[index]]);
+      }
+    });
+  }
+  tasks.Wait();
+#else
+  (void)policy;
+  for (std::size_t index = 0; index < count; ++index) {
+    StatusOne(-1, nullptr, paths[index], fields, results[index]);
+  }
+#endif  // ASAP_FS_USE_OPENAT
+}
+
 // -----------------------------------------------------------------------------
 //                               temp_directory_path
 // -----------------------------------------------------------------------------
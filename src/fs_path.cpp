@@ -22,95 +22,196 @@ namespace {
 constexpr path::value_type dot = '.';
 }
 
-void path::SplitComponents() {
-  components_.clear();
-  if (pathname_.empty()) {
-    type_ = Type::FILENAME;
-    return;
+class path::ComponentScanner {
+ public:
+  explicit ComponentScanner(const string_type &pathname) noexcept
+      : pathname_(pathname) {}
+
+  // Gets the next component into `cmpt`, or returns false when there is none
+  // left.
+  auto Next(Component &cmpt) noexcept -> bool;
+
+ private:
+  enum class Stage : unsigned char {
+    ROOT_NAME,
+    ROOT_DIR,
+    FILENAMES,
+    TRAILING,
+    DONE
+  };
+
+  void SkipSeparators() noexcept {
+    while (pos_ < pathname_.size() && IsDirSeparator(pathname_[pos_])) {
+      ++pos_;
+    }
   }
-  type_ = Type::MULTI;
 
-  size_t pos = 0;
-  const size_t len = pathname_.size();
+  const string_type &pathname_;
+  size_t pos_{0};
+  Stage stage_{Stage::ROOT_NAME};
+};
 
-  // look for root name or root directory
-  if (IsDirSeparator(pathname_[0])) {
+auto path::ComponentScanner::Next(Component &cmpt) noexcept -> bool {
+  const auto len = pathname_.size();
+  if (stage_ == Stage::ROOT_NAME) {
+    stage_ = Stage::ROOT_DIR;
 #ifdef ASAP_WINDOWS
-    // look for root name, such as "//foo"
-    if (len > 2 && pathname_[1] == pathname_[0]) {
-      if (!IsDirSeparator(pathname_[2])) {
-        // got root name, find its end
-        pos = 3;
-        while (pos < len && !IsDirSeparator(pathname_[pos])) {
-          ++pos;
-        }
-        AddRootName(pos);
-        if (pos < len) {  // also got root directory
-          AddRootDir(pos);
-        }
-      } else {
-        // got something like "///foo" which is just a root directory
-        // composed of multiple redundant directory separators
-        AddRootDir(0);
-      }
-    } else
-#endif
-    {
-      // got root directory
-      if (pathname_.find_first_not_of('/') == string_type::npos) {
-        // entire path is just slashes
-        type_ = Type::ROOT_DIR;
-        AddRootDir(0);
-        Trim();
-        return;
+    if (len > 2 && IsDirSeparator(pathname_[0]) &&
+        pathname_[1] == pathname_[0] && !IsDirSeparator(pathname_[2])) {
+      // got root name, such as "//foo", find its end
+      pos_ = 3;
+      while (pos_ < len && !IsDirSeparator(pathname_[pos_])) {
+        ++pos_;
       }
-      AddRootDir(0);
-      ++pos;
+      cmpt = {0, pos_, Type::ROOT_NAME};
+      return true;
+    }
+    if (len > 1 && !IsDirSeparator(pathname_[0]) && pathname_[1] == ':') {
+      // got disk designator
+      pos_ = 2;
+      cmpt = {0, pos_, Type::ROOT_NAME};
+      return true;
     }
+#endif
   }
-#ifdef ASAP_WINDOWS
-  else if (len > 1 && pathname_[1] == ':') {
-    // got disk designator
-    AddRootName(2);
-    if (len > 2 && IsDirSeparator(pathname_[2])) {
-      AddRootDir(2);
+  if (stage_ == Stage::ROOT_DIR) {
+    stage_ = Stage::FILENAMES;
+    if (pos_ < len && IsDirSeparator(pathname_[pos_])) {
+      // got root directory, possibly made of redundant separators
+      cmpt = {pos_, 1, Type::ROOT_DIR};
+      SkipSeparators();
+      return true;
     }
-    pos = 2;
   }
-#endif
-
-  size_t back = pos;
-  while (pos < len) {
-    if (IsDirSeparator(pathname_[pos])) {
-      if (back != pos) {
-        AddFilename(back, pos - back);
-      }
-      back = ++pos;
-    } else {
-      ++pos;
+  if (stage_ == Stage::FILENAMES) {
+    if (pos_ == len) {
+      stage_ = Stage::DONE;
+      return false;
+    }
+    const auto start = pos_;
+    while (pos_ < len && !IsDirSeparator(pathname_[pos_])) {
+      ++pos_;
     }
+    cmpt = {start, pos_ - start, Type::FILENAME};
+    SkipSeparators();
+    if (pos_ == len && cmpt.pos_ + cmpt.len_ != len) {
+      stage_ = Stage::TRAILING;
+    }
+    return true;
   }
-
-  if (back != pos) {
-    AddFilename(back, pos - back);
-  } else if (IsDirSeparator(pathname_.back())) {
+  if (stage_ == Stage::TRAILING) {
     // [fs.path.itr]/4
     // An empty element, if trailing non-root directory-separator present.
-    if (components_.back().type_ == Type::FILENAME) {
-      pos = pathname_.size();
-      components_.emplace_back(string_type(), Type::FILENAME, pos);
+    stage_ = Stage::DONE;
+    cmpt = {len, 0, Type::FILENAME};
+    return true;
+  }
+  return false;
+}
+
+path::path(const path &p) : pathname_(p.pathname_), type_(p.type_) {}
+
+path::~path() { DropComponents(); }
+
+auto path::operator=(const path &p) -> path & {
+  if (this != &p) {
+    pathname_ = p.pathname_;
+    type_ = p.type_;
+    DropComponents();
+  }
+  return *this;
+}
+
+void path::SplitComponents() {
+  DropComponents();
+  if (pathname_.empty()) {
+    type_ = Type::FILENAME;
+    return;
+  }
+
+  // A path with a single component has the type of that component
+  ComponentScanner scanner(pathname_);
+  Component first;
+  Component second;
+  scanner.Next(first);
+  if (scanner.Next(second)) {
+    type_ = Type::MULTI;
+    return;
+  }
+  type_ = first.type_;
+  if (type_ != Type::FILENAME) {
+    // Trim the redundant separators of a root, and use the preferred ones
+    string_type trimmed;
+    AppendComponent(trimmed, first);
+    pathname_.swap(trimmed);
+  }
+}
+
+auto path::Components() const -> const ComponentList & {
+  auto *components = components_.load(std::memory_order_acquire);
+  if (components == nullptr) {
+    std::unique_ptr<ComponentList> built(new ComponentList());
+    ComponentScanner scanner(pathname_);
+    Component cmpt;
+    while (scanner.Next(cmpt)) {
+      built->push_back(ComponentPath(cmpt));
+    }
+    // Another thread iterating the same path may have been faster
+    if (components_.compare_exchange_strong(components, built.get(),
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+      components = built.release();
     }
   }
+  return *components;
+}
 
-  Trim();
+void path::DropComponents() noexcept {
+  delete components_.exchange(nullptr, std::memory_order_relaxed);
 }
 
-void path::Trim() {
-  if (components_.size() == 1) {
-    auto &component = components_.front();
-    type_ = component.type_;
-    pathname_ = component.pathname_;
-    components_.clear();
+auto path::FirstComponent() const noexcept -> Component {
+  Component cmpt{0, 0, Type::FILENAME};
+  ComponentScanner scanner(pathname_);
+  scanner.Next(cmpt);
+  return cmpt;
+}
+
+auto path::LastComponents() const noexcept
+    -> std::pair<Component, Component> {
+  std::pair<Component, Component> last{{0, 0, Type::FILENAME},
+                                       {0, 0, Type::FILENAME}};
+  ComponentScanner scanner(pathname_);
+  Component cmpt;
+  while (scanner.Next(cmpt)) {
+    last.first = last.second;
+    last.second = cmpt;
+  }
+  return last;
+}
+
+void path::FindRoot(Component &root_name, Component &root_dir) const noexcept {
+  root_name = {0, 0, Type::ROOT_NAME};
+  root_dir = {0, 0, Type::ROOT_DIR};
+  if (type_ == Type::ROOT_NAME) {
+    root_name.len_ = pathname_.size();
+  } else if (type_ == Type::ROOT_DIR) {
+    root_dir.len_ = pathname_.size();
+  } else if (type_ == Type::MULTI) {
+    ComponentScanner scanner(pathname_);
+    Component cmpt;
+    if (!scanner.Next(cmpt)) {
+      return;
+    }
+    if (cmpt.type_ == Type::ROOT_NAME) {
+      root_name = cmpt;
+      if (!scanner.Next(cmpt)) {
+        return;
+      }
+    }
+    if (cmpt.type_ == Type::ROOT_DIR) {
+      root_dir = cmpt;
+    }
   }
 }
 
@@ -120,7 +221,9 @@ void path::Trim() {
 
 auto path::operator=(path &&p) noexcept -> path & {
   pathname_ = std::move(p.pathname_);
-  components_ = std::move(p.components_);
+  DropComponents();
+  components_.store(p.components_.exchange(nullptr, std::memory_order_relaxed),
+                    std::memory_order_relaxed);
   type_ = p.type_;
   p.clear();
   return *this;
@@ -140,23 +243,27 @@ auto path::assign(string_type &&source) -> path & {
 
 auto path::has_stem() const -> bool {
   auto ext = FindExtension();
-  return ext.first != nullptr;
+  return ext.first != string_type::npos;
 }
 
 auto path::has_extension() const -> bool {
   auto ext = FindExtension();
-  return (ext.first != nullptr) && ext.second != string_type::npos &&
+  return ext.first != string_type::npos && ext.second != string_type::npos &&
          ext.second != 0;
 }
 
 auto path::has_root_name() const -> bool {
-  return (type_ == Type::ROOT_NAME) ||
-         (!components_.empty() &&
-          components_.begin()->type_ == Type::ROOT_NAME);
+  Component root_name;
+  Component root_dir;
+  FindRoot(root_name, root_dir);
+  return root_name.len_ != 0;
 }
 
 auto path::has_root_directory() const -> bool {
-  return !root_directory().empty();
+  Component root_name;
+  Component root_dir;
+  FindRoot(root_name, root_dir);
+  return root_dir.len_ != 0;
 }
 
 auto path::has_root_path() const -> bool { return !root_path().empty(); }
@@ -167,7 +274,17 @@ auto path::has_relative_path() const -> bool {
 
 auto path::has_parent_path() const -> bool { return !parent_path().empty(); }
 
-auto path::has_filename() const -> bool { return !filename().empty(); }
+auto path::has_filename() const -> bool {
+  if (empty()) {
+    return false;
+  }
+  if (type_ == Type::FILENAME) {
+    return true;
+  }
+  // The last component of a MULTI path is a filename, empty when the path ends
+  // with a separator.
+  return type_ == Type::MULTI && !IsDirSeparator(pathname_.back());
+}
 
 auto path::is_absolute() const -> bool {
 // NOTE: //foo is absolute because we can't express relative paths on top of it
@@ -197,9 +314,11 @@ auto path::root_name() const -> path {
   path ret;
   if (type_ == Type::ROOT_NAME) {
     ret = *this;
-  } else if (!components_.empty() &&
-             components_.begin()->type_ == Type::ROOT_NAME) {
-    ret = *components_.begin();
+  } else if (type_ == Type::MULTI) {
+    const auto first = FirstComponent();
+    if (first.type_ == Type::ROOT_NAME) {
+      ret = ComponentPath(first);
+    }
   }
   return ret;
 }
@@ -208,18 +327,12 @@ auto path::root_directory() const -> path {
   path ret;
   if (type_ == Type::ROOT_DIR) {
     ret = *this;
-  } else if (type_ == Type::ROOT_NAME) {
-    // Check for windows special case of drive letter
-    if (pathname_[1] == ':') {
-      ret = path("");
-    }
-  } else if (!components_.empty()) {
-    auto it = components_.begin();
-    if (it->type_ == Type::ROOT_NAME) {
-      ++it;
-    }
-    if (it != components_.end() && it->type_ == Type::ROOT_DIR) {
-      ret = *it;
+  } else if (type_ == Type::MULTI) {
+    Component root_name;
+    Component root_dir;
+    FindRoot(root_name, root_dir);
+    if (root_dir.len_ != 0) {
+      ret = ComponentPath(root_dir);
     }
   }
   return ret;
@@ -229,16 +342,18 @@ auto path::root_path() const -> path {
   path ret;
   if (type_ == Type::ROOT_NAME || type_ == Type::ROOT_DIR) {
     ret = *this;
-  } else if (!components_.empty()) {
-    auto it = components_.begin();
-    if (it->type_ == Type::ROOT_NAME) {
-      ret = *it++;
-      if (it != components_.end() && it->type_ == Type::ROOT_DIR) {
+  } else if (type_ == Type::MULTI) {
+    Component root_name;
+    Component root_dir;
+    FindRoot(root_name, root_dir);
+    if (root_name.len_ != 0) {
+      ret = ComponentPath(root_name);
+      if (root_dir.len_ != 0) {
         ret.pathname_ += preferred_separator;
         ret.SplitComponents();
       }
-    } else if (it->type_ == Type::ROOT_DIR) {
-      ret = *it;
+    } else if (root_dir.len_ != 0) {
+      ret = ComponentPath(root_dir);
     }
   }
   return ret;
@@ -248,16 +363,14 @@ auto path::relative_path() const -> path {
   path ret;
   if (type_ == Type::FILENAME) {
     ret = *this;
-  } else if (!components_.empty()) {
-    auto it = components_.begin();
-    if (it->type_ == Type::ROOT_NAME) {
-      ++it;
-    }
-    if (it != components_.end() && it->type_ == Type::ROOT_DIR) {
-      ++it;
-    }
-    if (it != components_.end()) {
-      ret.assign(pathname_.substr(it->pos_));
+  } else if (type_ == Type::MULTI) {
+    ComponentScanner scanner(pathname_);
+    Component cmpt;
+    while (scanner.Next(cmpt)) {
+      if (cmpt.type_ == Type::FILENAME) {
+        ret.assign(pathname_.substr(cmpt.pos_));
+        break;
+      }
     }
   }
   return ret;
@@ -269,28 +382,28 @@ auto path::parent_path() const -> path {
   }
 
   if (type_ == Type::MULTI) {
-    ASAP_ASSERT(!components_.empty());
-    path ret = *this;
     // Remove the end component
     // Note that if the end component is the empty path, we need to remove
     // the component preceding it as well. The empty path as a component
     // indicates that the previous component is a directory and it was followed
     // with a separator in the path name.
-    auto last = std::prev(ret.components_.end());
-    if (last->pathname_.empty()) {
-      last = std::prev(last);
-    }
-    ret.components_.erase(last, ret.components_.end());
-    ret.pathname_.clear();
-    auto components_size = ret.components_.size();
-    auto component_index = 1U;
-    for (const auto &comp : ret.components_) {
-      ret.pathname_.append(comp.pathname_);
-      if (component_index < components_size) {
+    size_t count = 0;
+    Component cmpt;
+    ComponentScanner counter(pathname_);
+    while (counter.Next(cmpt)) {
+      ++count;
+    }
+    count -= cmpt.len_ == 0 ? 2 : 1;
+
+    path ret;
+    ComponentScanner scanner(pathname_);
+    for (size_t index = 0; index < count && scanner.Next(cmpt); ++index) {
+      if (index != 0) {
         ret.AppendSeparatorIfNeeded();
       }
-      ++component_index;
+      AppendComponent(ret.pathname_, cmpt);
     }
+    ret.SplitComponents();
     return ret;
   }
   return {};
@@ -303,87 +416,89 @@ auto path::filename() const -> path {
   if (type_ == Type::FILENAME) {
     return *this;
   }
-  if (type_ == Type::MULTI) {
-    if (pathname_.back() == preferred_separator) {
-      return {};
-    }
-    const auto &last = *--end();
-    if (last.type_ == Type::FILENAME) {
-      return last;
-    }
+  if (type_ == Type::MULTI && !IsDirSeparator(pathname_.back())) {
+    return ComponentPath(LastComponents().second);
   }
   return {};
 }
 
 auto path::stem() const -> path {
   auto ext = FindExtension();
-  if (ext.first != nullptr) {
+  if (ext.first != string_type::npos) {
     if (ext.second == string_type::npos || ext.second == 0) {
-      return path{*ext.first};
+      return path{pathname_.substr(ext.first)};
     }
-    return path{ext.first->substr(0, ext.second)};
+    return path{pathname_.substr(ext.first, ext.second)};
   }
   return {};
 }
 
 auto path::extension() const -> path {
   auto ext = FindExtension();
-  if ((ext.first != nullptr) && ext.second != string_type::npos &&
+  if (ext.first != string_type::npos && ext.second != string_type::npos &&
       ext.second != 0) {
-    return path{ext.first->substr(ext.second)};
+    return path{pathname_.substr(ext.first + ext.second)};
   }
   return {};
 }
 
-auto path::FindExtension() const
-    -> std::pair<const path::string_type *, std::size_t> {
-  const string_type *s = nullptr;
+auto path::FindExtension() const -> std::pair<size_t, size_t> {
+  // The filename, if any, is always at the end of the path
+  auto filename_pos = string_type::npos;
 
   if (type_ == Type::FILENAME) {
-    s = &pathname_;
-  } else if (type_ == Type::MULTI && !components_.empty()) {
-    const auto &c = components_.back();
-    if (c.type_ == Type::FILENAME) {
-      s = &c.pathname_;
+    filename_pos = 0;
+  } else if (type_ == Type::MULTI && !empty()) {
+    const auto last = LastComponents().second;
+    if (last.type_ == Type::FILENAME) {
+      filename_pos = last.pos_;
     }
   }
 
-  if (s != nullptr) {
-    if (auto sz = s->size()) {
-      if (sz <= 2 && (*s)[0] == dot) {
-        return {s, string_type::npos};
+  if (filename_pos != string_type::npos) {
+    if (auto sz = pathname_.size() - filename_pos) {
+      if (sz <= 2 && pathname_[filename_pos] == dot) {
+        return {filename_pos, string_type::npos};
       }
-      const auto pos = s->rfind(dot);
-      return {s, pos != 0U ? pos : string_type::npos};
+      const auto pos = pathname_.rfind(dot);
+      if (pos == string_type::npos || pos <= filename_pos) {
+        return {filename_pos, string_type::npos};
+      }
+      return {filename_pos, pos - filename_pos};
     }
   }
-  return {};
+  return {string_type::npos, string_type::npos};
 }
 
 // End Decomposition -----------------------------------------------------------
 
-void path::AddRootName(size_t len) {
-  auto rootname = pathname_.substr(0, len);
+void path::AppendComponent(string_type &str, const Component &cmpt) const {
+  const auto start = str.size();
+  str.append(pathname_, cmpt.pos_, cmpt.len_);
 #if defined(ASAP_WINDOWS)
-  // Replace separator with preferred separator '\'
-  std::replace(rootname.begin(), rootname.end(), slash, preferred_separator);
+  // Replace separator with preferred separator '\' in the root
+  if (cmpt.type_ == Type::ROOT_NAME || cmpt.type_ == Type::ROOT_DIR) {
+    std::replace(str.begin() + start, str.end(), slash, preferred_separator);
+  }
+#else
+  (void)start;
 #endif
-  components_.emplace_back(rootname, Type::ROOT_NAME, 0);
 }
 
-void path::AddRootDir(size_t pos) {
-  auto rootdir = pathname_.substr(pos, 1);
-#if defined(ASAP_WINDOWS)
-  // Replace separator with preferred separator '\'
-  if (rootdir[0] == slash) {
-    rootdir[0] = preferred_separator;
-  }
-#endif
-  components_.emplace_back(rootdir, Type::ROOT_DIR, pos);
+auto path::ComponentPath(const Component &cmpt) const -> path {
+  string_type str;
+  AppendComponent(str, cmpt);
+  return {std::move(str), cmpt.type_};
 }
 
-void path::AddFilename(size_t pos, size_t len) {
-  components_.emplace_back(pathname_.substr(pos, len), Type::FILENAME, pos);
+void path::ReplaceTrailingFilename(size_t prefix_size, const value_type *name,
+                                   size_t len) {
+  ASAP_ASSERT(type_ == Type::MULTI);
+  pathname_.resize(prefix_size);
+  pathname_.append(name, len);
+  // Still at least two components with the same root, so only the components
+  // built by an iteration, if any, are out of date.
+  DropComponents();
 }
 
 //
@@ -392,14 +507,14 @@ void path::AddFilename(size_t pos, size_t len) {
 
 auto path::begin() const -> path::iterator {
   if (type_ == Type::MULTI) {
-    return {this, components_.begin()};
+    return {this, Components().begin()};
   }
   return {this, empty()};
 }
 
 auto path::end() const -> path::iterator {
   if (type_ == Type::MULTI) {
-    return {this, components_.end()};
+    return {this, Components().end()};
   }
   return {this, true};
 }
@@ -407,7 +522,7 @@ auto path::end() const -> path::iterator {
 auto path::iterator::operator++() -> path::iterator & {
   ASAP_ASSERT(path_ != nullptr);
   if ((path_ != nullptr) && (path_->type_ == Type::MULTI)) {
-    ASAP_ASSERT(cur_ != path_->components_.end());
+    ASAP_ASSERT(cur_ != path_->Components().end());
     ++cur_;
   } else {
     ASAP_ASSERT(!at_end_);
@@ -419,7 +534,7 @@ auto path::iterator::operator++() -> path::iterator & {
 auto path::iterator::operator--() -> path::iterator & {
   ASAP_ASSERT(path_ != nullptr);
   if ((path_ != nullptr) && (path_->type_ == Type::MULTI)) {
-    ASAP_ASSERT(cur_ != path_->components_.begin());
+    ASAP_ASSERT(cur_ != path_->Components().begin());
     --cur_;
   } else {
     ASAP_ASSERT(at_end_);
@@ -431,13 +546,13 @@ auto path::iterator::operator--() -> path::iterator & {
 auto path::iterator::operator*() const -> path::iterator::reference {
   ASAP_ASSERT(path_ != nullptr);
   if ((path_ != nullptr) && (path_->type_ == Type::MULTI)) {
-    ASAP_ASSERT(cur_ != path_->components_.end());
+    ASAP_ASSERT(cur_ != path_->Components().end());
     return *cur_;
   }
   return *path_;
 }
 
-auto path::iterator::equals(iterator rhs) const -> bool {
+auto path::iterator::equals(const iterator &rhs) const -> bool {
   if (path_ != rhs.path_) {
     return false;
   }
@@ -454,57 +569,87 @@ auto path::iterator::equals(iterator rhs) const -> bool {
 // Compare
 //------------------------------------------------------------------------------
 
+#if defined(ASAP_WINDOWS)
 namespace {
-template <typename Iter1, typename Iter2>
-auto do_compare(Iter1 begin1, Iter1 end1, Iter2 begin2, Iter2 end2) -> int {
-  int cmpt = 1;
-  while (begin1 != end1 && begin2 != end2) {
-    if (begin1->native() < begin2->native()) {
-      return -cmpt;
-    }
-    if (begin1->native() > begin2->native()) {
-      return +cmpt;
-    }
-    ++begin1;
-    ++begin2;
-    ++cmpt;
-  }
-  if (begin1 == end1) {
-    if (begin2 == end2) {
+// Root components may not be stored with the preferred separator, so they
+// are seen as if they were.
+inline auto PreferredSeparator(path::value_type ch) -> path::value_type {
+  return ch == '/' ? path::preferred_separator : ch;
+}
+}  // namespace
+#endif
+
+auto path::CompareComponent(const Component &cmpt, const path &other,
+                            const Component &other_cmpt) const noexcept
+    -> int {
+#if defined(ASAP_WINDOWS)
+  if (cmpt.type_ != Type::FILENAME || other_cmpt.type_ != Type::FILENAME) {
+    const auto len = std::min(cmpt.len_, other_cmpt.len_);
+    for (size_t index = 0; index < len; ++index) {
+      const auto ch = PreferredSeparator(pathname_[cmpt.pos_ + index]);
+      const auto other_ch =
+          PreferredSeparator(other.pathname_[other_cmpt.pos_ + index]);
+      if (ch != other_ch) {
+        return ch < other_ch ? -1 : 1;
+      }
+    }
+    if (cmpt.len_ == other_cmpt.len_) {
       return 0;
     }
-    return -cmpt;
+    return cmpt.len_ < other_cmpt.len_ ? -1 : 1;
   }
-  return +cmpt;
+#endif
+  return pathname_.compare(cmpt.pos_, cmpt.len_, other.pathname_,
+                           other_cmpt.pos_, other_cmpt.len_);
 }
-}  // namespace
 
-auto path::compare(const path &other) const noexcept -> int {
-  struct CmptRef {
-    const path *ptr;
-    auto native() const noexcept -> const string_type & {
-      return ptr->native();
+auto path::HashComponent(const Component &cmpt) const noexcept -> size_t {
+  // FNV-1a
+  size_t hash = 2166136261U;
+  for (auto index = cmpt.pos_; index < cmpt.pos_ + cmpt.len_; ++index) {
+    auto ch = pathname_[index];
+#if defined(ASAP_WINDOWS)
+    if (cmpt.type_ != Type::FILENAME) {
+      ch = PreferredSeparator(ch);
     }
-  };
-
-  if (empty() && other.empty()) {
-    return 0;
-  }
-  if (type_ == Type::MULTI && other.type_ == Type::MULTI) {
-    return do_compare(components_.begin(), components_.end(),
-                      other.components_.begin(), other.components_.end());
-  }
-  if (type_ == Type::MULTI) {
-    CmptRef c[1] = {{&other}};
-    return do_compare(components_.begin(), components_.end(), c, c + 1);
+#endif
+    hash = (hash ^ static_cast<unsigned char>(ch)) * 16777619U;
   }
-  if (other.type_ == Type::MULTI) {
-    CmptRef c[1] = {{this}};
-    return do_compare(c, c + 1, other.components_.begin(),
-                      other.components_.end());
+  return hash;
+}
+
+auto path::compare(const path &other) const noexcept -> int {
+  // The components are scanned from the pathnames rather than split, which
+  // would allocate.
+  ComponentScanner scanner(pathname_);
+  ComponentScanner other_scanner(other.pathname_);
+  Component cmpt;
+  Component other_cmpt;
+  bool more = scanner.Next(cmpt);
+  bool other_more = other_scanner.Next(other_cmpt);
+
+  int count = 1;
+  while (more && other_more) {
+    const auto res = CompareComponent(cmpt, other, other_cmpt);
+    if (res < 0) {
+      return -count;
+    }
+    if (res > 0) {
+      return +count;
+    }
+    more = scanner.Next(cmpt);
+    other_more = other_scanner.Next(other_cmpt);
+    ++count;
+  }
+  if (!more) {
+    if (!other_more) {
+      return 0;
+    }
+    return -count;
   }
-  return pathname_.compare(other.pathname_);
+  return +count;
 }
+
 auto path::compare(const string_type &other) const -> int {
   return compare(path(other));
 }
@@ -546,53 +691,49 @@ auto path::operator/=(const path &p) -> path & {
     return operator=(p);
   }
 
-  auto lhs = pathname_;
+  if (&p == this) {
+    return operator/=(path(p));
+  }
+
+  // When p has a root directory, only the root name of this path is kept.
+  bool keep_root_name = false;
   bool add_sep = false;
 
   if (p.has_root_directory()) {
     // Remove any root directory and relative path
-    if (type_ != Type::ROOT_NAME) {
-      if (!components_.empty() &&
-          components_.front().type_ == Type::ROOT_NAME) {
-        lhs = components_.front().pathname_;
-      } else {
-        lhs = {};
-      }
-    }
+    keep_root_name = type_ != Type::ROOT_NAME;
   } else if (has_filename() || (!has_root_directory() && is_absolute())) {
     add_sep = true;
   }
 
-  auto rhs = p.pathname_;
   // Omit any root-name from the generic format pathname:
-  if (p.type_ == Type::ROOT_NAME) {
-    rhs = {};
-  } else if (!p.components_.empty() &&
-             p.components_.front().type_ == Type::ROOT_NAME) {
-    rhs.erase(0, p.components_.front().pathname_.size());
+  size_t rhs_pos = 0;
+  if (p.has_root_name()) {
+    rhs_pos = p.type_ == Type::ROOT_NAME ? p.pathname_.size()
+                                         : p.FirstComponent().len_;
   }
+  const size_t rhs_len = p.pathname_.size() - rhs_pos;
 
-  const size_t len = lhs.size() + static_cast<size_t>(add_sep) + rhs.size();
-  const size_t maxcmpts = components_.size() + p.components_.size();
-  if (pathname_.capacity() < len || components_.capacity() < maxcmpts) {
-    // Construct new path and swap (strong exception-safety guarantee).
+  if (keep_root_name) {
+    // Construct the new pathname and swap (strong exception-safety guarantee).
     string_type tmp;
-    tmp.reserve(len);
-    tmp = lhs;
-    if (add_sep) {
-      tmp += preferred_separator;
+    const auto first = FirstComponent();
+    if (first.type_ == Type::ROOT_NAME) {
+      tmp.reserve(first.len_ + rhs_len);
+      AppendComponent(tmp, first);
     }
-    tmp += rhs;
-    path newp(std::move(tmp));
-    swap(newp);
+    tmp.append(p.pathname_, rhs_pos, rhs_len);
+    pathname_.swap(tmp);
   } else {
-    pathname_ = lhs;
+    // Nothing is modified if growing the pathname fails.
+    pathname_.reserve(pathname_.size() + static_cast<size_t>(add_sep) +
+                      rhs_len);
     if (add_sep) {
       pathname_ += preferred_separator;
     }
-    pathname_ += rhs;
-    SplitComponents();
+    pathname_.append(p.pathname_, rhs_pos, rhs_len);
   }
+  SplitComponents();
   return *this;
 }
 
@@ -614,12 +755,14 @@ auto hash_value(const path &p) noexcept -> std::size_t {
   // "If for two paths, p1 == p2 then hash_value(p1) == hash_value(p2)."
   // Equality works as if by traversing the range [begin(), end()), meaning
   // e.g. path("a//b") == path("a/b"), so we cannot simply hash pathname_
-  // but need to iterate over individual elements. Use the hash_combine from
-  // http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2014/n3876.pdf
+  // but need to hash individual elements. They are scanned from pathname_,
+  // like compare() does, as iterating could allocate. Use the hash_combine
+  // from http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2014/n3876.pdf
   size_t seed = 0;
-  for (const auto &x : p) {
-    seed ^= std::hash<path::string_type>()(x.native()) + 0x9e3779b9 +
-            (seed << 6) + (seed >> 2);
+  path::ComponentScanner scanner(p.pathname_);
+  path::Component cmpt;
+  while (scanner.Next(cmpt)) {
+    seed ^= p.HashComponent(cmpt) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
   }
   return seed;
 }
@@ -631,24 +774,18 @@ auto hash_value(const path &p) noexcept -> std::size_t {
 auto path::make_preferred() -> path & {
 #ifdef ASAP_WINDOWS
   std::replace(pathname_.begin(), pathname_.end(), slash, preferred_separator);
+  DropComponents();
 #endif
   return *this;
 }
 
 auto path::remove_filename() -> path & {
   if (type_ == Type::MULTI) {
-    if (!components_.empty()) {
-      auto cmpt = std::prev(components_.end());
-      if (cmpt->type_ == Type::FILENAME && !cmpt->empty()) {
-        pathname_.erase(cmpt->pos_);
-        auto prev = std::prev(cmpt);
-        if (prev->type_ == Type::ROOT_DIR || prev->type_ == Type::ROOT_NAME) {
-          components_.erase(cmpt);
-          Trim();
-        } else {
-          cmpt->clear();
-        }
-      }
+    const auto last = LastComponents().second;
+    if (last.type_ == Type::FILENAME && last.len_ != 0) {
+      // Leaves an empty filename after the separator, or only the root
+      pathname_.erase(last.pos_);
+      SplitComponents();
     }
   } else if (type_ == Type::FILENAME) {
     clear();
@@ -665,16 +802,8 @@ auto path::replace_filename(const path &replacement) -> path & {
 auto path::replace_extension(const path &replacement) -> path & {
   auto ext = FindExtension();
   // Any existing extension() is removed
-  if ((ext.first != nullptr) && ext.second != string_type::npos) {
-    if (ext.first == &pathname_) {
-      pathname_.erase(ext.second);
-    } else {
-      const auto &back = components_.back();
-      if (ext.first != &back.pathname_) {
-        throw(std::logic_error("path::replace_extension failed"));
-      }
-      pathname_.erase(back.pos_ + ext.second);
-    }
+  if (ext.first != string_type::npos && ext.second != string_type::npos) {
+    pathname_.erase(ext.first + ext.second);
   }
   // If replacement is not empty and does not begin with a dot character,
   // a dot character is appended
@@ -753,13 +882,9 @@ auto path::lexically_normal() const -> path {
           if (elem == ret.begin()) {
             ret.clear();
           } else {
-            ret.pathname_.erase(elem.cur_->pos_);
-            // Do we still have a trailing slash?
-            if (std::prev(elem)->type_ == Type::FILENAME) {
-              ret.components_.erase(elem.cur_);
-            } else {
-              ret.components_.erase(elem.cur_, ret.components_.end());
-            }
+            // Keeps the trailing slash, unless only the root is left
+            ret.pathname_.erase(ret.LastComponents().first.pos_);
+            ret.SplitComponents();
           }
         } else {  // ???
           ret /= p;
@@ -772,13 +897,14 @@ auto path::lexically_normal() const -> path {
     }
   }
 
-  if (ret.components_.size() >= 2) {
-    auto back = std::prev(ret.components_.end());
+  if (ret.type_ == Type::MULTI && !ret.empty()) {
+    const auto last = ret.LastComponents();
     // If the last filename is dot-dot, ...
-    if (back->empty() && is_dotdot(*std::prev(back))) {
+    if (last.second.len_ == 0 &&
+        ret.pathname_.compare(last.first.pos_, last.first.len_, "..") == 0) {
       // ... remove any trailing directory-separator.
-      ret.components_.erase(back);
-      ret.pathname_.erase(std::prev(ret.pathname_.end()));
+      ret.pathname_.pop_back();
+      ret.SplitComponents();
     }
   }
   // If the path is empty, add a dot.
@@ -19,6 +19,8 @@
 # include <sys/types.h>
 # include <sys/stat.h>
 # include <sys/statvfs.h>
+# include <sys/mman.h>
+# include <sys/uio.h>
 # include <dirent.h>
 #endif
 
@@ -37,6 +39,22 @@
 #elif defined(ASAP_FS_USE_COPYFILE)
 # include <copyfile.h>
 #endif
+#if defined(ASAP_FS_USE_FICLONE)
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+#if defined(ASAP_FS_USE_GETDENTS64)
+# include <sys/syscall.h>
+#endif
+#if defined(ASAP_FS_USE_IO_URING)
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif
+#if defined(ASAP_FS_USE_INOTIFY)
+# include <poll.h>
+# include <sys/eventfd.h>
+# include <sys/inotify.h>
+#endif
 
 #if defined(ASAP_WINDOWS)
 # include <windows.h>
@@ -55,9 +73,36 @@ namespace linux_port {
 #if defined(ASAP_FS_USE_SENDFILE)
 using ::sendfile;
 #endif
+#if defined(ASAP_FS_USE_COPY_FILE_RANGE)
+using ::copy_file_range;
+#endif
+#if defined(ASAP_FS_USE_FICLONE)
+using ::ioctl;
+#endif
 #if defined(ASAP_FS_USE_UTIMENSAT)
 using ::utimensat;
 #endif
+#if defined(ASAP_FS_USE_GETDENTS64)
+using ::syscall;
+#endif
+#if defined(ASAP_FS_USE_STATX)
+using ::statx;
+#endif
+#if defined(ASAP_FS_USE_IO_URING)
+using ::mmap;
+using ::munmap;
+using ::syscall;
+#endif
+#if defined(ASAP_FS_USE_INOTIFY)
+using ::eventfd;
+using ::inotify_add_watch;
+using ::inotify_init1;
+using ::inotify_rm_watch;
+using ::poll;
+#endif
+#if defined(ASAP_LINUX)
+using ::madvise;
+#endif
 }  // namespace linux_port
 
 namespace apple_port {
@@ -75,25 +120,58 @@ const int invalid_fd_value = -1;
 using ::chdir;
 using ::close;
 using ::fchmod;
+#if defined(ASAP_FS_USE_FDATASYNC)
+using ::fdatasync;
+#endif
 using ::fstat;
+using ::fsync;
 using ::ftruncate;
 using ::getcwd;
 using ::link;
+using ::lseek;
 using ::lstat;
 using ::mkdir;
+using ::mmap;
+using ::msync;
+using ::munmap;
 using ::open;
 using ::pathconf;
+#if defined(ASAP_FS_USE_POSIX_FADVISE)
+using ::posix_fadvise;
+#endif
+#if defined(ASAP_FS_USE_POSIX_FALLOCATE)
+using ::posix_fallocate;
+#endif
+using ::posix_madvise;
+using ::posix_memalign;
+using ::pread;
+#if defined(ASAP_FS_USE_PREADV)
+using ::preadv;
+#endif
+using ::pwrite;
+#if defined(ASAP_FS_USE_PREADV)
+using ::pwritev;
+#endif
 using ::read;
 using ::readdir;
 using ::readlink;
 using ::remove;
 using ::stat;
 using ::symlink;
+using ::sysconf;
 using ::truncate;
 #if defined(ASAP_FS_USE_UTIME)
 using ::utime;
 #endif
 using ::write;
+#if defined(ASAP_FS_USE_OPENAT)
+using ::closedir;
+using ::dirfd;
+using ::fdopendir;
+using ::fstatat;
+using ::openat;
+using ::unlinkat;
+#endif
 }  // namespace posix_port
 #endif  // ASAP_POSIX
 
@@ -114,27 +192,36 @@ using ::CloseHandle;
 using ::CopyFileW;
 using ::CreateDirectoryExW;
 using ::CreateDirectoryW;
+using ::CreateFileMappingW;
 using ::CreateFileW;
 using ::CreateHardLinkW;
 using ::CreateSymbolicLinkW;
 using ::DeleteFileW;
 using ::DeviceIoControl;
+using ::FlushFileBuffers;
+using ::FlushViewOfFile;
 using ::GetCurrentDirectoryW;
 using ::GetDiskFreeSpaceExW;
 using ::GetFileAttributesExW;
 using ::GetFileAttributesW;
 using ::GetFileInformationByHandle;
 using ::GetFileInformationByHandleEx;
+using ::GetFileSizeEx;
 using ::GetFileTime;
 using ::GetFileType;
 using ::GetLastError;
+using ::GetSystemInfo;
 using ::GetTempPathW;
+using ::MapViewOfFile;
+using ::ReadFile;
 using ::RemoveDirectoryW;
 using ::SetCurrentDirectoryW;
 using ::SetEndOfFile;
 using ::SetFileAttributesW;
 using ::SetFilePointerEx;
 using ::SetFileTime;
+using ::UnmapViewOfFile;
+using ::WriteFile;
 
 }  // namespace win32_port
 #endif  // ASAP_WINDOWS
@@ -213,9 +300,50 @@ auto GetFileStatus(path const &p, posix_port::StatT &path_stat,
 auto GetLinkStatus(path const &p, posix_port::StatT &path_stat,
                    std::error_code *ec) -> file_status;
 
+// Same as GetFileStatus() or GetLinkStatus(), but going through the stat cache
+// when it is enabled.
+auto GetCachedFileStatus(path const &p, bool follow_symlinks,
+                         posix_port::StatT &path_stat, std::error_code *ec)
+    -> file_status;
+
 auto ExtractLastWriteTime(const path &p, const StatT &st, std::error_code *ec)
     -> file_time_type;
 
+// The attributes of a file GetFileStat() can be asked for, besides its type and
+// permissions which are always fetched.
+enum StatField : unsigned {
+  STAT_NLINK = 1U << 0,
+  STAT_SIZE = 1U << 1,
+  STAT_MTIME = 1U << 2,
+  STAT_BTIME = 1U << 3
+};
+
+struct FileStat {
+  // Only st_mode and the fields in `fields` are set
+  StatT st{};
+  // The StatField actually fetched, which may be more or less than asked for
+  unsigned fields{0};
+  // Time of creation, when STAT_BTIME is in `fields`
+  TimeSpec birth_time{};
+};
+
+// Gets the status of `p` like stat() or lstat(), but with statx() only asks
+// the file system for the attributes in `fields`. This saves network file
+// systems from refreshing the others. With `dont_sync`, they may even reply
+// with the attributes they have cached instead of asking the server.
+auto GetFileStat(path const &p, bool follow_symlinks, unsigned fields,
+                 bool dont_sync, FileStat &file_stat, std::error_code *ec)
+    -> file_status;
+
+#if defined(ASAP_FS_USE_OPENAT)
+// Same as GetFileStat() for the file `name` in the open directory `dir_fd`,
+// which saves resolving the full path `p` again. `p` is only used to report
+// errors.
+auto GetFileStatAt(int dir_fd, const char *name, path const &p,
+                   bool follow_symlinks, unsigned fields, bool dont_sync,
+                   FileStat &file_stat, std::error_code *ec) -> file_status;
+#endif  // ASAP_FS_USE_OPENAT
+
 }  // namespace posix_port
 #endif  // ASAP_POSIX
 
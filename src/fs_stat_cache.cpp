@@ -0,0 +1,243 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include "fs_stat_cache.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace asap {
+namespace filesystem {
+namespace detail {
+
+std::atomic<bool> stat_cache_on{false};
+
+namespace {
+
+// -----------------------------------------------------------------------------
+//                          detail: StatCache
+// -----------------------------------------------------------------------------
+
+using Clock = std::chrono::steady_clock;
+
+// Spreads the paths over several independently locked maps, so that threads
+// looking up different paths rarely wait for each other.
+constexpr std::size_t SHARDS = 16;
+
+struct CachedStat {
+  bool valid{false};
+#if defined(ASAP_POSIX)
+  posix_port::StatT st{};
+#endif
+  std::error_code ec;
+  Clock::time_point expires;
+};
+
+struct Entry {
+  path::string_type name;
+  // Following symlinks or not
+  CachedStat stats[2];
+};
+
+struct Shard {
+  std::mutex mutex;
+  // Most recently used first
+  std::list<Entry> lru;
+  std::unordered_map<path::string_type, std::list<Entry>::iterator> index;
+  std::uint64_t hits{0};
+  std::uint64_t misses{0};
+  std::uint64_t evictions{0};
+  // Changes each time entries are dropped, so that attributes got before
+  // are not stored after
+  std::uint64_t generation{0};
+};
+
+class StatCache {
+ public:
+  static auto Instance() -> StatCache & {
+    static StatCache cache;
+    return cache;
+  }
+
+  void Configure(const stat_cache_options &options) {
+    ttl_.store(std::chrono::duration_cast<Clock::duration>(options.ttl).count(),
+               std::memory_order_relaxed);
+    const auto per_shard = (options.max_entries + SHARDS - 1) / SHARDS;
+    shard_capacity_.store(per_shard == 0 ? 1 : per_shard,
+                          std::memory_order_relaxed);
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.lru.clear();
+      shard.index.clear();
+      shard.hits = shard.misses = shard.evictions = 0;
+      ++shard.generation;
+    }
+  }
+
+#if defined(ASAP_POSIX)
+  auto Lookup(const path &p, bool follow_symlinks, posix_port::StatT &st,
+              std::error_code &ec, std::uint64_t &generation) -> bool {
+    auto &shard = ShardOf(p);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(p.native());
+    if (found == shard.index.end()) {
+      generation = shard.generation;
+      ++shard.misses;
+      return false;
+    }
+    auto &cached = found->second->stats[follow_symlinks ? 1 : 0];
+    if (!cached.valid || cached.expires <= Clock::now()) {
+      cached.valid = false;
+      generation = shard.generation;
+      ++shard.misses;
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    st = cached.st;
+    ec = cached.ec;
+    ++shard.hits;
+    return true;
+  }
+
+  void Store(const path &p, bool follow_symlinks,
+             const posix_port::StatT &st, const std::error_code &ec,
+             std::uint64_t generation) {
+    const auto expires =
+        Clock::now() + Clock::duration(ttl_.load(std::memory_order_relaxed));
+    auto &shard = ShardOf(p);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!StatCacheEnabled() || generation != shard.generation) {
+      return;
+    }
+    auto found = shard.index.find(p.native());
+    if (found != shard.index.end()) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    } else {
+      shard.lru.push_front(Entry{p.native(), {}});
+      shard.index.emplace(p.native(), shard.lru.begin());
+      const auto capacity = shard_capacity_.load(std::memory_order_relaxed);
+      while (shard.lru.size() > capacity) {
+        shard.index.erase(shard.lru.back().name);
+        shard.lru.pop_back();
+        ++shard.evictions;
+      }
+    }
+    auto &cached = shard.lru.front().stats[follow_symlinks ? 1 : 0];
+    cached.valid = true;
+    cached.st = st;
+    cached.ec = ec;
+    cached.expires = expires;
+  }
+#endif  // ASAP_POSIX
+
+  void Invalidate(const path &p) {
+    auto &shard = ShardOf(p);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(p.native());
+    if (found != shard.index.end()) {
+      shard.lru.erase(found->second);
+      shard.index.erase(found);
+    }
+    ++shard.generation;
+  }
+
+  void Clear() {
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.lru.clear();
+      shard.index.clear();
+      ++shard.generation;
+    }
+  }
+
+  auto Statistics() -> stat_cache_stats {
+    stat_cache_stats stats;
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      stats.hits += shard.hits;
+      stats.misses += shard.misses;
+      stats.evictions += shard.evictions;
+      stats.size += shard.lru.size();
+    }
+    return stats;
+  }
+
+ private:
+  auto ShardOf(const path &p) -> Shard & {
+    return shards_[std::hash<path::string_type>()(p.native()) % SHARDS];
+  }
+
+  std::array<Shard, SHARDS> shards_;
+  std::atomic<Clock::rep> ttl_{0};
+  std::atomic<std::size_t> shard_capacity_{1};
+};
+
+}  // namespace
+
+#if defined(ASAP_POSIX)
+auto LookupStat(const path &p, bool follow_symlinks, posix_port::StatT &st,
+                std::error_code &ec, std::uint64_t &generation) -> bool {
+  return StatCache::Instance().Lookup(p, follow_symlinks, st, ec, generation);
+}
+
+void StoreStat(const path &p, bool follow_symlinks,
+               const posix_port::StatT &st, const std::error_code &ec,
+               std::uint64_t generation) {
+  StatCache::Instance().Store(p, follow_symlinks, st, ec, generation);
+}
+#endif  // ASAP_POSIX
+
+void InvalidateStat(const path &p) { StatCache::Instance().Invalidate(p); }
+
+void InvalidateEntry(const path &p) {
+  auto &cache = StatCache::Instance();
+  cache.Invalidate(p);
+  // The directory is cached under the name it was given, "." for the current
+  // one. With a trailing separator, the entry is the last named component.
+  auto dir = p.has_filename() ? p.parent_path() : p.parent_path().parent_path();
+  cache.Invalidate(dir.empty() ? path(".") : dir);
+}
+
+void ClearStats() { StatCache::Instance().Clear(); }
+
+}  // namespace detail
+
+// -----------------------------------------------------------------------------
+//                               stat cache
+// -----------------------------------------------------------------------------
+
+void enable_stat_cache(const stat_cache_options &options) {
+  detail::StatCache::Instance().Configure(options);
+  detail::stat_cache_on.store(true, std::memory_order_relaxed);
+}
+
+void disable_stat_cache() {
+  detail::stat_cache_on.store(false, std::memory_order_relaxed);
+  detail::StatCache::Instance().Clear();
+}
+
+auto stat_cache_enabled() noexcept -> bool {
+  return detail::StatCacheEnabled();
+}
+
+void invalidate_stat_cache(const path &p) {
+  if (detail::StatCacheEnabled()) {
+    detail::InvalidateStat(p);
+  }
+}
+
+void clear_stat_cache() { detail::StatCache::Instance().Clear(); }
+
+auto stat_cache_statistics() -> stat_cache_stats {
+  return detail::StatCache::Instance().Statistics();
+}
+
+}  // namespace filesystem
+}  // namespace asap
@@ -0,0 +1,118 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <system_error>
+
+#include <filesystem/fs_path.h>
+#include <filesystem/fs_stat_cache.h>
+
+#include "fs_portability.h"
+
+namespace asap {
+namespace filesystem {
+namespace detail {
+
+// -----------------------------------------------------------------------------
+//                          detail: stat cache
+// -----------------------------------------------------------------------------
+
+extern std::atomic<bool> stat_cache_on;
+
+inline auto StatCacheEnabled() noexcept -> bool {
+  return stat_cache_on.load(std::memory_order_relaxed);
+}
+
+#if defined(ASAP_POSIX)
+// Gets the attributes of `p` from the cache, with the error the system gave
+// for them if any. Returns false when they are not cached or have expired,
+// with the generation to store the attributes the caller gets with.
+auto LookupStat(const path &p, bool follow_symlinks, posix_port::StatT &st,
+                std::error_code &ec, std::uint64_t &generation) -> bool;
+
+// Keeps the attributes of `p` for later lookups, unless the cache was disabled
+// or `p` was invalidated since the lookup that returned `generation`, in which
+// case the attributes may be stale.
+void StoreStat(const path &p, bool follow_symlinks,
+               const posix_port::StatT &st, const std::error_code &ec,
+               std::uint64_t generation);
+#endif  // ASAP_POSIX
+
+void InvalidateStat(const path &p);
+// Same as InvalidateStat() for the paths that were added to, or removed from,
+// their directory, whose modification time changed too.
+void InvalidateEntry(const path &p);
+void ClearStats();
+
+// Drops the cached attributes of the paths an operation changes once it
+// returns, whether it succeeded or not. A concurrent lookup that got the
+// attributes from before the change does not store them after they were
+// dropped: dropping them starts a new generation of their shard.
+class InvalidateStatOnExit {
+ public:
+  explicit InvalidateStatOnExit(const path &p1, const path *p2 = nullptr)
+      : p1_(p1), p2_(p2) {}
+  InvalidateStatOnExit(const InvalidateStatOnExit &) = delete;
+  auto operator=(const InvalidateStatOnExit &)
+      -> InvalidateStatOnExit & = delete;
+  ~InvalidateStatOnExit() {
+    if (StatCacheEnabled()) {
+      InvalidateStat(p1_);
+      if (p2_ != nullptr) {
+        InvalidateStat(*p2_);
+      }
+    }
+  }
+
+ private:
+  const path &p1_;
+  const path *p2_;
+};
+
+// Same as InvalidateStatOnExit for the operations that add or remove the
+// directory entry `p`, which also changes the attributes of its directory.
+// `other` is a path whose attributes only change, such as the target of a new
+// hard link.
+class InvalidateEntryOnExit {
+ public:
+  explicit InvalidateEntryOnExit(const path &p, const path *other = nullptr)
+      : p_(p), other_(other) {}
+  InvalidateEntryOnExit(const InvalidateEntryOnExit &) = delete;
+  auto operator=(const InvalidateEntryOnExit &)
+      -> InvalidateEntryOnExit & = delete;
+  ~InvalidateEntryOnExit() {
+    if (StatCacheEnabled()) {
+      InvalidateEntry(p_);
+      if (other_ != nullptr) {
+        InvalidateStat(*other_);
+      }
+    }
+  }
+
+ private:
+  const path &p_;
+  const path *other_;
+};
+
+// Same as InvalidateStatOnExit for the operations that change whole trees, or
+// how relative paths are resolved.
+class ClearStatsOnExit {
+ public:
+  ClearStatsOnExit() = default;
+  ClearStatsOnExit(const ClearStatsOnExit &) = delete;
+  auto operator=(const ClearStatsOnExit &) -> ClearStatsOnExit & = delete;
+  ~ClearStatsOnExit() {
+    if (StatCacheEnabled()) {
+      ClearStats();
+    }
+  }
+};
+
+}  // namespace detail
+}  // namespace filesystem
+}  // namespace asap
@@ -0,0 +1,214 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include "fs_thread_pool.h"
+
+#include <algorithm>
+
+namespace asap {
+namespace filesystem {
+namespace detail {
+
+namespace {
+auto HardwareConcurrency() -> std::size_t {
+  // May return 0 when the value is not computable
+  return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+// The pool and the queue index of the worker running on the current thread.
+thread_local ThreadPool *current_pool = nullptr;
+thread_local std::size_t current_queue = 0;
+}  // namespace
+
+// -----------------------------------------------------------------------------
+//                          detail: ThreadPool
+// -----------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  threads = std::max<std::size_t>(1, threads);
+  queues_.reserve(threads);
+  for (std::size_t index = 0; index < threads; ++index) {
+    queues_.emplace_back(new WorkQueue());
+  }
+  threads_.reserve(threads);
+  for (std::size_t index = 0; index < threads; ++index) {
+    threads_.emplace_back([this, index]() { Work(index); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_up_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+auto ThreadPool::Instance() -> ThreadPool & {
+  static ThreadPool pool(HardwareConcurrency());
+  return pool;
+}
+
+void ThreadPool::Submit(Task task) {
+  const auto index = current_pool == this
+                         ? current_queue
+                         : next_queue_.fetch_add(1) % queues_.size();
+  // Count the task before it becomes visible so that the count never goes
+  // below zero. A worker woken up in between simply tries again.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++queued_;
+  }
+  {
+    auto &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  wake_up_.notify_one();
+}
+
+void ThreadPool::Work(std::size_t index) {
+  current_pool = this;
+  current_queue = index;
+  for (;;) {
+    Task task;
+    if (Pop(index, task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_up_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+    if (queued_ == 0) {
+      // Stopping and nothing left to do
+      return;
+    }
+  }
+}
+
+auto ThreadPool::Pop(std::size_t index, Task &task) -> bool {
+  const auto count = queues_.size();
+  bool found = false;
+  // Most recent task from our own queue first, then the oldest task from the
+  // queues of the other workers.
+  {
+    auto &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      found = true;
+    }
+  }
+  for (std::size_t offset = 1; !found && offset < count; ++offset) {
+    auto &queue = *queues_[(index + offset) % count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      found = true;
+    }
+  }
+  if (found) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --queued_;
+  }
+  return found;
+}
+
+// -----------------------------------------------------------------------------
+//                          detail: TaskGroup
+// -----------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(const parallel_policy &policy)
+    : executor_(policy.executor), state_(std::make_shared<State>()) {
+  const auto concurrency = policy.max_concurrency == 0 ? HardwareConcurrency()
+                                                       : policy.max_concurrency;
+  // The thread waiting on the group is one of the workers
+  max_runners_ = concurrency - 1;
+  if (!executor_ && max_runners_ > 0) {
+    executor_ = [](parallel_policy::task task) {
+      ThreadPool::Instance().Submit(std::move(task));
+    };
+  }
+}
+
+TaskGroup::~TaskGroup() { WaitForAll(); }
+
+void TaskGroup::Run(Task task) {
+  auto &state = *state_;
+  std::unique_lock<std::mutex> lock(state.mutex);
+  state.queue.push_back(std::move(task));
+  ++state.pending;
+  if (state.runners >= max_runners_) {
+    return;
+  }
+  ++state.runners;
+  lock.unlock();
+
+  auto shared_state = state_;
+  try {
+    executor_([shared_state]() {
+      std::unique_lock<std::mutex> runner_lock(shared_state->mutex);
+      Drain(*shared_state, runner_lock);
+      --shared_state->runners;
+    });
+  } catch (...) {
+    // The executor did not take the runner, the queued tasks will be run by
+    // the other runners or by Wait().
+    lock.lock();
+    --state.runners;
+  }
+}
+
+void TaskGroup::Wait() {
+  WaitForAll();
+  std::exception_ptr exception;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::swap(exception, state_->exception);
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void TaskGroup::Drain(State &state, std::unique_lock<std::mutex> &lock) {
+  while (!state.queue.empty()) {
+    auto task = std::move(state.queue.back());
+    state.queue.pop_back();
+    lock.unlock();
+    std::exception_ptr exception;
+    try {
+      task();
+    } catch (...) {
+      exception = std::current_exception();
+    }
+    // Release what the task holds before it is counted as done
+    task = nullptr;
+    lock.lock();
+    if (exception && !state.exception) {
+      state.exception = exception;
+    }
+    if (--state.pending == 0) {
+      state.done.notify_all();
+    }
+  }
+}
+
+void TaskGroup::WaitForAll() {
+  auto &state = *state_;
+  std::unique_lock<std::mutex> lock(state.mutex);
+  Drain(state, lock);
+  // Runners which are not running a task don't need to be waited for, they
+  // only hold the shared state.
+  state.done.wait(lock, [&state]() { return state.pending == 0; });
+}
+
+}  // namespace detail
+}  // namespace filesystem
+}  // namespace asap
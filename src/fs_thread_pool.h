@@ -0,0 +1,132 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <filesystem/fs_parallel.h>
+
+namespace asap {
+namespace filesystem {
+namespace detail {
+
+// -----------------------------------------------------------------------------
+//                          detail: ThreadPool
+// -----------------------------------------------------------------------------
+
+/*!
+@brief A work-stealing thread pool, used to run the parallel operations when
+no executor is provided by the caller.
+
+Each worker has its own queue of tasks. Tasks submitted from a worker go to the
+back of its own queue and are taken back from there (last in, first out) to
+keep the working set hot in the cache. Tasks submitted from other threads are
+distributed over the workers in a round robin fashion. A worker with an empty
+queue steals from the front of the other queues before going to sleep.
+*/
+class ThreadPool {
+ public:
+  using Task = std::function<void()>;
+
+  explicit ThreadPool(std::size_t threads);
+  ThreadPool(const ThreadPool &) = delete;
+  auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+  ~ThreadPool();
+
+  /// The pool shared by the whole library, created on first use with one
+  /// worker per hardware thread.
+  static auto Instance() -> ThreadPool &;
+
+  void Submit(Task task);
+
+  auto Size() const -> std::size_t { return threads_.size(); }
+
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void Work(std::size_t index);
+  auto Pop(std::size_t index, Task &task) -> bool;
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> next_queue_{0};
+
+  // Protects the count of queued tasks, which the idle workers sleep on.
+  std::mutex mutex_;
+  std::condition_variable wake_up_;
+  std::size_t queued_{0};
+  bool stop_{false};
+};
+
+// -----------------------------------------------------------------------------
+//                          detail: TaskGroup
+// -----------------------------------------------------------------------------
+
+/*!
+@brief Runs a group of tasks according to a parallel_policy and waits for all
+of them to complete.
+
+The tasks are kept in the group's own queue, which is drained by at most
+`max_concurrency - 1` runners scheduled on the executor, and by the thread
+calling Wait(). This bounds the concurrency of the group independently of the
+executor, and guarantees progress even if the executor is busy or never runs
+the runners. The most recently added tasks are run first, which keeps the
+working set of recursive operations (e.g. open directories) small.
+
+If a task throws, the first exception is rethrown by Wait().
+*/
+class TaskGroup {
+ public:
+  using Task = std::function<void()>;
+
+  explicit TaskGroup(const parallel_policy &policy);
+  TaskGroup(const TaskGroup &) = delete;
+  auto operator=(const TaskGroup &) -> TaskGroup & = delete;
+  /// Waits for the tasks still running, but does not rethrow their exceptions.
+  ~TaskGroup();
+
+  void Run(Task task);
+
+  /// Helps running the queued tasks, then blocks until all the tasks of the
+  /// group have completed.
+  void Wait();
+
+ private:
+  // Shared with the runners, which may outlive the group when the executor
+  // runs them late.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable done;
+    std::deque<Task> queue;
+    // Tasks queued or running
+    std::size_t pending{0};
+    std::size_t runners{0};
+    std::exception_ptr exception;
+  };
+
+  static void Drain(State &state, std::unique_lock<std::mutex> &lock);
+  void WaitForAll();
+
+  parallel_policy::executor_type executor_;
+  std::size_t max_runners_;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace detail
+}  // namespace filesystem
+}  // namespace asap
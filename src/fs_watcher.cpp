@@ -0,0 +1,686 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#include <filesystem/filesystem.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "fs_error.h"
+#include "fs_portability.h"
+
+namespace asap {
+namespace filesystem {
+
+using detail::ErrorHandler;
+
+namespace {
+
+// -----------------------------------------------------------------------------
+//                           detail: EventBatch
+// -----------------------------------------------------------------------------
+
+// Collects the events until they are reported, coalescing the events of the
+// same path and keeping at most `max` of them.
+class EventBatch {
+ public:
+  explicit EventBatch(std::size_t max) : max_(max == 0 ? 1 : max) {}
+
+  void Add(watch_event_kind kind, const path &p) {
+    if (overflow_) {
+      return;
+    }
+    auto found = index_.find(p.native());
+    if (found != index_.end()) {
+      Merge(found->second, kind);
+      return;
+    }
+    if (!Reserve()) {
+      return;
+    }
+    index_.emplace(p.native(), events_.size());
+    events_.push_back({watch_event{kind, p, {}}, false});
+    ++live_;
+  }
+
+  void AddRename(const path &from, const path &to) {
+    if (overflow_ || !Reserve()) {
+      return;
+    }
+    // Whatever happens to the paths next is not merged with what happened
+    // before the rename.
+    index_.erase(from.native());
+    index_.erase(to.native());
+    events_.push_back(
+        {watch_event{watch_event_kind::renamed, from, to}, false});
+    ++live_;
+  }
+
+  void AddOverflow() {
+    Clear();
+    overflow_ = true;
+  }
+
+  auto Empty() const -> bool { return !overflow_ && live_ == 0; }
+
+  auto Take() -> std::vector<watch_event> {
+    std::vector<watch_event> events;
+    if (overflow_) {
+      events.push_back({watch_event_kind::overflow, {}, {}});
+    } else {
+      events.reserve(live_);
+      for (auto &pending : events_) {
+        if (!pending.dropped) {
+          events.push_back(std::move(pending.event));
+        }
+      }
+    }
+    Clear();
+    return events;
+  }
+
+ private:
+  struct Pending {
+    watch_event event;
+    bool dropped;
+  };
+
+  void Merge(std::size_t index, watch_event_kind kind) {
+    auto &pending = events_[index];
+    auto &event = pending.event;
+    switch (event.kind) {
+      case watch_event_kind::created:
+        if (kind == watch_event_kind::removed) {
+          // Came and went
+          pending.dropped = true;
+          --live_;
+          index_.erase(event.path.native());
+        }
+        break;
+      case watch_event_kind::removed:
+        if (kind == watch_event_kind::created) {
+          // Replaced
+          event.kind = watch_event_kind::modified;
+        }
+        break;
+      default:
+        event.kind = kind;
+        break;
+    }
+  }
+
+  // Whether there is room for one more event, overflowing otherwise.
+  auto Reserve() -> bool {
+    if (live_ < max_) {
+      return true;
+    }
+    AddOverflow();
+    return false;
+  }
+
+  void Clear() {
+    events_.clear();
+    index_.clear();
+    live_ = 0;
+    overflow_ = false;
+  }
+
+  std::size_t max_;
+  std::vector<Pending> events_;
+  // Where the last event of each path is in events_
+  std::unordered_map<path::string_type, std::size_t> index_;
+  std::size_t live_{0};
+  bool overflow_{false};
+};
+
+// -----------------------------------------------------------------------------
+//                            detail: Snapshot
+// -----------------------------------------------------------------------------
+
+// What a scan of the watched tree compares.
+struct Stamp {
+  file_type type;
+  std::uintmax_t size;
+  file_time_type write_time;
+
+  auto operator==(const Stamp &other) const -> bool {
+    return type == other.type && size == other.size &&
+           write_time == other.write_time;
+  }
+  auto operator!=(const Stamp &other) const -> bool {
+    return !(*this == other);
+  }
+};
+
+// Sorted, so that two snapshots are compared in one pass.
+using Snapshot = std::map<path::string_type, Stamp>;
+
+void Record(const directory_entry &entry, Snapshot &snapshot) {
+  std::error_code ec;
+  Stamp stamp{entry.symlink_status(ec).type(), static_cast<std::uintmax_t>(-1),
+              file_time_type::min()};
+  if (ec) {
+    // Gone since it was listed
+    return;
+  }
+  // The modification time of a directory only says that its entries changed,
+  // which is reported for the entries themselves.
+  if (stamp.type == file_type::regular) {
+    stamp.size = entry.file_size(ec);
+    stamp.write_time = entry.last_write_time(ec);
+  }
+  snapshot.emplace(entry.path().native(), stamp);
+}
+
+// The attributes of the watched root, always asked to the system: the stat
+// cache may still hold the ones from before the change we are looking for.
+auto StampOf(const path &p, std::error_code &ec) -> Stamp {
+  Stamp stamp{file_type::none, static_cast<std::uintmax_t>(-1),
+              file_time_type::min()};
+  // Only failing to get the type makes the stamp unusable
+  std::error_code attr_ec;
+#if defined(ASAP_WINDOWS)
+  stamp.type = status_impl(p, &ec).type();
+  if (!ec && stamp.type == file_type::regular) {
+    stamp.size = file_size_impl(p, &attr_ec);
+    stamp.write_time = last_write_time_impl(p, &attr_ec);
+  }
+#else
+  detail::posix_port::StatT st{};
+  stamp.type = detail::posix_port::GetFileStatus(p, st, &ec).type();
+  if (!ec && stamp.type == file_type::regular) {
+    stamp.size = static_cast<std::uintmax_t>(st.st_size);
+    stamp.write_time =
+        detail::posix_port::ExtractLastWriteTime(p, st, &attr_ec);
+  }
+#endif
+  return stamp;
+}
+
+auto Scan(const path &root, bool recursive) -> Snapshot {
+  Snapshot snapshot;
+  std::error_code ec;
+  const auto stamp = StampOf(root, ec);
+  if (ec) {
+    return snapshot;
+  }
+  snapshot.emplace(root.native(), stamp);
+  if (stamp.type != file_type::directory) {
+    return snapshot;
+  }
+
+  if (recursive) {
+    const recursive_directory_iterator end;
+    for (recursive_directory_iterator iter(
+             root, directory_options::skip_permission_denied, ec);
+         !ec && iter != end; iter.increment(ec)) {
+      Record(*iter, snapshot);
+    }
+  } else {
+    const directory_iterator end;
+    for (directory_iterator iter(root, ec); !ec && iter != end;
+         iter.increment(ec)) {
+      Record(*iter, snapshot);
+    }
+  }
+  return snapshot;
+}
+
+// Adds to the batch the differences between two scans.
+void Compare(const Snapshot &before, const Snapshot &after, EventBatch &batch) {
+  auto old_entry = before.begin();
+  auto new_entry = after.begin();
+  while (old_entry != before.end() || new_entry != after.end()) {
+    if (new_entry == after.end() ||
+        (old_entry != before.end() && old_entry->first < new_entry->first)) {
+      batch.Add(watch_event_kind::removed, old_entry->first);
+      ++old_entry;
+    } else if (old_entry == before.end() ||
+               new_entry->first < old_entry->first) {
+      batch.Add(watch_event_kind::created, new_entry->first);
+      ++new_entry;
+    } else {
+      if (old_entry->second != new_entry->second) {
+        batch.Add(watch_event_kind::modified, new_entry->first);
+      }
+      ++old_entry;
+      ++new_entry;
+    }
+  }
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+//                              watcher::Impl
+// -----------------------------------------------------------------------------
+
+class watcher::Impl {
+ public:
+  Impl(const path &root, callback on_events, const watch_options &options,
+       std::error_code &ec)
+      : root_(root),
+        on_events_(std::move(on_events)),
+        options_(options),
+        batch_(options.max_events) {
+    const auto type = StampOf(root_, ec).type;
+    if (ec) {
+      return;
+    }
+#if defined(ASAP_FS_USE_INOTIFY)
+    if (options_.allow_notifications && StartNotifications(type)) {
+      notifications_ = true;
+      thread_ = std::thread([this]() { RunNotifications(); });
+      return;
+    }
+#endif
+    snapshot_ = Scan(root_, options_.recursive);
+    thread_ = std::thread([this]() { RunPolling(); });
+  }
+
+  Impl(const Impl &) = delete;
+  auto operator=(const Impl &) -> Impl & = delete;
+
+  ~Impl() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_up_.notify_all();
+#if defined(ASAP_FS_USE_INOTIFY)
+    if (wake_fd_ != -1) {
+      const std::uint64_t one = 1;
+      detail::posix_port::write(wake_fd_, &one, sizeof(one));
+    }
+#endif
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+#if defined(ASAP_FS_USE_INOTIFY)
+    StopNotifications();
+#endif
+  }
+
+  auto UsesNotifications() const noexcept -> bool { return notifications_; }
+
+ private:
+  void Deliver() {
+    auto events = batch_.Take();
+    if (!events.empty()) {
+      on_events_(std::move(events));
+    }
+  }
+
+  void RunPolling() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_up_.wait_for(lock, options_.poll_interval,
+                        [this]() { return stop_; });
+      if (stop_) {
+        return;
+      }
+      lock.unlock();
+      auto snapshot = Scan(root_, options_.recursive);
+      Compare(snapshot_, snapshot, batch_);
+      snapshot_ = std::move(snapshot);
+      if (snapshot_.empty()) {
+        // The watched path is gone, and nothing more is reported
+        Deliver();
+        return;
+      }
+      Deliver();
+      lock.lock();
+    }
+  }
+
+#if defined(ASAP_FS_USE_INOTIFY)
+  static constexpr std::uint32_t DIRECTORY_EVENTS =
+      IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM |
+      IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_EXCL_UNLINK;
+  static constexpr std::uint32_t FILE_EVENTS =
+      IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+
+  // Watches the whole tree, or returns false to scan it instead.
+  auto StartNotifications(file_type type) -> bool {
+    namespace linux_port = detail::linux_port;
+    notify_fd_ = linux_port::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wake_fd_ = linux_port::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    bool started = notify_fd_ != -1 && wake_fd_ != -1;
+    if (started) {
+      if (type == file_type::directory) {
+        started = AddTree(root_, false);
+      } else {
+        root_watch_ = linux_port::inotify_add_watch(notify_fd_, root_.c_str(),
+                                                    FILE_EVENTS);
+        started = root_watch_ != -1;
+        if (started) {
+          watched_[root_watch_] = root_;
+        }
+      }
+    }
+    if (!started) {
+      StopNotifications();
+    }
+    return started;
+  }
+
+  void StopNotifications() {
+    // Closing the inotify descriptor removes all the watches
+    if (notify_fd_ != -1) {
+      detail::posix_port::close(notify_fd_);
+      notify_fd_ = -1;
+    }
+    if (wake_fd_ != -1) {
+      detail::posix_port::close(wake_fd_);
+      wake_fd_ = -1;
+    }
+    watched_.clear();
+  }
+
+  auto AddWatch(const path &dir) -> bool {
+    if (options_.max_watches != 0 && watched_.size() >= options_.max_watches) {
+      return false;
+    }
+    const auto watch = detail::linux_port::inotify_add_watch(
+        notify_fd_, dir.c_str(), DIRECTORY_EVENTS | IN_ONLYDIR);
+    if (watch == -1) {
+      // The directory may have been removed already, which is reported anyway
+      return errno == ENOENT || errno == ENOTDIR;
+    }
+    if (dir == root_) {
+      root_watch_ = watch;
+    }
+    watched_[watch] = dir;
+    return true;
+  }
+
+  // Watches the directory, and all its sub-directories when recursive. The
+  // directory is watched before being listed, so that an entry added in the
+  // meantime is reported at least once. Returns false when running out of
+  // watches.
+  auto AddTree(const path &dir, bool report_entries) -> bool {
+    if (!AddWatch(dir)) {
+      return false;
+    }
+    if (!options_.recursive) {
+      return true;
+    }
+    std::error_code ec;
+    const recursive_directory_iterator end;
+    for (recursive_directory_iterator iter(
+             dir, directory_options::skip_permission_denied, ec);
+         !ec && iter != end; iter.increment(ec)) {
+      if (report_entries) {
+        batch_.Add(watch_event_kind::created, iter->path());
+      }
+      std::error_code type_ec;
+      if (iter->symlink_status(type_ec).type() == file_type::directory &&
+          !AddWatch(iter->path())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static auto IsWithin(const path &p, const path &dir) -> bool {
+    const auto &name = p.native();
+    const auto &prefix = dir.native();
+    return name.compare(0, prefix.size(), prefix) == 0 &&
+           (name.size() == prefix.size() ||
+            name[prefix.size()] == path::preferred_separator);
+  }
+
+  // Follows a directory moved within the tree.
+  void MoveWatches(const path &from, const path &to) {
+    for (auto &watched : watched_) {
+      if (IsWithin(watched.second, from)) {
+        watched.second =
+            to.native() + watched.second.native().substr(from.native().size());
+      }
+    }
+  }
+
+  // Stops watching a directory moved out of the tree.
+  void RemoveWatches(const path &dir) {
+    for (auto watched = watched_.begin(); watched != watched_.end();) {
+      if (IsWithin(watched->second, dir)) {
+        detail::linux_port::inotify_rm_watch(notify_fd_, watched->first);
+        watched = watched_.erase(watched);
+      } else {
+        ++watched;
+      }
+    }
+  }
+
+  void HandleEvent(const struct ::inotify_event &event) {
+    if ((event.mask & IN_Q_OVERFLOW) != 0) {
+      batch_.AddOverflow();
+      return;
+    }
+    auto watched = watched_.find(event.wd);
+    if (watched == watched_.end()) {
+      return;
+    }
+    if ((event.mask & IN_IGNORED) != 0) {
+      watched_.erase(watched);
+      return;
+    }
+    if (event.wd == root_watch_ &&
+        (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) != 0) {
+      batch_.Add(watch_event_kind::removed, root_);
+      RemoveWatches(root_);
+      watched_.clear();
+      return;
+    }
+    if (event.len == 0) {
+      // About the watched directory itself. Its removal and moves are reported
+      // by its parent.
+      if ((event.mask & (IN_MODIFY | IN_ATTRIB)) != 0) {
+        batch_.Add(watch_event_kind::modified, watched->second);
+      }
+      return;
+    }
+
+    const bool is_directory = (event.mask & IN_ISDIR) != 0;
+    auto p = watched->second / event.name;
+    if ((event.mask & IN_CREATE) != 0) {
+      batch_.Add(watch_event_kind::created, p);
+      if (is_directory && options_.recursive && !AddTree(p, true)) {
+        StartPolling();
+      }
+    } else if ((event.mask & IN_DELETE) != 0) {
+      batch_.Add(watch_event_kind::removed, p);
+    } else if ((event.mask & (IN_MODIFY | IN_ATTRIB)) != 0) {
+      batch_.Add(watch_event_kind::modified, p);
+    } else if ((event.mask & IN_MOVED_FROM) != 0) {
+      // Matched with IN_MOVED_TO when moved within the tree
+      moves_[event.cookie] = Move{std::move(p), is_directory};
+    } else if ((event.mask & IN_MOVED_TO) != 0) {
+      auto move = moves_.find(event.cookie);
+      if (move != moves_.end()) {
+        batch_.AddRename(move->second.from, p);
+        if (is_directory) {
+          MoveWatches(move->second.from, p);
+        }
+        moves_.erase(move);
+      } else {
+        batch_.Add(watch_event_kind::created, p);
+        if (is_directory && options_.recursive && !AddTree(p, true)) {
+          StartPolling();
+        }
+      }
+    }
+  }
+
+  // Gives up on watching a tree grown beyond the watches available, to scan it
+  // from now on. The entries of the directory that could not be watched are
+  // not all reported, hence the overflow.
+  void StartPolling() {
+    batch_.AddOverflow();
+    polling_ = true;
+  }
+
+  // Switches to scanning the tree once the events read so far are handled.
+  void SwitchToPolling() {
+    FinishMoves();
+    snapshot_ = Scan(root_, options_.recursive);
+    // Closing the inotify descriptor removes all the watches
+    detail::posix_port::close(notify_fd_);
+    notify_fd_ = -1;
+    watched_.clear();
+    notifications_ = false;
+    Deliver();
+    RunPolling();
+  }
+
+  // The moves not matched by now were out of the tree.
+  void FinishMoves() {
+    for (auto &move : moves_) {
+      batch_.Add(watch_event_kind::removed, move.second.from);
+      if (move.second.is_directory) {
+        RemoveWatches(move.second.from);
+      }
+    }
+    moves_.clear();
+  }
+
+  auto ReadEvents() -> bool {
+    alignas(struct ::inotify_event) char buffer[4096];
+    const ssize_t size =
+        detail::posix_port::read(notify_fd_, buffer, sizeof(buffer));
+    if (size <= 0) {
+      return false;
+    }
+    for (ssize_t offset = 0; offset < size;) {
+      const auto *event =
+          reinterpret_cast<const struct ::inotify_event *>(buffer + offset);
+      offset +=
+          static_cast<ssize_t>(sizeof(struct ::inotify_event) + event->len);
+      HandleEvent(*event);
+    }
+    return true;
+  }
+
+  void RunNotifications() {
+    using clock = std::chrono::steady_clock;
+    struct ::pollfd fds[2] = {{notify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    auto deadline = clock::time_point::max();
+    for (;;) {
+      int timeout = -1;
+      if (deadline != clock::time_point::max()) {
+        const auto remaining = std::chrono::duration_cast<
+            std::chrono::milliseconds>(deadline - clock::now());
+        timeout =
+            static_cast<int>(std::max<std::int64_t>(0, remaining.count()));
+      }
+      if (detail::linux_port::poll(fds, 2, timeout) == -1 && errno != EINTR) {
+        return;
+      }
+      if ((fds[1].revents & POLLIN) != 0) {
+        return;
+      }
+      if ((fds[0].revents & POLLIN) != 0) {
+        while (ReadEvents()) {
+        }
+        if (polling_) {
+          SwitchToPolling();
+          return;
+        }
+        if (deadline == clock::time_point::max() &&
+            (!batch_.Empty() || !moves_.empty())) {
+          deadline = clock::now() + options_.latency;
+        }
+      }
+      if (clock::now() >= deadline) {
+        FinishMoves();
+        Deliver();
+        deadline = clock::time_point::max();
+        if (watched_.empty()) {
+          // The watched path is gone, and nothing more is reported
+          return;
+        }
+      }
+    }
+  }
+
+  struct Move {
+    path from;
+    bool is_directory;
+  };
+
+  int notify_fd_{-1};
+  // Written to when the watcher is destroyed
+  int wake_fd_{-1};
+  int root_watch_{-1};
+  // The watched directories, by watch descriptor
+  std::unordered_map<int, path> watched_;
+  // The entries moved from a watched directory, by cookie
+  std::unordered_map<std::uint32_t, Move> moves_;
+  // Set when the tree outgrew the watches
+  bool polling_{false};
+#endif  // ASAP_FS_USE_INOTIFY
+
+  std::atomic<bool> notifications_{false};
+
+  path root_;
+  callback on_events_;
+  watch_options options_;
+  // Only used by the thread of the watcher
+  EventBatch batch_;
+  Snapshot snapshot_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_up_;
+  bool stop_{false};
+
+  std::thread thread_;
+};
+
+#if defined(ASAP_FS_USE_INOTIFY)
+constexpr std::uint32_t watcher::Impl::DIRECTORY_EVENTS;
+constexpr std::uint32_t watcher::Impl::FILE_EVENTS;
+#endif
+
+// -----------------------------------------------------------------------------
+//                                 watcher
+// -----------------------------------------------------------------------------
+
+watcher::watcher(const path &p, callback on_events,
+                 const watch_options &options) {
+  std::error_code ec;
+  impl_.reset(new Impl(p, std::move(on_events), options, ec));
+  if (ec) {
+    impl_.reset();
+    ErrorHandler<void> err("watcher", nullptr, &p);
+    err.report(ec);
+  }
+}
+
+watcher::watcher(const path &p, callback on_events,
+                 const watch_options &options, std::error_code &ec) {
+  ErrorHandler<void> err("watcher", &ec, &p);
+  std::error_code m_ec;
+  impl_.reset(new Impl(p, std::move(on_events), options, m_ec));
+  if (m_ec) {
+    impl_.reset();
+    err.report(m_ec);
+  }
+}
+
+watcher::~watcher() = default;
+
+auto watcher::uses_notifications() const noexcept -> bool {
+  return impl_ && impl_->UsesNotifications();
+}
+
+}  // namespace filesystem
+}  // namespace asap
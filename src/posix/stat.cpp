@@ -5,6 +5,9 @@
 
 #include "../fs_error.h"
 #include "../fs_portability.h"
+#include "../fs_stat_cache.h"
+
+#include <atomic>
 
 #if defined(ASAP_POSIX)
 
@@ -75,6 +78,167 @@ auto GetLinkStatus(path const &p, posix_port::StatT &path_stat,
   return CreateFileStatus(m_ec, p, path_stat, ec);
 }
 
+auto GetCachedFileStatus(path const &p, bool follow_symlinks,
+                         posix_port::StatT &path_stat, std::error_code *ec)
+    -> file_status {
+  if (!StatCacheEnabled()) {
+    return follow_symlinks ? GetFileStatus(p, path_stat, ec)
+                           : GetLinkStatus(p, path_stat, ec);
+  }
+  std::error_code m_ec;
+  std::uint64_t generation = 0;
+  if (!LookupStat(p, follow_symlinks, path_stat, m_ec, generation)) {
+    const auto result = follow_symlinks
+                            ? detail::posix_port::stat(p.c_str(), &path_stat)
+                            : detail::posix_port::lstat(p.c_str(), &path_stat);
+    if (result == -1) {
+      m_ec = capture_errno();
+    }
+    // Besides the attributes, only the absence of the file is worth keeping.
+    // Other errors, e.g. running out of memory, may not last.
+    if (!m_ec || m_ec.value() == ENOENT || m_ec.value() == ENOTDIR) {
+      StoreStat(p, follow_symlinks, path_stat, m_ec, generation);
+    }
+  }
+  return CreateFileStatus(m_ec, p, path_stat, ec);
+}
+
+#if defined(ASAP_FS_USE_STATX)
+namespace {
+// Set when the kernel turns out to be older than statx()
+std::atomic<bool> statx_unsupported{false};
+
+auto StatxMask(unsigned fields) -> unsigned {
+  unsigned mask = STATX_TYPE | STATX_MODE;
+  if ((fields & STAT_NLINK) != 0) {
+    mask |= STATX_NLINK;
+  }
+  if ((fields & STAT_SIZE) != 0) {
+    mask |= STATX_SIZE;
+  }
+  if ((fields & STAT_MTIME) != 0) {
+    mask |= STATX_MTIME;
+  }
+  if ((fields & STAT_BTIME) != 0) {
+    mask |= STATX_BTIME;
+  }
+  return mask;
+}
+
+auto TimeSpecFromStatx(const struct ::statx_timestamp &ts) -> TimeSpec {
+  TimeSpec tm{};
+  tm.tv_sec = static_cast<decltype(tm.tv_sec)>(ts.tv_sec);
+  tm.tv_nsec = static_cast<decltype(tm.tv_nsec)>(ts.tv_nsec);
+  return tm;
+}
+
+// Returns false when statx() is not supported, and the status must be fetched
+// with stat() instead.
+auto Statx(int dir_fd, const char *name, bool follow_symlinks, unsigned fields,
+           bool dont_sync, FileStat &file_stat, std::error_code &m_ec)
+    -> bool {
+  if (statx_unsupported) {
+    return false;
+  }
+  const int flags = AT_NO_AUTOMOUNT |
+                    (follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW) |
+                    (dont_sync ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT);
+  struct ::statx stx {};
+  if (linux_port::statx(dir_fd, name, flags, StatxMask(fields), &stx) == -1) {
+    if (errno == ENOSYS) {
+      statx_unsupported = true;
+      return false;
+    }
+    m_ec = capture_errno();
+    return true;
+  }
+  auto &st = file_stat.st;
+  st.st_mode = stx.stx_mode;
+  file_stat.fields = 0;
+  if ((stx.stx_mask & STATX_NLINK) != 0) {
+    st.st_nlink = stx.stx_nlink;
+    file_stat.fields |= STAT_NLINK;
+  }
+  if ((stx.stx_mask & STATX_SIZE) != 0) {
+    st.st_size = static_cast<off_t>(stx.stx_size);
+    file_stat.fields |= STAT_SIZE;
+  }
+  if ((stx.stx_mask & STATX_MTIME) != 0) {
+    st.st_mtim = TimeSpecFromStatx(stx.stx_mtime);
+    file_stat.fields |= STAT_MTIME;
+  }
+  if ((stx.stx_mask & STATX_BTIME) != 0) {
+    file_stat.birth_time = TimeSpecFromStatx(stx.stx_btime);
+    file_stat.fields |= STAT_BTIME;
+  }
+  return true;
+}
+}  // namespace
+#endif  // ASAP_FS_USE_STATX
+
+namespace {
+// The fields filled in by stat() and its variants
+void SetStatFields(FileStat &file_stat) {
+  file_stat.fields = STAT_NLINK | STAT_SIZE | STAT_MTIME;
+#if defined(ASAP_APPLE)
+  file_stat.birth_time = file_stat.st.st_birthtimespec;
+  file_stat.fields |= STAT_BTIME;
+#endif  // ASAP_APPLE
+}
+}  // namespace
+
+auto GetFileStat(path const &p, bool follow_symlinks, unsigned fields,
+                 bool dont_sync, FileStat &file_stat, std::error_code *ec)
+    -> file_status {
+#if defined(ASAP_FS_USE_OPENAT)
+  return GetFileStatAt(AT_FDCWD, p.c_str(), p, follow_symlinks, fields,
+                       dont_sync, file_stat, ec);
+#else
+  std::error_code m_ec;
+#if defined(ASAP_FS_USE_STATX)
+  if (Statx(AT_FDCWD, p.c_str(), follow_symlinks, fields, dont_sync,
+            file_stat, m_ec)) {
+    return CreateFileStatus(m_ec, p, file_stat.st, ec);
+  }
+#else
+  (void)fields;
+  (void)dont_sync;
+#endif  // ASAP_FS_USE_STATX
+  const int res = follow_symlinks
+                      ? detail::posix_port::stat(p.c_str(), &file_stat.st)
+                      : detail::posix_port::lstat(p.c_str(), &file_stat.st);
+  if (res == -1) {
+    m_ec = capture_errno();
+  }
+  SetStatFields(file_stat);
+  return CreateFileStatus(m_ec, p, file_stat.st, ec);
+#endif  // ASAP_FS_USE_OPENAT
+}
+
+#if defined(ASAP_FS_USE_OPENAT)
+auto GetFileStatAt(int dir_fd, const char *name, path const &p,
+                   bool follow_symlinks, unsigned fields, bool dont_sync,
+                   FileStat &file_stat, std::error_code *ec) -> file_status {
+  std::error_code m_ec;
+#if defined(ASAP_FS_USE_STATX)
+  if (Statx(dir_fd, name, follow_symlinks, fields, dont_sync, file_stat,
+            m_ec)) {
+    return CreateFileStatus(m_ec, p, file_stat.st, ec);
+  }
+#else
+  (void)fields;
+  (void)dont_sync;
+#endif  // ASAP_FS_USE_STATX
+  if (detail::posix_port::fstatat(dir_fd, name, &file_stat.st,
+                                  follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW) ==
+      -1) {
+    m_ec = capture_errno();
+  }
+  SetStatFields(file_stat);
+  return CreateFileStatus(m_ec, p, file_stat.st, ec);
+}
+#endif  // ASAP_FS_USE_OPENAT
+
 }  // namespace posix_port
 }  // namespace detail
 }  // namespace filesystem
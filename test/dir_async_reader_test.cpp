@@ -0,0 +1,226 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fs_testsuite.h"
+
+namespace {
+
+// Stands for the event loop of an application: the tasks posted to it are run
+// by the test thread.
+class EventLoop {
+ public:
+  auto executor() -> fs::parallel_policy::executor_type {
+    return [this](fs::parallel_policy::task task) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+      posted_.notify_one();
+    };
+  }
+
+  // Runs the posted tasks until `done` returns true.
+  template <typename Predicate> void RunUntil(Predicate done) {
+    while (!done()) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      posted_.wait(lock, [this]() { return !tasks_.empty(); });
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      task();
+      ++ran_;
+    }
+  }
+
+  auto Ran() const -> std::size_t { return ran_; }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable posted_;
+  std::deque<fs::parallel_policy::task> tasks_;
+  std::size_t ran_{0};
+};
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+//  async_directory_reader
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Dir / async_directory_reader / entries", "[common][filesystem][dir][async]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  // More than fits in one batch
+  const int count = static_cast<int>(fs::async_directory_reader::batch_size) + 44;
+  for (int index = 0; index < count; ++index) {
+    std::ofstream{p / std::to_string(index)};
+  }
+  create_directory(p / "dir");
+
+  std::vector<fs::path> expected;
+  for (const auto &entry : fs::directory_iterator(p)) {
+    expected.push_back(entry.path());
+  }
+
+  EventLoop loop;
+  fs::async_directory_reader reader(p, fs::directory_options::none, loop.executor());
+  REQUIRE(reader.path() == p);
+
+  std::vector<fs::path> listed;
+  std::size_t batches = 0;
+  bool finished = false;
+  bool failed = false;
+  std::function<void(std::vector<fs::directory_entry>, std::error_code)> on_batch =
+      [&](std::vector<fs::directory_entry> entries, std::error_code error) {
+        if (error) {
+          failed = true;
+          return;
+        }
+        if (entries.empty()) {
+          finished = true;
+          return;
+        }
+        ++batches;
+        REQUIRE(entries.size() <= fs::async_directory_reader::batch_size);
+        for (const auto &entry : entries) {
+          listed.push_back(entry.path());
+          if (entry.path().filename() == "dir") {
+            REQUIRE(entry.is_directory());
+          } else {
+            REQUIRE(entry.is_regular_file());
+          }
+        }
+        reader.next(on_batch);
+      };
+  reader.next(on_batch);
+  loop.RunUntil([&]() { return finished || failed; });
+
+  REQUIRE(!failed);
+  REQUIRE(batches == 2);
+  REQUIRE(listed == expected);
+
+  // Reading past the end gives empty batches
+  finished = false;
+  reader.next(on_batch);
+  loop.RunUntil([&]() { return finished || failed; });
+  REQUIRE(listed.size() == expected.size());
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Dir / async_directory_reader / errors", "[common][filesystem][dir][async]") {
+  const auto p = testing::nonexistent_path();
+  // Without executor, the callback is called from the I/O thread
+  fs::async_directory_reader reader(p);
+
+  std::mutex mutex;
+  std::condition_variable called;
+  bool done = false;
+  std::error_code ec;
+  reader.next([&](std::vector<fs::directory_entry> entries, std::error_code error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    REQUIRE(entries.empty());
+    ec = error;
+    done = true;
+    called.notify_one();
+  });
+  std::unique_lock<std::mutex> lock(mutex);
+  called.wait(lock, [&]() { return done; });
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+}
+
+TEST_CASE("Dir / async_directory_reader / destroyed while reading",
+    "[common][filesystem][dir][async]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  std::ofstream{p / "file"};
+
+  EventLoop loop;
+  bool called = false;
+  {
+    fs::async_directory_reader reader(p, fs::directory_options::none, loop.executor());
+    reader.next([&](std::vector<fs::directory_entry>, std::error_code) { called = true; });
+  }
+  // The read still completes and is handed to the loop, without calling back
+  loop.RunUntil([&]() { return loop.Ran() == 1; });
+  remove_all(p, ec);
+  REQUIRE(!called);
+}
+
+TEST_CASE("Dir / async_directory_reader / destroyed while calling back",
+    "[common][filesystem][dir][async]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+
+  std::mutex mutex;
+  std::condition_variable called;
+  bool entered = false;
+  std::atomic<bool> returned{false};
+  {
+    fs::async_directory_reader reader(p);
+    reader.next([&](std::vector<fs::directory_entry>, std::error_code) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        entered = true;
+        called.notify_one();
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      returned = true;
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    called.wait(lock, [&]() { return entered; });
+  }
+  // The destructor waited for the callback already running to return
+  REQUIRE(returned);
+  remove_all(p, ec);
+}
+
+TEST_CASE("Dir / async_directory_reader / destroyed by the callback",
+    "[common][filesystem][dir][async]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+
+  EventLoop loop;
+  auto reader = std::make_unique<fs::async_directory_reader>(
+      p, fs::directory_options::none, loop.executor());
+  reader->next([&](std::vector<fs::directory_entry>, std::error_code) { reader.reset(); });
+  loop.RunUntil([&]() { return !reader; });
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
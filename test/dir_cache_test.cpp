@@ -0,0 +1,185 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "fs_testsuite.h"
+
+namespace {
+
+auto Names(const fs::directory_cache::listing &entries) -> std::vector<std::string> {
+  std::vector<std::string> names;
+  for (const auto &entry : *entries) {
+    names.push_back(entry.filename.string());
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+//  directory_cache
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Dir / directory_cache / list", "[common][filesystem][dir][directory_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  std::ofstream{p / "file"};
+  create_directory(p / "dir");
+  create_symlink("file", p / "link");
+
+  fs::directory_cache cache;
+  auto entries = cache.list(p);
+  REQUIRE(Names(entries) == std::vector<std::string>{"dir", "file", "link"});
+  for (const auto &entry : *entries) {
+    if (entry.filename == "dir") {
+      REQUIRE(entry.type == fs::file_type::directory);
+    } else if (entry.filename == "file") {
+      REQUIRE(entry.type == fs::file_type::regular);
+    } else {
+      REQUIRE(entry.type == fs::file_type::symlink);
+    }
+  }
+  REQUIRE(cache.size() == 1);
+
+  // Nothing changed, the same listing is given back
+  REQUIRE(cache.list(p).get() == entries.get());
+  // Writing to a file does not change the listing
+  {
+    std::ofstream file{p / "file"};
+    file << "hello";
+  }
+  // Changes are only seen for sure with notifications; the modification time
+  // of the directory may not have moved yet.
+  if (cache.uses_notifications()) {
+    REQUIRE(cache.list(p).get() == entries.get());
+  }
+
+  // Added, renamed and removed entries are seen
+  std::ofstream{p / "new"};
+  REQUIRE(Names(cache.list(p)) == std::vector<std::string>{"dir", "file", "link", "new"});
+  rename(p / "new", p / "renamed");
+  REQUIRE(Names(cache.list(p)) == std::vector<std::string>{"dir", "file", "link", "renamed"});
+  remove(p / "renamed");
+  remove(p / "link");
+  REQUIRE(Names(cache.list(p)) == std::vector<std::string>{"dir", "file"});
+  // Moved in from another directory
+  std::ofstream{p / "dir" / "moved"};
+  REQUIRE(cache.list(p / "dir")->size() == 1);
+  REQUIRE(cache.size() == 2);
+  rename(p / "dir" / "moved", p / "moved");
+  REQUIRE(Names(cache.list(p)) == std::vector<std::string>{"dir", "file", "moved"});
+  REQUIRE(cache.list(p / "dir")->empty());
+
+  // Removing the directory itself
+  remove(p / "dir");
+  REQUIRE(cache.list(p / "dir", ec)->empty());
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  REQUIRE_THROWS_AS(cache.list(p / "dir"), fs::filesystem_error);
+  // And creating it again
+  create_directory(p / "dir");
+  std::ofstream{p / "dir" / "again"};
+  REQUIRE(Names(cache.list(p / "dir", ec)) == std::vector<std::string>{"again"});
+  REQUIRE(!ec);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Dir / directory_cache / modification time", "[common][filesystem][dir][directory_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  std::ofstream{p / "file"};
+
+  fs::directory_cache cache(16, false);
+  REQUIRE(!cache.uses_notifications());
+
+  // Modified too recently to tell a later change apart, so not kept
+  auto entries = cache.list(p);
+  REQUIRE(Names(entries) == std::vector<std::string>{"file"});
+  REQUIRE(cache.size() == 0);
+  REQUIRE(cache.list(p).get() != entries.get());
+
+  // Kept once the modification time settled...
+  last_write_time(p, last_write_time(p) - std::chrono::hours(1));
+  entries = cache.list(p);
+  REQUIRE(cache.size() == 1);
+  REQUIRE(cache.list(p).get() == entries.get());
+
+  // ...until the directory changes
+  std::ofstream{p / "new"};
+  REQUIRE(Names(cache.list(p)) == std::vector<std::string>{"file", "new"});
+  REQUIRE(cache.size() == 0);
+  remove(p / "new");
+  REQUIRE(Names(cache.list(p)) == std::vector<std::string>{"file"});
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Dir / directory_cache / invalidate", "[common][filesystem][dir][directory_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  for (const auto *name : {"a", "b", "c"}) {
+    create_directory(p / name);
+  }
+
+  fs::directory_cache cache(2);
+  auto a = cache.list(p / "a");
+  cache.list(p / "b");
+  REQUIRE(cache.size() == 2);
+  // The least recently used is dropped
+  REQUIRE(cache.list(p / "a").get() == a.get());
+  cache.list(p / "c");
+  REQUIRE(cache.size() == 2);
+  REQUIRE(cache.list(p / "a").get() == a.get());
+  REQUIRE(cache.size() == 2);
+
+  // The listings handed out stay valid when dropped
+  cache.invalidate(p / "a");
+  REQUIRE(cache.size() == 1);
+  REQUIRE(a->empty());
+  REQUIRE(cache.list(p / "a").get() != a.get());
+
+  // Relative paths are made absolute
+  const auto cwd = fs::current_path();
+  fs::current_path(p);
+  REQUIRE(cache.list("a")->empty());
+  cache.invalidate("a");
+  cache.invalidate("missing");
+  fs::current_path(cwd);
+  REQUIRE(cache.size() == 1);
+
+  cache.clear();
+  REQUIRE(cache.size() == 0);
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
@@ -19,6 +19,10 @@
 #endif // __clang__
 
 #include <catch2/catch.hpp>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "fs_testsuite.h"
 
@@ -260,6 +264,162 @@ TEST_CASE("Dir / dir_iterator / noexcept", "[common][filesystem][ops][dir_iterat
   static_assert(noexcept(end(it)), "end is noexcept");
 }
 
+TEST_CASE("Dir / dir_iterator / many entries", "[common][filesystem][ops][dir_iterator]") {
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::scoped_file sp(p, testing::scoped_file::adopt_file);
+
+  // More entries than can be read from the directory in one go
+  const auto prefix = std::string(60, 'x');
+  std::set<std::string> expected;
+  for (auto i = 0; i < 2000; ++i) {
+    auto name = prefix + std::to_string(i);
+    if (i % 10 == 0) {
+      create_directory(p / name);
+    } else {
+      std::ofstream{p / name};
+    }
+    expected.insert(name);
+  }
+
+  std::set<std::string> found;
+  for (const auto &entry : fs::directory_iterator(p)) {
+    REQUIRE(entry.path().parent_path() == p);
+    const auto name = entry.path().filename().string();
+    REQUIRE(found.insert(name).second);
+    const auto index = std::stoi(name.substr(prefix.size()));
+    REQUIRE(entry.is_directory() == (index % 10 == 0));
+  }
+  REQUIRE(found == expected);
+}
+
+TEST_CASE("Dir / dir_iterator / entry paths", "[common][filesystem][ops][dir_iterator]") {
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::scoped_file sp(p, testing::scoped_file::adopt_file);
+  std::set<std::string> names{"a", "a_much_longer_name_than_the_first_one", "b",
+                              "c.ext"};
+  for (const auto &name : names) {
+    std::ofstream{p / name};
+  }
+
+  // The entry paths are reused from one entry to the next, but each of them
+  // must be the same as building it from the iterated directory.
+  for (const auto &root : {p, p / "", p / "." / ""}) {
+    std::set<std::string> found;
+    for (const auto &entry : fs::directory_iterator(root)) {
+      const auto name = entry.path().filename();
+      const auto expected = root / name;
+      REQUIRE(entry.path() == expected);
+      REQUIRE(entry.path().native() == expected.native());
+      REQUIRE(std::distance(entry.path().begin(), entry.path().end()) ==
+              std::distance(expected.begin(), expected.end()));
+      found.insert(name.string());
+    }
+    REQUIRE(found == names);
+  }
+}
+
+#if !defined(ASAP_WINDOWS)
+TEST_CASE("Dir / dir_iterator / entry attributes", "[common][filesystem][ops][dir_iterator]") {
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::scoped_file sp(p, testing::scoped_file::adopt_file);
+  {
+    std::ofstream file{p / "file"};
+    file << "hello";
+  }
+  create_directory(p / "dir");
+  create_symlink("file", p / "link");
+  create_symlink("none", p / "dangling");
+
+  // Entries from the iterator, with and without allowing stale attributes,
+  // and entries refreshed from their path must all agree.
+  std::vector<fs::directory_entry> entries;
+  for (auto opts : {fs::directory_options::none, fs::directory_options::allow_stale_attributes}) {
+    for (const auto &entry : fs::directory_iterator(p, opts)) {
+      entries.push_back(entry);
+      entries.emplace_back(entry.path());
+    }
+  }
+  REQUIRE(entries.size() == 16);
+
+  for (const auto &entry : entries) {
+    std::error_code ec;
+    const auto name = entry.path().filename().string();
+    if (name == "file") {
+      REQUIRE(entry.is_regular_file());
+      REQUIRE(!entry.is_symlink());
+      REQUIRE(entry.file_size() == 5);
+      REQUIRE(entry.hard_link_count() == 1);
+      REQUIRE(entry.last_write_time() == last_write_time(p / "file"));
+      REQUIRE(entry.status().permissions() == status(p / "file").permissions());
+      REQUIRE(entry.symlink_status().type() == fs::file_type::regular);
+    } else if (name == "dir") {
+      REQUIRE(entry.is_directory(ec));
+      REQUIRE(!ec);
+      entry.file_size(ec);
+      REQUIRE(ec == std::errc::is_a_directory);
+    } else if (name == "link") {
+      REQUIRE(entry.is_symlink());
+      REQUIRE(entry.is_regular_file());
+      REQUIRE(entry.file_size() == 5);
+      REQUIRE(entry.last_write_time() == last_write_time(p / "file"));
+      REQUIRE(entry.status().type() == fs::file_type::regular);
+      REQUIRE(entry.symlink_status().type() == fs::file_type::symlink);
+    } else {
+      REQUIRE(name == "dangling");
+      REQUIRE(entry.is_symlink());
+      REQUIRE(!entry.exists(ec));
+      REQUIRE(entry.status().type() == fs::file_type::not_found);
+      REQUIRE(entry.symlink_status().type() == fs::file_type::symlink);
+    }
+
+    // Not all file systems record the creation time
+    const auto birth_time = entry.birth_time(ec);
+    if (name == "dangling") {
+      REQUIRE(ec);
+    } else if (!ec) {
+      REQUIRE(birth_time <= entry.last_write_time());
+    } else {
+      REQUIRE(ec == std::errc::not_supported);
+    }
+  }
+}
+#endif // ASAP_WINDOWS
+
+#if defined(ASAP_LINUX)
+TEST_CASE("Dir / dir_iterator / renamed directory", "[common][filesystem][ops][dir_iterator]") {
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  const auto q = testing::nonexistent_path();
+  create_directory(p);
+  {
+    std::ofstream file{p / "file"};
+    file << "hello";
+  }
+
+  // The current entry fetches its attributes relative to the open directory,
+  // so it does not depend on the path of that directory. A copy of the entry
+  // only has its path.
+  auto iter = fs::directory_iterator(p);
+  REQUIRE(iter->path() == p / "file");
+  const fs::directory_entry copy = *iter;
+  rename(p, q);
+  ec = bad_ec;
+  REQUIRE(iter->file_size(ec) == 5);
+  REQUIRE(!ec);
+  REQUIRE(iter->is_regular_file());
+  copy.file_size(ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  ++iter;
+  REQUIRE(iter == end(iter));
+
+  remove_all(q, ec);
+}
+#endif // ASAP_LINUX
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif // __clang__
@@ -20,6 +20,13 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
 #include "fs_testsuite.h"
 
 // -----------------------------------------------------------------------------
@@ -141,6 +148,98 @@ TEST_CASE(
   remove_all(p, ec);
 }
 
+namespace {
+auto CollectPaths(fs::recursive_directory_iterator iter) -> std::vector<fs::path> {
+  std::vector<fs::path> paths;
+  for (; iter != end(iter); ++iter) {
+    paths.push_back(iter->path());
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+#if defined(ASAP_LINUX)
+auto CountOpenFiles() -> std::ptrdiff_t {
+  return std::distance(fs::directory_iterator("/proc/self/fd"), fs::directory_iterator());
+}
+#endif // ASAP_LINUX
+} // namespace
+
+TEST_CASE("Dir / dir_recursive_iterator / max open directories",
+    "[common][filesystem][ops][dir_recursive_iterator]") {
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  fs::path deepest = p;
+  constexpr int DEPTH = 8;
+  for (int level = 0; level < DEPTH; ++level) {
+    deepest /= "d";
+    ec = bad_ec;
+    create_directories(deepest, ec);
+    REQUIRE(!ec);
+    for (const auto *name : {"f1", "f2", "f3"}) {
+      std::ofstream{deepest.parent_path() / name};
+    }
+  }
+
+  auto iter = fs::recursive_directory_iterator(p);
+  REQUIRE(iter.max_open_directories() == 64);
+  const auto expected = CollectPaths(iter);
+  REQUIRE(expected.size() == DEPTH * 4);
+
+  for (std::size_t max_open : {0, 1, 2, 3}) {
+    iter = fs::recursive_directory_iterator(p);
+    iter.set_max_open_directories(max_open);
+    REQUIRE(iter.max_open_directories() == (max_open == 0 ? 1 : max_open));
+    REQUIRE(CollectPaths(iter) == expected);
+  }
+
+#if defined(ASAP_LINUX)
+  // Only the directory being iterated stays open, however deep it is.
+  iter = fs::recursive_directory_iterator(p);
+  iter.set_max_open_directories(1);
+  const auto open_at_top = CountOpenFiles();
+  for (; iter != end(iter) && iter.depth() < DEPTH - 1; ++iter) {
+  }
+  REQUIRE(iter != end(iter));
+  REQUIRE(CountOpenFiles() == open_at_top);
+#endif // ASAP_LINUX
+
+  remove_all(p, ec);
+}
+
+#if defined(ASAP_LINUX)
+TEST_CASE("Dir / dir_recursive_iterator / renamed ancestor",
+    "[common][filesystem][ops][dir_recursive_iterator]") {
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  ec = bad_ec;
+  create_directories(p / "a/b/c", ec);
+  REQUIRE(!ec);
+
+  // Sub-directories are opened relative to their parent, so recursion keeps
+  // working after an ancestor of the current entry has been renamed.
+  ec = bad_ec;
+  auto iter = fs::recursive_directory_iterator(p, ec);
+  REQUIRE(!ec);
+  REQUIRE(iter->path() == p / "a");
+  ++iter;
+  REQUIRE(iter->path() == p / "a/b");
+  rename(p / "a", p / "x", ec);
+  REQUIRE(!ec);
+  ec = bad_ec;
+  iter.increment(ec);
+  REQUIRE(!ec);
+  REQUIRE(iter != end(iter));
+  REQUIRE(iter->path() == p / "a/b/c");
+  ++iter;
+  REQUIRE(iter == end(iter));
+
+  remove_all(p, ec);
+}
+#endif // ASAP_LINUX
+
 TEST_CASE("Dir / dir_recursive_iterator / noexcept",
     "[common][filesystem][ops][dir_recursive_iterator]") {
   auto p = testing::nonexistent_path();
@@ -157,6 +256,81 @@ TEST_CASE("Dir / dir_recursive_iterator / noexcept",
   remove_all(p, ec);
 }
 
+// -----------------------------------------------------------------------------
+//  parallel_walk
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Dir / parallel_walk", "[common][filesystem][ops][dir_recursive_iterator]") {
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  for (const auto *dir : {"a/b/c", "a/d", "e/f/g/h", "i"}) {
+    ec = bad_ec;
+    create_directories(p / dir, ec);
+    REQUIRE(!ec);
+  }
+  for (const auto *file : {"f1", "a/f2", "a/b/f3", "a/b/c/f4", "e/f/g/h/f5"}) {
+    std::ofstream{p / file};
+  }
+  const auto expected = CollectPaths(fs::recursive_directory_iterator(p));
+
+  std::mutex mutex;
+  std::vector<fs::path> visited;
+  const auto visit_all = [&](const fs::directory_entry &entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    visited.push_back(entry.path());
+    return true;
+  };
+
+  SECTION("visits the same entries as recursive_directory_iterator") {
+    for (std::size_t concurrency : {0, 1, 4}) {
+      visited.clear();
+      fs::parallel_policy policy;
+      policy.max_concurrency = concurrency;
+      ec = bad_ec;
+      parallel_walk(p, fs::directory_options::none, visit_all, policy, ec);
+      REQUIRE(!ec);
+      std::sort(visited.begin(), visited.end());
+      REQUIRE(visited == expected);
+    }
+  }
+
+  SECTION("does not walk into pruned directories") {
+    parallel_walk(p, fs::directory_options::none, [&](const fs::directory_entry &entry) {
+      std::lock_guard<std::mutex> lock(mutex);
+      visited.push_back(entry.path());
+      return entry.path().filename() != "a";
+    });
+    REQUIRE(std::find(visited.begin(), visited.end(), p / "a") != visited.end());
+    for (const auto &path : visited) {
+      REQUIRE(path.parent_path() != p / "a");
+    }
+    REQUIRE(visited.size() == expected.size() - 6);
+  }
+
+  SECTION("reports a missing root") {
+    ec = bad_ec;
+    parallel_walk(p / "missing", fs::directory_options::none, visit_all, ec);
+    REQUIRE(ec);
+    REQUIRE(visited.empty());
+    REQUIRE_THROWS_AS(parallel_walk(p / "missing", fs::directory_options::none, visit_all),
+        fs::filesystem_error);
+  }
+
+  SECTION("rethrows the exceptions of the visitor") {
+    const auto throw_in_depth = [](const fs::directory_entry &entry) {
+      if (entry.path().filename() == "h") {
+        throw std::runtime_error("stop");
+      }
+      return true;
+    };
+    REQUIRE_THROWS_AS(parallel_walk(p, fs::directory_options::none, throw_in_depth),
+        std::runtime_error);
+  }
+
+  remove_all(p, ec);
+}
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif // __clang__
@@ -0,0 +1,265 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "fs_testsuite.h"
+
+namespace {
+
+// Collects the events reported by a watcher.
+class EventLog {
+ public:
+  auto callback() -> fs::watcher::callback {
+    return [this](std::vector<fs::watch_event> events) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++batches_;
+      for (auto &event : events) {
+        events_.push_back(std::move(event));
+      }
+      reported_.notify_all();
+    };
+  }
+
+  // Waits until an event of `kind` is reported for `p`.
+  auto WaitFor(fs::watch_event_kind kind, const fs::path &p,
+      const fs::path &new_path = {}) -> bool {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return reported_.wait_for(lock, std::chrono::seconds(10), [&]() {
+      for (const auto &event : events_) {
+        if (event.kind == kind && event.path == p && event.new_path == new_path) {
+          return true;
+        }
+      }
+      return false;
+    });
+  }
+
+  auto Has(const fs::path &p) -> bool {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &event : events_) {
+      if (event.path == p || event.new_path == p) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto Batches() -> std::size_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable reported_;
+  std::vector<fs::watch_event> events_;
+  std::size_t batches_{0};
+};
+
+auto Options(bool allow_notifications, bool recursive) -> fs::watch_options {
+  fs::watch_options options;
+  options.recursive = recursive;
+  options.latency = std::chrono::milliseconds(10);
+  options.poll_interval = std::chrono::milliseconds(20);
+  options.allow_notifications = allow_notifications;
+  return options;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+//  watcher
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Dir / watcher / directory", "[common][filesystem][dir][watcher]") {
+  std::error_code ec;
+  const bool allow_notifications = GENERATE(true, false);
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+
+  EventLog log;
+  fs::watcher watcher(p, log.callback(), Options(allow_notifications, false));
+  if (!allow_notifications) {
+    REQUIRE(!watcher.uses_notifications());
+  }
+
+  std::ofstream{p / "file"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "file"));
+  {
+    std::ofstream file{p / "file"};
+    file << "hello";
+  }
+  REQUIRE(log.WaitFor(fs::watch_event_kind::modified, p / "file"));
+
+  rename(p / "file", p / "renamed");
+  if (watcher.uses_notifications()) {
+    REQUIRE(log.WaitFor(fs::watch_event_kind::renamed, p / "file", p / "renamed"));
+  } else {
+    REQUIRE(log.WaitFor(fs::watch_event_kind::removed, p / "file"));
+    REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "renamed"));
+  }
+  remove(p / "renamed");
+  REQUIRE(log.WaitFor(fs::watch_event_kind::removed, p / "renamed"));
+
+  // Not recursive
+  create_directory(p / "dir");
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "dir"));
+  std::ofstream{p / "dir" / "file"};
+  std::ofstream{p / "marker"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "marker"));
+  REQUIRE(!log.Has(p / "dir" / "file"));
+
+  remove_all(p, ec);
+  REQUIRE(log.WaitFor(fs::watch_event_kind::removed, p));
+}
+
+TEST_CASE("Dir / watcher / recursive", "[common][filesystem][dir][watcher]") {
+  std::error_code ec;
+  const bool allow_notifications = GENERATE(true, false);
+  const auto p = testing::nonexistent_path();
+  create_directories(p / "a" / "b");
+
+  EventLog log;
+  fs::watcher watcher(p, log.callback(), Options(allow_notifications, true));
+
+  std::ofstream{p / "a" / "b" / "file"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "a" / "b" / "file"));
+
+  // New directories are watched too, including what they had before that
+  create_directories(p / "c" / "d");
+  std::ofstream{p / "c" / "d" / "file"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "c" / "d" / "file"));
+  std::ofstream{p / "c" / "d" / "other"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "c" / "d" / "other"));
+
+  // Moved directories keep being watched under their new path
+  rename(p / "c", p / "a" / "c");
+  std::ofstream{p / "a" / "c" / "d" / "moved"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "a" / "c" / "d" / "moved"));
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Dir / watcher / out of watches", "[common][filesystem][dir][watcher]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directories(p / "a");
+
+  EventLog log;
+  auto options = Options(true, true);
+  options.max_watches = 2;
+  fs::watcher watcher(p, log.callback(), options);
+  if (!watcher.uses_notifications()) {
+    remove_all(p, ec);
+    return;
+  }
+
+  // The new directories cannot all be watched, and the tree is scanned instead
+  create_directories(p / "b" / "c");
+  REQUIRE(log.WaitFor(fs::watch_event_kind::overflow, {}));
+  REQUIRE(!watcher.uses_notifications());
+  std::ofstream{p / "b" / "c" / "file"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "b" / "c" / "file"));
+  std::ofstream{p / "a" / "file"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "a" / "file"));
+
+  // Too many directories to start with
+  options.max_watches = 1;
+  EventLog scan_log;
+  fs::watcher scanning(p, scan_log.callback(), options);
+  REQUIRE(!scanning.uses_notifications());
+  std::ofstream{p / "b" / "c" / "other"};
+  REQUIRE(scan_log.WaitFor(fs::watch_event_kind::created, p / "b" / "c" / "other"));
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Dir / watcher / file", "[common][filesystem][dir][watcher]") {
+  std::error_code ec;
+  const bool allow_notifications = GENERATE(true, false);
+  const auto p = testing::nonexistent_path();
+  std::ofstream{p};
+
+  EventLog log;
+  fs::watcher watcher(p, log.callback(), Options(allow_notifications, false));
+  {
+    std::ofstream file{p};
+    file << "hello";
+  }
+  REQUIRE(log.WaitFor(fs::watch_event_kind::modified, p));
+  remove(p);
+  REQUIRE(log.WaitFor(fs::watch_event_kind::removed, p));
+}
+
+TEST_CASE("Dir / watcher / coalesced", "[common][filesystem][dir][watcher]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+
+  EventLog log;
+  auto options = Options(true, false);
+  options.latency = std::chrono::milliseconds(200);
+  fs::watcher watcher(p, log.callback(), options);
+  if (!watcher.uses_notifications()) {
+    remove_all(p, ec);
+    return;
+  }
+
+  // Created and removed within the same batch
+  std::ofstream{p / "gone"};
+  remove(p / "gone");
+  std::ofstream{p / "file"};
+  REQUIRE(log.WaitFor(fs::watch_event_kind::created, p / "file"));
+  REQUIRE(!log.Has(p / "gone"));
+  REQUIRE(log.Batches() == 1);
+
+  // Overflow
+  options.latency = std::chrono::milliseconds(10);
+  options.max_events = 4;
+  EventLog overflow_log;
+  fs::watcher small(p, overflow_log.callback(), options);
+  for (int index = 0; index < 10; ++index) {
+    std::ofstream{p / std::to_string(index)};
+  }
+  REQUIRE(overflow_log.WaitFor(fs::watch_event_kind::overflow, {}));
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Dir / watcher / errors", "[common][filesystem][dir][watcher]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  EventLog log;
+  REQUIRE_THROWS_AS(fs::watcher(p, log.callback()), fs::filesystem_error);
+  fs::watcher watcher(p, log.callback(), {}, ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  REQUIRE(!watcher.uses_notifications());
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
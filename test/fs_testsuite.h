@@ -23,7 +23,9 @@
 
 #include <cstdio>
 #include <fstream>
+#include <iterator>
 #include <sstream>
+#include <string>
 #include <utility>
 
 namespace fs = asap::filesystem;
@@ -178,6 +180,18 @@ struct scoped_file {
   path path_{};
 };
 
+// Replaces the content of the file, creating it if needed.
+inline void WriteFile(const path &p, const std::string &content) {
+  std::ofstream file{p.c_str(), std::ios::binary};
+  file << content;
+}
+
+inline auto ReadFile(const path &p) -> std::string {
+  std::ifstream file{p.c_str(), std::ios::binary};
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
 #if defined(ASAP_WINDOWS)
 // Symbolic links without privilege escalation require developer mode and
 // windows creator update version (10.0 build 1703).
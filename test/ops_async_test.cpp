@@ -0,0 +1,224 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include "fs_testsuite.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// -----------------------------------------------------------------------------
+//  async_queue
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Ops / async / status", "[common][filesystem][ops][async]") {
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+  const bool allow_io_uring = GENERATE(true, false);
+  fs::async_queue queue(8, allow_io_uring);
+  if (!allow_io_uring) {
+    REQUIRE(!queue.uses_io_uring());
+  }
+
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  {
+    std::ofstream file{p / "file"};
+    file << "hello";
+  }
+  create_symlink("file", p / "link");
+
+  REQUIRE(queue.status(p).get().type() == fs::file_type::directory);
+  REQUIRE(queue.status(p / "link").get().type() == fs::file_type::regular);
+  REQUIRE(queue.symlink_status(p / "link").get().type() == fs::file_type::symlink);
+  REQUIRE(queue.status(p / "missing").get().type() == fs::file_type::not_found);
+  REQUIRE(queue.file_size(p / "link").get() == 5);
+  REQUIRE_THROWS_AS(queue.file_size(p).get(), fs::filesystem_error);
+
+  fs::file_status status;
+  std::error_code ec = bad_ec;
+  queue.status(p / "missing", [&](fs::file_status st, std::error_code error) {
+    status = st;
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(status.type() == fs::file_type::not_found);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+
+  std::uintmax_t size = 0;
+  ec = bad_ec;
+  queue.file_size(p / "file", [&](std::uintmax_t sz, std::error_code error) {
+    size = sz;
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(size == 5);
+  REQUIRE(!ec);
+
+  queue.file_size(p, [&](std::uintmax_t sz, std::error_code error) {
+    size = sz;
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(size == static_cast<std::uintmax_t>(-1));
+  REQUIRE(ec == std::errc::is_a_directory);
+
+  const auto write_time = last_write_time(p / "file") - std::chrono::hours(1);
+  last_write_time(p / "file", write_time);
+  REQUIRE(queue.last_write_time(p / "link").get() == write_time);
+  REQUIRE(queue.last_write_time(p).get() == last_write_time(p));
+  REQUIRE_THROWS_AS(queue.last_write_time(p / "missing").get(), fs::filesystem_error);
+
+  auto time = fs::file_time_type::max();
+  queue.last_write_time(p / "missing", [&](fs::file_time_type tm, std::error_code error) {
+    time = tm;
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(time == fs::file_time_type::min());
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / async / create and remove", "[common][filesystem][ops][async]") {
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+  std::error_code ec;
+  fs::async_queue queue(8, GENERATE(true, false));
+
+  const auto p = testing::nonexistent_path();
+  REQUIRE(queue.create_directory(p).get());
+  REQUIRE(!queue.create_directory(p).get());
+  REQUIRE(is_directory(p));
+  REQUIRE_THROWS_AS(queue.create_directory(p / "a" / "b").get(), fs::filesystem_error);
+
+  std::ofstream{p / "file"};
+  queue.rename(p / "file", p / "renamed").get();
+  REQUIRE(!exists(p / "file"));
+  REQUIRE(exists(p / "renamed"));
+  REQUIRE_THROWS_AS(queue.rename(p / "file", p / "other").get(), fs::filesystem_error);
+
+  bool removed = false;
+  ec = bad_ec;
+  queue.remove(p / "renamed", [&](bool result, std::error_code error) {
+    removed = result;
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(removed);
+  REQUIRE(!ec);
+  REQUIRE(!exists(p / "renamed"));
+
+  // Missing paths are not an error
+  ec = bad_ec;
+  queue.remove(p / "renamed", [&](bool result, std::error_code error) {
+    removed = result;
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(!removed);
+  REQUIRE(!ec);
+  REQUIRE(!queue.remove("").get());
+
+  // Directories are removed too, when empty
+  create_directory(p / "dir");
+  std::ofstream{p / "dir" / "file"};
+  REQUIRE_THROWS_AS(queue.remove(p / "dir").get(), fs::filesystem_error);
+  REQUIRE(queue.remove(p / "dir" / "file").get());
+  REQUIRE(queue.remove(p / "dir").get());
+  REQUIRE(queue.remove(p).get());
+  REQUIRE(!exists(p));
+}
+
+TEST_CASE("Ops / async / open", "[common][filesystem][ops][async]") {
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+  std::error_code ec;
+  fs::async_queue queue(8, GENERATE(true, false));
+
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  auto file = queue.open(p / "file", fs::open_flags::write | fs::open_flags::create).get();
+  REQUIRE(file.is_open());
+  REQUIRE(file.path() == p / "file");
+  REQUIRE(file.pwrite("hello", 5, 0) == 5);
+  file.close();
+  REQUIRE(file_size(p / "file") == 5);
+  REQUIRE_THROWS_AS(queue.open(p / "missing").get(), fs::filesystem_error);
+
+  fs::file_handle opened;
+  ec = bad_ec;
+  queue.open(p / "file", fs::open_flags::read, [&](fs::file_handle handle, std::error_code error) {
+    opened = std::move(handle);
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(!ec);
+  REQUIRE(opened.is_open());
+  char content[5];
+  REQUIRE(opened.pread(content, sizeof(content), 0) == 5);
+  REQUIRE(std::string(content, 5) == "hello");
+  opened.close();
+
+  queue.open(p / "missing", fs::open_flags::read, [&](fs::file_handle handle, std::error_code error) {
+    opened = std::move(handle);
+    ec = error;
+  });
+  queue.wait();
+  REQUIRE(!opened.is_open());
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / async / many in flight", "[common][filesystem][ops][async]") {
+  std::error_code ec;
+  // More operations than fit in the queue, some of them submitted from the
+  // callbacks.
+  fs::async_queue queue(4, GENERATE(true, false));
+
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  const int count = 100;
+  std::atomic<int> created{0};
+  std::atomic<int> found{0};
+  for (int index = 0; index < count; ++index) {
+    const auto dir = p / std::to_string(index);
+    queue.create_directory(dir, [&, dir](bool result, std::error_code error) {
+      if (result && !error) {
+        ++created;
+        queue.status(dir, [&](fs::file_status st, std::error_code) {
+          if (is_directory(st)) {
+            ++found;
+          }
+        });
+      }
+    });
+  }
+  queue.wait();
+  REQUIRE(created == count);
+  REQUIRE(found == count);
+
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
@@ -0,0 +1,191 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "fs_testsuite.h"
+
+using testing::ComparePaths;
+
+// -----------------------------------------------------------------------------
+//  canonicalizer
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Ops / canonicalizer / same as canonical", "[common][filesystem][ops][canonical]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directories(p / "a" / "b");
+  std::ofstream{p / "a" / "b" / "file"};
+  create_directory_symlink("a/b", p / "to_b");
+  create_directory_symlink("../a", p / "a" / "up");
+  create_symlink(fs::absolute(p / "a" / "b" / "file"), p / "to_file");
+  create_symlink("to_file", p / "to_to_file");
+
+  fs::canonicalizer resolver;
+  const std::vector<fs::path> paths = {
+      p,
+      p / "a" / "b" / "file",
+      p / "a" / "." / "b" / ".." / "b" / "file",
+      p / "to_b" / "file",
+      p / "to_b" / ".." / "up" / "up" / "b",
+      p / "to_file",
+      p / "to_to_file",
+      p / "a" / "b" / "",
+      fs::current_path() / "." / (p.string() + "////././."),
+      "/",
+      "/../.././.",
+  };
+  // Twice, the second time from what was remembered
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const auto &path : paths) {
+      INFO(path);
+      ComparePaths(resolver.canonical(path), fs::canonical(path));
+    }
+  }
+  REQUIRE(resolver.size() > 0);
+  resolver.clear();
+  REQUIRE(resolver.size() == 0);
+
+  auto results = resolver.canonical_many(paths);
+  REQUIRE(results.size() == paths.size());
+  for (std::size_t index = 0; index < paths.size(); ++index) {
+    REQUIRE(!results[index].ec);
+    ComparePaths(results[index].path, fs::canonical(paths[index]));
+  }
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / canonicalizer / errors", "[common][filesystem][ops][canonical]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+
+  fs::canonicalizer resolver;
+  resolver.canonical(p, ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  REQUIRE_THROWS_AS(resolver.canonical(p), fs::filesystem_error);
+
+  create_directory(p);
+  std::ofstream{p / "file"};
+  create_symlink("loop", p / "loop");
+  create_symlink("missing", p / "dangling");
+
+  resolver.canonical(p / "file" / "x", ec);
+  REQUIRE(ec == std::errc::not_a_directory);
+  resolver.canonical(p / "file" / "..", ec);
+  REQUIRE(ec == std::errc::not_a_directory);
+  resolver.canonical(p / "loop", ec);
+  REQUIRE(ec == std::errc::too_many_symbolic_link_levels);
+  resolver.canonical(p / "dangling", ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+
+  // Errors are reported per path
+  const std::vector<fs::path> paths = {p / "file", p / "missing", p};
+  auto results = resolver.canonical_many(paths);
+  REQUIRE(!results[0].ec);
+  REQUIRE(results[1].ec == std::errc::no_such_file_or_directory);
+  REQUIRE(results[1].path.empty());
+  REQUIRE(!results[2].ec);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / canonicalizer / relative and parallel", "[common][filesystem][ops][canonical]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  std::vector<fs::path> paths;
+  for (int dir = 0; dir < 10; ++dir) {
+    const auto sub = p / std::to_string(dir);
+    create_directories(sub);
+    for (int file = 0; file < 50; ++file) {
+      paths.push_back(sub / (std::to_string(file) + ".txt"));
+      std::ofstream{paths.back()};
+    }
+  }
+  // testing::nonexistent_path() is relative to the current directory
+  REQUIRE(p.is_relative());
+
+  fs::canonicalizer resolver(4);
+  fs::parallel_policy policy;
+  policy.max_concurrency = 4;
+  auto results = resolver.canonical_many(paths, policy);
+  for (std::size_t index = 0; index < paths.size(); ++index) {
+    REQUIRE(!results[index].ec);
+    ComparePaths(results[index].path, fs::canonical(paths[index]));
+  }
+  // Forgets part of them once full
+  REQUIRE(resolver.size() <= 4);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / canonicalizer / contention", "[common][filesystem][ops][canonical]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  std::vector<fs::path> paths;
+  for (int dir = 0; dir < 8; ++dir) {
+    const auto sub = p / std::to_string(dir) / "sub";
+    create_directories(sub);
+    create_directory_symlink(std::to_string(dir), p / ("link" + std::to_string(dir)));
+    for (int file = 0; file < 20; ++file) {
+      std::ofstream{sub / (std::to_string(file) + ".txt")};
+    }
+  }
+  // Many threads going through the same directories and symlinks
+  for (int round = 0; round < 20; ++round) {
+    for (int dir = 0; dir < 8; ++dir) {
+      const auto name = std::to_string(dir);
+      const auto file = std::to_string(round) + ".txt";
+      paths.push_back(p / name / "sub" / (std::to_string(round % 20) + ".txt"));
+      paths.push_back(p / ("link" + name) / "sub" / ".." / "sub" / file);
+      paths.push_back(p / ("link" + std::to_string(7 - dir)) / ".." / ("link" + name) / "sub");
+    }
+  }
+
+  std::vector<fs::path> expected;
+  for (const auto &path : paths) {
+    expected.push_back(fs::canonical(path));
+  }
+  fs::parallel_policy policy;
+  policy.max_concurrency = 8;
+  // Remembering everything, then forgetting all the time
+  for (const std::size_t max_directories : {std::size_t{65536}, std::size_t{8}}) {
+    fs::canonicalizer resolver(max_directories);
+    for (int pass = 0; pass < 3; ++pass) {
+      auto results = resolver.canonical_many(paths, policy);
+      for (std::size_t index = 0; index < paths.size(); ++index) {
+        INFO(paths[index]);
+        REQUIRE(!results[index].ec);
+        ComparePaths(results[index].path, expected[index]);
+      }
+    }
+    REQUIRE(resolver.size() <= max_directories);
+  }
+
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
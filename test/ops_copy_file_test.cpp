@@ -23,6 +23,10 @@
 
 #include "fs_testsuite.h"
 
+#if defined(ASAP_POSIX)
+#include <sys/stat.h>
+#endif
+
 using testing::ComparePaths;
 
 // -----------------------------------------------------------------------------
@@ -113,6 +117,121 @@ TEST_CASE("Ops / copy_file", "[common][filesystem][ops][copy_file]") {
   REQUIRE(file_size(to) == file_size(from));
 }
 
+TEST_CASE("Ops / copy_file / large", "[common][filesystem][ops][copy_file]") {
+  auto from = testing::nonexistent_path();
+  testing::scoped_file sfrom(from, testing::scoped_file::adopt_file);
+  auto to = testing::nonexistent_path();
+  testing::scoped_file sto(to, testing::scoped_file::adopt_file);
+
+  // Bigger than any of the internal buffers used to copy the data
+  std::string content;
+  for (auto i = 0; i < 5 * 1024 * 1024 / 16; ++i) {
+    content += "0123456789abcde" + std::string(1, static_cast<char>(i));
+  }
+  std::ofstream{from, std::ios::binary} << content;
+  REQUIRE(file_size(from) == content.size());
+
+  bool b = copy_file(from, to);
+  REQUIRE(b);
+  REQUIRE(fs::last_copy_file_strategy() != fs::copy_file_strategy::none);
+  REQUIRE(file_size(to) == content.size());
+  std::ifstream in{to, std::ios::binary};
+  std::string copied{std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>()};
+  REQUIRE(copied == content);
+}
+
+TEST_CASE("Ops / copy_file / sparse", "[common][filesystem][ops][copy_file]") {
+  auto from = testing::nonexistent_path();
+  testing::scoped_file sfrom(from, testing::scoped_file::adopt_file);
+  auto to = testing::nonexistent_path();
+  testing::scoped_file sto(to, testing::scoped_file::adopt_file);
+
+  // Seeking past the end of the file before writing leaves holes in the file
+  // on filesystems that support it.
+  const std::streamoff hole_size = 16 * 1024 * 1024;
+  {
+    std::ofstream out{from, std::ios::binary};
+    out.seekp(hole_size);
+    out << "data";
+    out.seekp(3 * hole_size);
+    out << "tail";
+  }
+  const auto size = static_cast<uintmax_t>(3 * hole_size + 4);
+  REQUIRE(file_size(from) == size);
+
+  bool b = copy_file(from, to);
+  REQUIRE(b);
+  REQUIRE(file_size(to) == size);
+  std::ifstream in{to, std::ios::binary};
+  std::string copied{std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>()};
+  REQUIRE(copied.size() == size);
+  REQUIRE(copied.substr(static_cast<size_t>(hole_size), 4) == "data");
+  REQUIRE(copied.substr(static_cast<size_t>(3 * hole_size), 4) == "tail");
+  REQUIRE(copied.find_first_not_of('\0') == static_cast<size_t>(hole_size));
+
+#if defined(ASAP_POSIX)
+  // If the source has holes, so does the destination.
+  struct ::stat from_st {};
+  struct ::stat to_st {};
+  REQUIRE(::stat(from.c_str(), &from_st) == 0);
+  REQUIRE(::stat(to.c_str(), &to_st) == 0);
+  if (from_st.st_blocks * 512 < from_st.st_size) {
+    REQUIRE(to_st.st_blocks * 512 < to_st.st_size);
+  }
+#endif
+}
+
+TEST_CASE("Ops / copy_file / buffer size", "[common][filesystem][ops][copy_file]") {
+  const auto default_size = fs::copy_file_buffer_size();
+
+  fs::copy_file_buffer_size(4 * 1024 * 1024);
+  REQUIRE(fs::copy_file_buffer_size() == 4 * 1024 * 1024);
+  // Out of range sizes are clamped
+  fs::copy_file_buffer_size(1);
+  REQUIRE(fs::copy_file_buffer_size() == 64 * 1024);
+  fs::copy_file_buffer_size(1024 * 1024 * 1024);
+  REQUIRE(fs::copy_file_buffer_size() == 16 * 1024 * 1024);
+
+  // Several buffers worth of data, copied through userspace
+  fs::copy_file_buffer_size(64 * 1024);
+  REQUIRE(!fs::copy_file_in_userspace());
+  fs::copy_file_in_userspace(true);
+  REQUIRE(fs::copy_file_in_userspace());
+  auto from = testing::nonexistent_path();
+  testing::scoped_file sfrom(from, testing::scoped_file::adopt_file);
+  auto to = testing::nonexistent_path();
+  testing::scoped_file sto(to, testing::scoped_file::adopt_file);
+  std::string content;
+  for (auto i = 0; i < 300 * 1024 / 16; ++i) {
+    content += "0123456789abcde" + std::string(1, static_cast<char>(i));
+  }
+  std::ofstream{from, std::ios::binary} << content;
+
+  bool b = copy_file(from, to);
+  fs::copy_file_in_userspace(false);
+  REQUIRE(b);
+#if defined(ASAP_WINDOWS)
+  REQUIRE(fs::last_copy_file_strategy() == fs::copy_file_strategy::win32_copy_file);
+#else
+  REQUIRE(fs::last_copy_file_strategy() == fs::copy_file_strategy::read_write);
+#endif
+  std::ifstream in{to, std::ios::binary};
+  std::string copied{std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>()};
+  REQUIRE(copied == content);
+
+  // A failed copy leaves the last strategy alone
+  const auto strategy = fs::last_copy_file_strategy();
+  std::error_code ec;
+  REQUIRE(!copy_file(testing::nonexistent_path(), to, ec));
+  REQUIRE(ec);
+  REQUIRE(fs::last_copy_file_strategy() == strategy);
+
+  fs::copy_file_buffer_size(default_size);
+}
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif // __clang__
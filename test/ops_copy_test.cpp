@@ -19,7 +19,9 @@
 #endif // __clang__
 
 #include <catch2/catch.hpp>
+#include <atomic>
 #include <fstream>
+#include <stdexcept>
 
 #include "fs_testsuite.h"
 
@@ -186,6 +188,82 @@ TEST_CASE("Ops / copy / directory", "[common][filesystem][ops][copy]") {
   REQUIRE(is_empty(to / "a/b/c"));
 }
 
+TEST_CASE("Ops / copy / parallel", "[common][filesystem][ops][copy]") {
+  auto from = testing::nonexistent_path();
+  testing::scoped_file sfrom(from, testing::scoped_file::adopt_file);
+  auto to = testing::nonexistent_path();
+  testing::scoped_file sto(to, testing::scoped_file::adopt_file);
+
+  for (auto dir : {"a", "a/b", "c"}) {
+    create_directories(from / dir);
+    for (auto i = 0; i < 20; ++i) {
+      std::ofstream{from / dir / ("f" + std::to_string(i))} << dir << i;
+    }
+  }
+  create_directories(from / "a/b/empty");
+
+  auto check_copy = [&]() {
+    REQUIRE(is_directory(to / "a/b/empty"));
+    for (auto dir : {"a", "a/b", "c"}) {
+      for (auto i = 0; i < 20; ++i) {
+        auto file = to / dir / ("f" + std::to_string(i));
+        REQUIRE(is_regular_file(file));
+        std::string content;
+        std::ifstream{file} >> content;
+        REQUIRE(content == dir + std::to_string(i));
+      }
+    }
+  };
+
+  SECTION("default thread pool") {
+    std::error_code ec = make_error_code(std::errc::invalid_argument);
+    copy(from, to, fs::copy_options::recursive, fs::parallel_policy{}, ec);
+    REQUIRE(!ec);
+    check_copy();
+  }
+
+  SECTION("thread pool") {
+    fs::parallel_policy policy;
+    policy.max_concurrency = 4;
+    copy(from, to, fs::copy_options::recursive, policy);
+    check_copy();
+  }
+
+  SECTION("custom executor") {
+    fs::parallel_policy policy;
+    policy.max_concurrency = 4;
+    std::atomic<int> runners{0};
+    policy.executor = [&runners](fs::parallel_policy::task task) {
+      ++runners;
+      task();
+    };
+    copy(from, to, fs::copy_options::recursive, policy);
+    REQUIRE(runners > 0);
+    check_copy();
+  }
+
+  SECTION("executor refusing tasks") {
+    fs::parallel_policy policy;
+    policy.max_concurrency = 4;
+    policy.executor = [](const fs::parallel_policy::task &) {
+      throw std::runtime_error("busy");
+    };
+    copy(from, to, fs::copy_options::recursive, policy);
+    check_copy();
+  }
+
+  SECTION("errors") {
+    create_directories(to / "c");
+    std::ofstream{to / "c/f7"} << "existing";
+    std::error_code ec;
+    copy(from, to, fs::copy_options::recursive, fs::parallel_policy{}, ec);
+    REQUIRE(ec == std::make_error_code(std::errc::file_exists));
+    REQUIRE_THROWS_AS(copy(from, to, fs::copy_options::recursive,
+                           fs::parallel_policy{}),
+                      fs::filesystem_error);
+  }
+}
+
 TEST_CASE("Ops / copy / no-op", "[common][filesystem][ops][copy]") {
   auto to = testing::nonexistent_path();
   std::error_code ec = std::make_error_code(std::errc::invalid_argument);
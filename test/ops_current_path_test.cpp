@@ -44,6 +44,35 @@ TEST_CASE("Ops / current_path", "[common][filesystem][ops]") {
   REQUIRE(canonical(fs::current_path(ec)) == canonical(oldwd));
 }
 
+TEST_CASE("Ops / current_path / cache", "[common][filesystem][ops]") {
+  REQUIRE(fs::current_path_cache_enabled());
+  auto oldwd = fs::current_path();
+  auto tmpdir = canonical(fs::temp_directory_path());
+
+  // Relative paths follow the changes made through the library
+  REQUIRE(fs::absolute("file") == oldwd / "file");
+  current_path(tmpdir);
+  REQUIRE(fs::absolute("file") == fs::current_path() / "file");
+  REQUIRE(canonical(fs::path(".")) == canonical(tmpdir));
+  current_path(oldwd);
+  REQUIRE(fs::absolute("file") == oldwd / "file");
+
+  // A failed change keeps the snapshot
+  std::error_code ec;
+  current_path(testing::nonexistent_path(), ec);
+  REQUIRE(ec);
+  REQUIRE(fs::absolute("file") == oldwd / "file");
+
+  fs::current_path_cache_enabled(false);
+  REQUIRE(!fs::current_path_cache_enabled());
+  current_path(tmpdir);
+  REQUIRE(fs::absolute("file") == fs::current_path() / "file");
+  current_path(oldwd);
+  REQUIRE(fs::absolute("file") == oldwd / "file");
+  fs::current_path_cache_enabled(true);
+  REQUIRE(fs::absolute("file") == oldwd / "file");
+}
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif // __clang__
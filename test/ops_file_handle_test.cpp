@@ -0,0 +1,186 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fs_testsuite.h"
+
+// -----------------------------------------------------------------------------
+//  file_handle
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Ops / file_handle / open", "[common][filesystem][ops][file_handle]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+
+  fs::file_handle closed;
+  REQUIRE(!closed.is_open());
+  REQUIRE(closed.path().empty());
+
+  // Not existing
+  fs::file_handle missing(p / "file", fs::open_flags::read, ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  REQUIRE(!missing.is_open());
+  REQUIRE_THROWS_AS(fs::file_handle(p / "file"), fs::filesystem_error);
+
+  // Created, then existing
+  fs::file_handle file(p / "file", fs::open_flags::write | fs::open_flags::create);
+  REQUIRE(file.is_open());
+  REQUIRE(file.path() == p / "file");
+  REQUIRE(fs::is_regular_file(file.status()));
+  fs::file_handle exclusive(
+      p / "file", fs::open_flags::write | fs::open_flags::create | fs::open_flags::exclusive, ec);
+  REQUIRE(ec == std::errc::file_exists);
+
+  // Inconsistent flags
+  fs::file_handle none(p / "file", fs::open_flags::none, ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  fs::file_handle read_create(p / "file", fs::open_flags::read | fs::open_flags::create, ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+
+  // Moving transfers the file
+  fs::file_handle other(std::move(file));
+  REQUIRE(!file.is_open());
+  REQUIRE(other.is_open());
+  other.close();
+  REQUIRE(!other.is_open());
+  char buffer[4];
+  other.pread(buffer, sizeof(buffer), 0, ec);
+  REQUIRE(ec == std::errc::bad_file_descriptor);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / file_handle / pread pwrite", "[common][filesystem][ops][file_handle]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "hello world");
+
+  fs::file_handle file(p / "file", fs::open_flags::read_write);
+  char buffer[16] = {};
+  REQUIRE(file.pread(buffer, 5, 6) == 5);
+  REQUIRE(std::string(buffer, 5) == "world");
+  // Short read at the end of the file, then nothing past it
+  REQUIRE(file.pread(buffer, sizeof(buffer), 6) == 5);
+  REQUIRE(file.pread(buffer, sizeof(buffer), 11) == 0);
+  REQUIRE(file.pread(buffer, sizeof(buffer), 100) == 0);
+
+  REQUIRE(file.pwrite("W", 1, 6) == 1);
+  REQUIRE(file.pwrite("!!", 2, 11) == 2);
+  REQUIRE(testing::ReadFile(p / "file") == "hello World!!");
+
+  // Several threads at different offsets
+  std::vector<std::thread> threads;
+  for (int index = 0; index < 8; ++index) {
+    threads.emplace_back([&file, index] {
+      const char value = static_cast<char>('0' + index);
+      file.pwrite(&value, 1, static_cast<std::uintmax_t>(index));
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(testing::ReadFile(p / "file") == "01234567rld!!");
+
+  // Not opened for writing
+  fs::file_handle read_only(p / "file");
+  read_only.pwrite("x", 1, 0, ec);
+  REQUIRE(ec);
+  REQUIRE_THROWS_AS(read_only.pwrite("x", 1, 0), fs::filesystem_error);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / file_handle / preadv pwritev", "[common][filesystem][ops][file_handle]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+
+  fs::file_handle file(p / "file", fs::open_flags::read_write | fs::open_flags::create);
+  const fs::const_io_buffer out[] = {{"hello", 5}, {" ", 1}, {"world", 5}};
+  REQUIRE(file.pwritev(out, 3, 2) == 11);
+  REQUIRE(testing::ReadFile(p / "file") == std::string("\0\0hello world", 13));
+
+  char first[5];
+  char second[20];
+  const fs::io_buffer in[] = {{first, sizeof(first)}, {second, sizeof(second)}};
+  REQUIRE(file.preadv(in, 2, 2) == 11);
+  REQUIRE(std::string(first, 5) == "hello");
+  REQUIRE(std::string(second, 6) == " world");
+
+  // More buffers than passed to the system at once
+  std::vector<std::string> parts;
+  std::vector<fs::const_io_buffer> many;
+  std::string expected;
+  for (int index = 0; index < 200; ++index) {
+    parts.push_back(std::to_string(index) + ",");
+    expected += parts.back();
+  }
+  for (const auto &part : parts) {
+    many.push_back({part.data(), part.size()});
+  }
+  REQUIRE(file.pwritev(many.data(), many.size(), 0) == expected.size());
+  std::vector<char> content(expected.size());
+  std::vector<fs::io_buffer> chunks;
+  for (std::size_t offset = 0; offset < content.size(); offset += 3) {
+    chunks.push_back({content.data() + offset, std::min<std::size_t>(3, content.size() - offset)});
+  }
+  REQUIRE(file.preadv(chunks.data(), chunks.size(), 0) == expected.size());
+  REQUIRE(std::string(content.begin(), content.end()) == expected);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / file_handle / fallocate fdatasync", "[common][filesystem][ops][file_handle]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+
+  fs::file_handle file(p / "file", fs::open_flags::write | fs::open_flags::create);
+  file.fallocate(0, 4096);
+  REQUIRE(file_size(p / "file") == 4096);
+  // Never shrinks the file
+  file.fallocate(0, 10);
+  REQUIRE(file_size(p / "file") == 4096);
+  file.fallocate(4000, 200);
+  REQUIRE(file_size(p / "file") == 4200);
+
+  REQUIRE(file.pwrite("hello", 5, 0) == 5);
+  file.fdatasync();
+  REQUIRE(testing::ReadFile(p / "file").substr(0, 5) == "hello");
+
+  fs::file_handle closed;
+  closed.fdatasync(ec);
+  REQUIRE(ec == std::errc::bad_file_descriptor);
+  REQUIRE_THROWS_AS(closed.fallocate(0, 1), fs::filesystem_error);
+
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
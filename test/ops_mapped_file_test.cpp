@@ -0,0 +1,165 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <stdexcept>
+#include <string>
+
+#include "fs_testsuite.h"
+
+// -----------------------------------------------------------------------------
+//  mapped_file
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Ops / mapped_file / read only", "[common][filesystem][ops][mapped_file]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "hello world");
+
+  fs::mapped_file file(p / "file");
+  REQUIRE(file.is_open());
+  REQUIRE(file.mode() == fs::map_mode::read_only);
+  REQUIRE(file.size() == 11);
+  REQUIRE(std::string(file.data(), file.size()) == "hello world");
+
+  auto view = file.view();
+  REQUIRE(std::string(view.begin(), view.end()) == "hello world");
+  REQUIRE(view[4] == 'o');
+  auto sub = view.subview(6);
+  REQUIRE(std::string(sub.begin(), sub.end()) == "world");
+  sub = view.subview(0, 5);
+  REQUIRE(std::string(sub.begin(), sub.end()) == "hello");
+  REQUIRE(view.subview(11).empty());
+  REQUIRE_THROWS_AS(view.subview(12), std::out_of_range);
+  view.advise(fs::map_advice::sequential);
+
+  // Moving transfers the mapping
+  fs::mapped_file other(std::move(file));
+  REQUIRE(!file.is_open());
+  REQUIRE(file.data() == nullptr);
+  REQUIRE(other.is_open());
+  REQUIRE(std::string(other.data(), other.size()) == "hello world");
+  other.close();
+  REQUIRE(!other.is_open());
+  REQUIRE(other.size() == 0);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / mapped_file / region", "[common][filesystem][ops][mapped_file]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  // Spans several pages, to map from an offset that is not page aligned
+  std::string content;
+  for (int i = 0; i < 20000; ++i) {
+    content += static_cast<char>('a' + i % 26);
+  }
+  testing::WriteFile(p / "file", content);
+
+  fs::map_options options;
+  options.offset = 10001;
+  options.length = 5000;
+  options.populate = true;
+  options.huge_pages = true;
+  options.advice = fs::map_advice::random;
+  fs::mapped_file file(p / "file", options);
+  REQUIRE(file.size() == 5000);
+  REQUIRE(std::string(file.data(), file.size()) == content.substr(10001, 5000));
+
+  // Up to the end of the file
+  options.length = 0;
+  file = fs::mapped_file(p / "file", options);
+  REQUIRE(std::string(file.data(), file.size()) == content.substr(10001));
+
+  // Past the end
+  options.offset = 20001;
+  fs::mapped_file past(p / "file", options, ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  REQUIRE(!past.is_open());
+  options.offset = 19000;
+  options.length = 1001;
+  REQUIRE_THROWS_AS(fs::mapped_file(p / "file", options), fs::filesystem_error);
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / mapped_file / read write", "[common][filesystem][ops][mapped_file]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "hello world");
+
+  fs::map_options options;
+  options.mode = fs::map_mode::read_write;
+  fs::mapped_file file(p / "file", options);
+  REQUIRE(file.mode() == fs::map_mode::read_write);
+  file.data()[0] = 'H';
+  file.data()[6] = 'W';
+  file.flush();
+  REQUIRE(testing::ReadFile(p / "file") == "Hello World");
+
+  // Written to the file even when not flushed
+  file.data()[10] = 'D';
+  file.close();
+  REQUIRE(testing::ReadFile(p / "file") == "Hello WorlD");
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / mapped_file / empty", "[common][filesystem][ops][mapped_file]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "");
+
+  fs::mapped_file file(p / "file", {}, ec);
+  REQUIRE(!ec);
+  REQUIRE(file.is_open());
+  REQUIRE(file.data() == nullptr);
+  REQUIRE(file.size() == 0);
+  REQUIRE(file.view().empty());
+  file.flush();
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / mapped_file / errors", "[common][filesystem][ops][mapped_file]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+
+  fs::mapped_file file(p, {}, ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  REQUIRE(!file.is_open());
+  REQUIRE_THROWS_AS(fs::mapped_file(p), fs::filesystem_error);
+
+  create_directory(p);
+  fs::mapped_file dir(p, {}, ec);
+  REQUIRE(ec);
+  REQUIRE(!dir.is_open());
+
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
@@ -304,6 +304,83 @@ TEST_CASE("Ops / remove_all / multiple levels", "[common][filesystem][ops][remov
   REQUIRE(!exists(dir));
 }
 
+TEST_CASE("Ops / remove_all / parallel", "[common][filesystem][ops][remove_all]") {
+  std::error_code ec;
+  const std::error_code bad_ec = make_error_code(std::errc::invalid_argument);
+
+  fs::parallel_policy policy;
+  policy.max_concurrency = GENERATE(1, 4);
+
+  auto n = remove_all(testing::nonexistent_path(), policy, ec);
+  REQUIRE(!ec);
+  REQUIRE(n == 0);
+
+  // A tree with a symlink to a directory outside of it, which must not be
+  // followed.
+  const auto outside = testing::nonexistent_path();
+  create_directories(outside / "keep");
+  const auto dir = testing::nonexistent_path();
+  std::uintmax_t entries = 1;
+  for (auto sub : {"a", "a/b", "a/b/c", "d", "e"}) {
+    create_directories(dir / sub);
+    ++entries;
+    for (auto i = 0; i < 10; ++i) {
+      testing::scoped_file file(dir / sub / ("f" + std::to_string(i)));
+      file.path_.clear();
+      ++entries;
+    }
+  }
+#if !defined(ASAP_WINDOWS)
+  create_directory_symlink(outside, dir / "a/b/link");
+  ++entries;
+#endif
+
+  ec = bad_ec;
+  n = remove_all(dir, policy, ec);
+  REQUIRE(!ec);
+  REQUIRE(n == entries);
+  REQUIRE(!exists(symlink_status(dir)));
+  REQUIRE(exists(outside / "keep"));
+
+  testing::scoped_file file(dir);
+  n = remove_all(dir, policy);
+  REQUIRE(n == 1);
+  REQUIRE(!exists(dir));
+  file.path_.clear();
+
+  remove_all(outside);
+}
+
+#if !defined(ASAP_WINDOWS)
+TEST_CASE("Ops / remove_all / errors", "[common][filesystem][ops][remove_all]") {
+  std::error_code ec;
+
+  const auto dir = testing::nonexistent_path();
+  create_directories(dir / "a/b");
+  testing::scoped_file file(dir / "a/b/f");
+  file.path_.clear();
+  // The files of a directory which cannot be written can't be removed
+  permissions(dir / "a/b", fs::perms::owner_write, fs::perm_options::remove);
+
+  auto n = remove_all(dir, ec);
+  REQUIRE(ec == std::make_error_code(std::errc::permission_denied));
+  REQUIRE(n == static_cast<std::uintmax_t>(-1));
+  REQUIRE(exists(dir / "a/b/f"));
+
+  ec.clear();
+  n = remove_all(dir, fs::parallel_policy{}, ec);
+  REQUIRE(ec == std::make_error_code(std::errc::permission_denied));
+  REQUIRE(n == static_cast<std::uintmax_t>(-1));
+  REQUIRE(exists(dir / "a/b/f"));
+  REQUIRE_THROWS_AS(remove_all(dir, fs::parallel_policy{}),
+                    fs::filesystem_error);
+
+  permissions(dir / "a/b", fs::perms::owner_write, fs::perm_options::add);
+  remove_all(dir);
+  REQUIRE(!exists(dir));
+}
+#endif
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif // __clang__
@@ -0,0 +1,250 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "fs_testsuite.h"
+
+namespace {
+
+// Enables the cache for one test only, the others run without it.
+class StatCacheScope {
+ public:
+  explicit StatCacheScope(const fs::stat_cache_options &options = {}) {
+    fs::enable_stat_cache(options);
+  }
+  StatCacheScope(const StatCacheScope &) = delete;
+  auto operator=(const StatCacheScope &) -> StatCacheScope & = delete;
+  ~StatCacheScope() { fs::disable_stat_cache(); }
+};
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+//  stat cache
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Ops / stat_cache / hits", "[common][filesystem][ops][stat_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "hello");
+  create_symlink("file", p / "link");
+
+  REQUIRE(!fs::stat_cache_enabled());
+  StatCacheScope scope;
+  REQUIRE(fs::stat_cache_enabled());
+
+  // One system call, then answered from the cache
+  REQUIRE(is_regular_file(status(p / "file")));
+  REQUIRE(file_size(p / "file") == 5);
+  REQUIRE(last_write_time(p / "file") != fs::file_time_type::min());
+  REQUIRE(!is_empty(p / "file"));
+  // Only the POSIX implementation keeps the attributes it gets
+#if !defined(ASAP_WINDOWS)
+  auto stats = fs::stat_cache_statistics();
+  REQUIRE(stats.misses == 1);
+  REQUIRE(stats.hits == 3);
+  REQUIRE(stats.size == 1);
+
+  // Following symlinks or not are cached apart
+#endif
+  REQUIRE(is_symlink(symlink_status(p / "link")));
+  REQUIRE(is_regular_file(status(p / "link")));
+  REQUIRE(is_symlink(symlink_status(p / "link")));
+#if !defined(ASAP_WINDOWS)
+  stats = fs::stat_cache_statistics();
+  REQUIRE(stats.misses == 3);
+  REQUIRE(stats.hits == 4);
+  REQUIRE(stats.size == 2);
+#endif
+
+  // So is the absence of a file
+  REQUIRE(!exists(p / "missing"));
+  REQUIRE(!exists(p / "missing"));
+  REQUIRE(status(p / "missing", ec).type() == fs::file_type::not_found);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  REQUIRE_THROWS_AS(file_size(p / "missing"), fs::filesystem_error);
+#if !defined(ASAP_WINDOWS)
+  stats = fs::stat_cache_statistics();
+  REQUIRE(stats.misses == 4);
+  REQUIRE(stats.hits == 7);
+#endif
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / stat_cache / invalidation", "[common][filesystem][ops][stat_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  StatCacheScope scope;
+
+  // Changes made through the library are seen at once
+  REQUIRE(!exists(p));
+  create_directory(p);
+  REQUIRE(is_directory(p));
+  testing::WriteFile(p / "file", "hello");
+  REQUIRE(file_size(p / "file") == 5);
+  resize_file(p / "file", 2);
+  REQUIRE(file_size(p / "file") == 2);
+  permissions(p / "file", fs::perms::owner_read);
+  REQUIRE(status(p / "file").permissions() == fs::perms::owner_read);
+  permissions(p / "file", fs::perms::owner_all);
+  rename(p / "file", p / "renamed");
+  REQUIRE(!exists(p / "file"));
+  REQUIRE(file_size(p / "renamed") == 2);
+  copy_file(p / "renamed", p / "copy");
+  REQUIRE(file_size(p / "copy") == 2);
+  REQUIRE(remove(p / "copy"));
+  REQUIRE(!exists(p / "copy"));
+
+  // Other changes are seen after invalidating...
+  testing::WriteFile(p / "renamed", "hello world");
+#if !defined(ASAP_WINDOWS)
+  REQUIRE(file_size(p / "renamed") == 2);
+#endif
+  fs::invalidate_stat_cache(p / "renamed");
+  REQUIRE(file_size(p / "renamed") == 11);
+  testing::WriteFile(p / "renamed", "hello");
+  fs::clear_stat_cache();
+  REQUIRE(file_size(p / "renamed") == 5);
+
+  // ...or once expired
+  fs::enable_stat_cache({std::chrono::milliseconds(1), 100});
+  REQUIRE(file_size(p / "renamed") == 5);
+  testing::WriteFile(p / "renamed", "hi");
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(file_size(p / "renamed") == 2);
+
+  remove_all(p, ec);
+  REQUIRE(!exists(p));
+}
+
+TEST_CASE("Ops / stat_cache / parent directory", "[common][filesystem][ops][stat_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "hello");
+  StatCacheScope scope;
+
+  // Adding or removing an entry changes the modification time of its directory
+  const auto old_time = last_write_time(p) - std::chrono::hours(1);
+  const auto check_parent = [&](const std::function<void()> &change) {
+    last_write_time(p, old_time);
+    REQUIRE(last_write_time(p) == old_time);
+    change();
+    REQUIRE(last_write_time(p) > old_time);
+  };
+  check_parent([&]() { create_directory(p / "dir"); });
+  check_parent([&]() { REQUIRE(remove(p / "dir")); });
+  check_parent([&]() { create_symlink("file", p / "link"); });
+  check_parent([&]() { create_hard_link(p / "file", p / "hard"); });
+  check_parent([&]() { copy_file(p / "file", p / "copy"); });
+  check_parent([&]() {
+    fs::file_handle created(p / "created", fs::open_flags::write | fs::open_flags::create);
+  });
+  REQUIRE(hard_link_count(p / "file") == 2);
+  fs::async_queue queue;
+  check_parent([&]() { REQUIRE(queue.create_directory(p / "async").get()); });
+  check_parent([&]() { REQUIRE(queue.remove(p / "async").get()); });
+
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / stat_cache / file handles", "[common][filesystem][ops][stat_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "hello");
+  StatCacheScope scope;
+
+  // What is written through a file handle is seen at once
+  REQUIRE(file_size(p / "file") == 5);
+  fs::file_handle file(p / "file", fs::open_flags::read_write | fs::open_flags::truncate);
+  REQUIRE(file_size(p / "file") == 0);
+  REQUIRE(file.pwrite("hello world", 11, 0) == 11);
+  REQUIRE(file_size(p / "file") == 11);
+  const fs::const_io_buffer out[] = {{"hello", 5}, {"world", 5}};
+  REQUIRE(file.pwritev(out, 2, 11) == 10);
+  REQUIRE(file_size(p / "file") == 21);
+  file.fallocate(0, 100);
+  REQUIRE(file_size(p / "file") == 100);
+
+  REQUIRE(!exists(p / "created"));
+  fs::file_handle created(p / "created", fs::open_flags::write | fs::open_flags::create);
+  REQUIRE(exists(p / "created"));
+
+  file.close();
+  created.close();
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / stat_cache / mapped files", "[common][filesystem][ops][stat_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  testing::WriteFile(p / "file", "hello world");
+  const auto old_time = last_write_time(p / "file") - std::chrono::hours(1);
+  last_write_time(p / "file", old_time);
+  StatCacheScope scope;
+
+  // What is written through a mapping is seen once flushed
+  REQUIRE(last_write_time(p / "file") == old_time);
+  fs::map_options options;
+  options.mode = fs::map_mode::read_write;
+  fs::mapped_file file(p / "file", options);
+  file.data()[0] = 'H';
+  file.flush();
+  REQUIRE(last_write_time(p / "file") > old_time);
+
+  file.close();
+  remove_all(p, ec);
+}
+
+TEST_CASE("Ops / stat_cache / eviction", "[common][filesystem][ops][stat_cache]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directory(p);
+  StatCacheScope scope({std::chrono::seconds(10), 16});
+
+  for (int index = 0; index < 200; ++index) {
+    exists(p / std::to_string(index));
+  }
+#if !defined(ASAP_WINDOWS)
+  auto stats = fs::stat_cache_statistics();
+  REQUIRE(stats.size <= 16);
+  REQUIRE(stats.evictions == 200 - stats.size);
+  REQUIRE(stats.misses == 200);
+#endif
+
+  fs::disable_stat_cache();
+  REQUIRE(!fs::stat_cache_enabled());
+  REQUIRE(fs::stat_cache_statistics().size == 0);
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
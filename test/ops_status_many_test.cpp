@@ -0,0 +1,98 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include "fs_testsuite.h"
+
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+//  status_many
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Ops / status_many", "[common][filesystem][ops][status_many]") {
+  std::error_code ec;
+  const auto p = testing::nonexistent_path();
+  create_directories(p / "dir");
+  std::vector<path> paths;
+  for (int index = 0; index < 100; ++index) {
+    const auto file = p / ("file" + std::to_string(index));
+    std::ofstream stream{file};
+    stream << std::string(static_cast<std::size_t>(index), 'x');
+    paths.push_back(file);
+  }
+  paths.push_back(p / "dir");
+  paths.push_back(p / "dir" / "");
+  paths.push_back(p / "dir" / "..");
+  paths.push_back(p / "missing");
+  paths.push_back(p / "missing" / "file");
+  paths.push_back(p);
+  paths.push_back(fs::current_path().root_path());
+  paths.push_back("");
+
+  const auto fields = fs::status_fields::size | fs::status_fields::last_write_time;
+  SECTION("gives the same results as status(), file_size() and last_write_time()") {
+    std::vector<fs::status_result> results;
+    const bool parallel = GENERATE(false, true);
+    if (parallel) {
+      fs::parallel_policy policy;
+      policy.max_concurrency = 4;
+      results = status_many(paths, fields, policy);
+    } else {
+      results = status_many(paths, fields);
+    }
+    REQUIRE(results.size() == paths.size());
+    for (std::size_t index = 0; index < paths.size(); ++index) {
+      const auto &result = results[index];
+      std::error_code status_ec;
+      const auto st = status(paths[index], status_ec);
+      REQUIRE(result.status.type() == st.type());
+      REQUIRE(result.status.permissions() == st.permissions());
+      REQUIRE(result.ec == status_ec);
+      if (is_regular_file(st)) {
+        REQUIRE(result.size == file_size(paths[index]));
+      } else {
+        REQUIRE(result.size == static_cast<std::uintmax_t>(-1));
+      }
+      if (status_ec) {
+        REQUIRE(result.last_write_time == fs::file_time_type::min());
+      } else {
+        REQUIRE(result.last_write_time == last_write_time(paths[index]));
+      }
+    }
+  }
+
+  SECTION("only fetches the fields asked for") {
+    std::vector<fs::status_result> results(paths.size());
+    status_many(paths.data(), paths.size(), fs::status_fields::none,
+                results.data());
+    REQUIRE(is_regular_file(results.front().status));
+    REQUIRE(results.front().size == static_cast<std::uintmax_t>(-1));
+    REQUIRE(results.front().last_write_time == fs::file_time_type::min());
+  }
+
+  remove_all(p, ec);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
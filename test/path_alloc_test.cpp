@@ -0,0 +1,134 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <cstddef>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "fs_testsuite.h"
+
+// Counts the allocations made by the current thread. This file is built in a
+// test executable of its own, so that replacing operator new does not affect
+// the other tests.
+
+namespace {
+thread_local std::size_t allocations = 0;
+}  // namespace
+
+auto operator new(std::size_t size) -> void * {
+  ++allocations;
+  if (void *block = std::malloc(size == 0 ? 1 : size)) {
+    return block;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *block) noexcept { std::free(block); }
+
+void operator delete(void *block, std::size_t /*size*/) noexcept {
+  std::free(block);
+}
+
+namespace {
+template <typename Work>
+auto CountAllocations(Work work) -> std::size_t {
+  const auto before = allocations;
+  work();
+  return allocations - before;
+}
+}  // namespace
+
+using fs::small_path;
+
+// -----------------------------------------------------------------------------
+//  Allocations
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Path / allocations / short path", "[common][filesystem][path][allocations]") {
+  // Pathnames that fit the small string buffer of std::string
+  for (const auto *str : {"", "/", "file.txt", "/usr/lib", "a/b/c/d/e/f/g"}) {
+    CAPTURE(str);
+    REQUIRE(CountAllocations([str]() {
+              const path p(str);
+              path copy(p);  // NOLINT(performance-unnecessary-copy-initialization)
+              const path moved(std::move(copy));
+              path assigned;
+              assigned = p;
+              (void)(p == moved);
+              (void)(p < assigned);
+              (void)hash_value(p);
+              (void)p.has_root_directory();
+              (void)p.has_filename();
+              (void)p.is_absolute();
+              (void)p.filename();
+              (void)p.parent_path();
+            }) == 0);
+  }
+}
+
+TEST_CASE("Path / allocations / iteration", "[common][filesystem][path][allocations]") {
+  const path p("a/b/c/d");
+  // The components are built once, for the first iteration
+  REQUIRE(CountAllocations([&p]() { (void)std::distance(p.begin(), p.end()); }) != 0);
+  REQUIRE(CountAllocations([&p]() { (void)std::distance(p.begin(), p.end()); }) == 0);
+  // and are not copied with the path
+  REQUIRE(CountAllocations([&p]() { const path copy(p); }) == 0);
+}
+
+TEST_CASE("Path / allocations / compare", "[common][filesystem][path][allocations]") {
+  const path lhs("/home/user/projects/asap/build/src/fs_path.cpp");
+  const path rhs("/home/user/projects/asap//build/src/fs_path.hpp");
+  REQUIRE(CountAllocations([&lhs, &rhs]() {
+            (void)(lhs == rhs);
+            (void)(lhs < rhs);
+            (void)lhs.compare(rhs);
+            (void)hash_value(lhs);
+          }) == 0);
+}
+
+TEST_CASE("Path / allocations / small_path", "[common][filesystem][path][allocations]") {
+  const std::string name(40, 'n');
+  REQUIRE(CountAllocations([&name]() {
+            small_path<> sp("/home/user/projects/asap/build");
+            sp /= "src";
+            sp /= name.c_str();
+            sp += ".cpp";
+            small_path<> copy(sp);  // NOLINT(performance-unnecessary-copy-initialization)
+            const small_path<> moved(std::move(copy));
+            small_path<> assigned;
+            assigned = moved;
+            (void)assigned.c_str();
+          }) == 0);
+
+  // Beyond its inline buffer, a small_path moves its pathname to the heap
+  REQUIRE(CountAllocations([&name]() {
+            small_path<32> sp("/home/user/projects/asap/build");
+            sp /= name.c_str();
+          }) != 0);
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__
@@ -0,0 +1,106 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+// Times the construction and the append of typical deep paths, with and
+// without splitting them into components, which is what every path used to
+// pay for before the split was deferred to the first decomposition or
+// iteration.
+//
+// Usage: asap_filesystem_path_benchmark [iterations]
+
+#include <filesystem/fs_path.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using asap::filesystem::path;
+
+namespace {
+
+// Keeps the compiler from optimizing the work away
+volatile std::size_t sink;
+
+auto DeepPaths() -> std::vector<std::string> {
+  return {"/usr/local/include/asap/filesystem/fs_path.h",
+          "/home/user/projects/asap/build/src/CMakeFiles/fs_path.cpp.o",
+          "relative/path/to/some/source/file.cpp",
+          "/var/lib/docker/overlay2/l/ABCDEFGHIJKLMNOP/diff/etc/hosts",
+          "a/b/c/d/e/f/g/h/i/j"};
+}
+
+template <typename Work>
+void Time(const char *name, std::size_t iterations, Work work) {
+  const auto start = std::chrono::steady_clock::now();
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    total += work();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  sink = total;
+  const auto nanos =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  std::printf("%-32s %10.1f ns/op\n", name,
+              static_cast<double>(nanos) / static_cast<double>(iterations));
+}
+
+auto Distance(const path &p) -> std::size_t {
+  std::size_t count = 0;
+  for (auto it = p.begin(); it != p.end(); ++it) {
+    ++count;
+  }
+  return count;
+}
+
+}  // namespace
+
+auto main(int argc, char *argv[]) -> int {
+  std::size_t iterations = 200000;
+  if (argc > 1) {
+    iterations = static_cast<std::size_t>(std::strtoul(argv[1], nullptr, 10));
+  }
+  const auto strings = DeepPaths();
+  const path base("/home/user/projects/asap");
+
+  Time("construct", iterations, [&strings]() {
+    std::size_t size = 0;
+    for (const auto &str : strings) {
+      size += path(str).native().size();
+    }
+    return size;
+  });
+  Time("construct + split", iterations, [&strings]() {
+    std::size_t size = 0;
+    for (const auto &str : strings) {
+      size += Distance(path(str));
+    }
+    return size;
+  });
+  Time("append", iterations, [&base]() {
+    path p(base);
+    p /= "build";
+    p /= "src";
+    p /= "fs_path.cpp";
+    return p.native().size();
+  });
+  Time("append + split", iterations, [&base]() {
+    path p(base);
+    p /= "build";
+    p /= "src";
+    p /= "fs_path.cpp";
+    return Distance(p);
+  });
+  Time("compare", iterations, [&strings]() {
+    std::size_t equal = 0;
+    for (const auto &str : strings) {
+      equal += path(str) == path(str) ? 1 : 0;
+    }
+    return equal;
+  });
+  return 0;
+}
@@ -20,7 +20,10 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <catch2/catch.hpp>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "fs_testsuite.h"
@@ -153,6 +156,109 @@ TEST_CASE("Path / iterator / special cases", "[common][filesystem][path][iterato
   }
 }
 
+TEST_CASE("Path / iterator / dereference", "[common][filesystem][path][iterator]") {
+  path p("/a/bb/a_component_longer_than_the_small_string_buffer");
+  const auto last = *std::prev(p.end());
+  const auto first = *p.begin();
+  p.remove_filename();
+  p /= "c";
+  REQUIRE(first.native() == path("/").native());
+  REQUIRE(last.native() == "a_component_longer_than_the_small_string_buffer");
+  REQUIRE(std::prev(p.end())->native() == "c");
+  REQUIRE(std::next(p.begin())->native() == "a");
+}
+
+TEST_CASE("Path / iterator / references", "[common][filesystem][path][iterator]") {
+  const path p("a/bb/ccc");
+  std::vector<const path *> addresses;
+  for (auto &cmpt : p) {
+    addresses.push_back(&cmpt);
+  }
+  REQUIRE(addresses.size() == 3);
+
+  // The components live in the path, not in the iterators
+  auto it = p.begin();
+  const path &first = *it;
+  auto copy = it;
+  ++it;
+  REQUIRE(&*copy == &first);
+  REQUIRE(&*p.begin() == addresses[0]);
+  REQUIRE(it->native() == "bb");
+
+  std::reverse_iterator<path::iterator> rit(p.end());
+  REQUIRE(rit->native() == "ccc");
+  REQUIRE(&*rit == addresses[2]);
+}
+
+TEST_CASE("Path / iterator / many components", "[common][filesystem][path][iterator]") {
+  // Many components, built again after each append
+  path p("/");
+  std::vector<std::string> names;
+  for (auto i = 0; i < 20; ++i) {
+    names.push_back(std::to_string(i));
+    p /= names.back();
+    REQUIRE(std::distance(p.begin(), p.end()) == i + 2);
+  }
+
+  path copy = p;  // NOLINT(performance-unnecessary-copy-initialization)
+  path assigned("a/b");
+  REQUIRE(std::distance(assigned.begin(), assigned.end()) == 2);
+  assigned = copy;
+  path moved = std::move(copy);
+  for (const path *cur : {&p, &assigned, &moved}) {
+    REQUIRE(std::distance(cur->begin(), cur->end()) == 21);
+    auto it = std::next(cur->begin());
+    for (const auto &name : names) {
+      REQUIRE(it->native() == name);
+      ++it;
+    }
+  }
+
+  p.swap(assigned);
+  REQUIRE(p == moved);
+  REQUIRE(assigned == moved);
+  assigned = "x/y";
+  REQUIRE(std::distance(assigned.begin(), assigned.end()) == 2);
+}
+
+TEST_CASE("Path / iterator / deferred split", "[common][filesystem][path][iterator]") {
+  for (const auto &str : TEST_PATHS()) {
+    const path split(str);
+    REQUIRE(std::distance(split.begin(), split.end()) >= 0);
+    CAPTURE(split);
+
+    // Each query starts from a path that was not split yet
+    REQUIRE(path(str).has_root_name() == split.has_root_name());
+    REQUIRE(path(str).has_root_directory() == split.has_root_directory());
+    REQUIRE(path(str).has_filename() == split.has_filename());
+    REQUIRE(path(str).is_absolute() == split.is_absolute());
+    REQUIRE(path(str).filename().native() == split.filename().native());
+    REQUIRE((path(str) / "x").native() == (split / "x").native());
+    REQUIRE((path(str) / "/x").native() == (split / "/x").native());
+
+    const path fresh(str);
+    path copy = fresh;  // NOLINT(performance-unnecessary-copy-initialization)
+    testing::ComparePaths(copy, split);
+    REQUIRE(std::equal(fresh.begin(), fresh.end(), split.begin(), split.end()));
+  }
+
+  // The first iteration of the same path from several threads
+  const path deep("a/b/c/d/e/f/g/h");
+  std::atomic<int> matches{0};
+  std::vector<std::thread> threads;
+  for (auto i = 0; i < 4; ++i) {
+    threads.emplace_back([&deep, &matches]() {
+      if (std::distance(deep.begin(), deep.end()) == 8) {
+        ++matches;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(matches == 4);
+}
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif // __clang__
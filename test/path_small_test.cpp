@@ -0,0 +1,113 @@
+//        Copyright The Authors 2018.
+//    Distributed under the 3-Clause BSD License.
+//    (See accompanying file LICENSE or copy at
+//   https://opensource.org/licenses/BSD-3-Clause)
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+// Catch2 uses a lot of macro names that will make clang go crazy
+#if (__clang_major__ >= 13) && !defined(__APPLE__)
+#pragma clang diagnostic ignored "-Wreserved-identifier"
+#endif
+// Big mess created because of the way spdlog is organizing its source code
+// based on header only builds vs library builds. The issue is that spdlog
+// places the template definitions in a separate file and explicitly
+// instantiates them, so we have no problem at link, but we do have a problem
+// with clang (rightfully) complaining that the template definitions are not
+// available when the template needs to be instantiated here.
+#pragma clang diagnostic ignored "-Wundefined-func-template"
+#endif // __clang__
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fs_testsuite.h"
+
+using fs::small_path;
+using testing::TEST_PATHS;
+
+// -----------------------------------------------------------------------------
+//  small_path
+// -----------------------------------------------------------------------------
+
+TEST_CASE("Path / small_path / construct", "[common][filesystem][path][small_path]") {
+  small_path<> empty;
+  REQUIRE(empty.empty());
+  REQUIRE(std::string(empty.c_str()).empty());
+
+  for (const auto &str : TEST_PATHS()) {
+    const small_path<> from_string(str);
+    const small_path<> from_path(path{str});
+    REQUIRE(from_string.c_str() == str);
+    REQUIRE(from_string.size() == str.size());
+    REQUIRE(from_path.c_str() == path(str).native());
+    REQUIRE(from_string.to_path().native() == path(str).native());
+  }
+}
+
+TEST_CASE("Path / small_path / append", "[common][filesystem][path][small_path]") {
+  // Appending follows the rules of path. The pathnames may differ only in the
+  // separators, as path trims a pathname made only of separators.
+  for (const auto &lhs : TEST_PATHS()) {
+    for (const auto &rhs : TEST_PATHS()) {
+      small_path<> sp(lhs);
+      sp /= rhs;
+      CAPTURE(lhs);
+      CAPTURE(rhs);
+      REQUIRE(path(sp.c_str()) == path(lhs) / rhs);
+    }
+  }
+
+  small_path<> sp("a");
+  sp /= sp;
+  REQUIRE(sp.c_str() == (path("a") / "a").native());
+  sp += ".txt";
+  sp += '~';
+  REQUIRE(sp.c_str() == (path("a") / "a").native() + ".txt~");
+}
+
+TEST_CASE("Path / small_path / overflow", "[common][filesystem][path][small_path]") {
+  small_path<8> sp("abc");
+  REQUIRE(sp.is_inline());
+  sp /= "def";
+  REQUIRE(sp.is_inline());
+  sp /= "ghi";
+  REQUIRE_FALSE(sp.is_inline());
+  const auto expected = (path("abc") / "def" / "ghi").native();
+  REQUIRE(sp.c_str() == expected);
+
+  small_path<8> copy(sp);
+  REQUIRE(copy.c_str() == expected);
+  small_path<8> moved(std::move(copy));
+  REQUIRE(moved.c_str() == expected);
+  REQUIRE(copy.empty());  // NOLINT(bugprone-use-after-move)
+
+  moved = "short";
+  REQUIRE(moved.is_inline());
+  REQUIRE(std::string(moved.c_str()) == "short");
+
+  swap(sp, moved);
+  REQUIRE(std::string(sp.c_str()) == "short");
+  REQUIRE(moved.c_str() == expected);
+}
+
+TEST_CASE("Path / small_path / interoperability", "[common][filesystem][path][small_path]") {
+  small_path<> sp(path("dir"));
+  sp /= path("file.txt");
+  const path p = sp;
+  REQUIRE(p == path("dir") / "file.txt");
+  REQUIRE(sp == p);
+  REQUIRE(p.filename() == "file.txt");
+
+  testing::scoped_file file;
+  const small_path<> name(file.path_);
+  REQUIRE(fs::exists(name));
+  REQUIRE(fs::is_regular_file(name));
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif // __clang__